@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "stencil.h"
+#include "relax.h"
+#include "rng.h"
+
+#define BILLION 1000000000L
+
+#define MAX_LIST 32 /* Most values any one swept flag can take */
+
+/* Bytes each relaxation has to move per interior cell if neighbours come from cache.
+ * Jacobi reads values and writes newValues, red-black reads and writes the array
+ * once per colour */
+#define JACOBI_BYTES 16
+#define RED_BLACK_BYTES 32
+
+const char *methodNames[] = { "jacobi", "gs", "sor", "multigrid" };
+const char *arithmeticNames[] = { "double", "float", "mixed" };
+
+struct Timing {
+	uint64_t median;
+	uint64_t p95;
+	int count; // Relaxations, or cycles for multigrid, on the last repeat
+	int floatCount; // Of count, how many were in float
+};
+
+/* Splits a comma separated list into at most MAX_LIST numbers. Returns how many,
+ * 0 if any of them isn't positive */
+int parseList(const char *text, double *list) {
+	int n = 0;
+	const char *c = text;
+
+	while (*c != '\0' && n < MAX_LIST) {
+		char *end;
+		list[n] = strtod(c, &end);
+		if (end == c || list[n] <= 0)
+			return 0;
+		n++;
+		c = *end == ',' ? end + 1 : end;
+		if (*end != ',' && *end != '\0')
+			return 0;
+	}
+
+	return n;
+}
+
+/* Splits a comma separated list of names into their indexes in names. Returns how
+ * many, 0 if any of them isn't one of the nameCount names */
+int parseNames(const char *text, const char **names, int nameCount, int *list) {
+	int n = 0;
+	const char *c = text;
+
+	while (*c != '\0' && n < MAX_LIST) {
+		size_t length = strcspn(c, ",");
+		int m;
+		for (m = 0; m < nameCount; m++) {
+			if (strlen(names[m]) == length && strncmp(c, names[m], length) == 0)
+				break;
+		}
+		if (m == nameCount)
+			return 0;
+		list[n++] = m;
+		c += length;
+		if (*c == ',')
+			c++;
+	}
+
+	return n;
+}
+
+uint64_t elapsed(struct timespec *start, struct timespec *end) {
+	return BILLION * (end->tv_sec - start->tv_sec) + end->tv_nsec - start->tv_nsec;
+}
+
+int compareTimes(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+/* Median and 95th percentile (nearest rank) of times, which gets sorted */
+void summarise(uint64_t *times, int repeats, struct Timing *timing) {
+	qsort(times, repeats, sizeof(uint64_t), compareTimes);
+	timing->median = repeats % 2 ? times[repeats / 2] : (times[repeats / 2 - 1] + times[repeats / 2]) / 2;
+	timing->p95 = times[(95 * repeats + 99) / 100 - 1];
+}
+
+/* The loop from sequential.c, so parallel efficiency is measured against the real
+ * single threaded program rather than the pool with one thread */
+int relaxSequential(double *values, double *newValues, int dimension, double precision,
+					enum Method method, double omega) {
+	int count = 0;
+	int withinPrecision = 0;
+	int i, colour;
+
+	while (!withinPrecision) {
+		withinPrecision = 1;
+		count++;
+
+		if (method != METHOD_JACOBI) {
+			for (colour = 0; colour < 2; colour++) {
+				for (i = 1; i < dimension - 1; i++) {
+					int first = (i + 1) % 2 == colour ? 1 : 2;
+					double delta = relaxRowColour(values + i*dimension, values + (i-1)*dimension,
+												  values + (i+1)*dimension, first, dimension - 1, omega);
+					if (delta > precision)
+						withinPrecision = 0;
+				}
+			}
+			continue;
+		}
+
+		for (i = 1; i < dimension - 1; i++) {
+			double delta = relaxRow(values + i*dimension, values + (i-1)*dimension, values + (i+1)*dimension,
+									newValues + i*dimension, 1, dimension - 1);
+			if (delta > precision)
+				withinPrecision = 0;
+		}
+		double *tempValues = values;
+		values = newValues;
+		newValues = tempValues;
+	}
+
+	return count;
+}
+
+/* Times warmup + repeats solves of a fresh copy of grid, keeping the last repeats.
+ * pool is NULL for the sequential loop. Returns 0 if memory ran out */
+int timeSolves(struct RelaxPool *pool, const struct RelaxOptions *options, const double *grid,
+			   int dimension, int warmup, int repeats, struct Timing *timing) {
+	size_t bytes = (size_t)dimension * dimension * sizeof(double);
+	// Placed the way parallel places its array, so the pool runs see the same memory layout
+	double *values = pool != NULL ? relaxAllocate(pool, dimension, dimension, options) : malloc(bytes);
+	double *newValues = pool != NULL ? NULL : malloc(bytes);
+	uint64_t *times = malloc(repeats * sizeof(uint64_t));
+	struct timespec start, end;
+	struct RelaxResult result;
+	int stalled = 0;
+	int r;
+	int ok = values != NULL && (pool != NULL || newValues != NULL) && times != NULL;
+
+	for (r = 0; ok && r < warmup + repeats; r++) {
+		memcpy(values, grid, bytes);
+		if (pool == NULL)
+			memcpy(newValues, grid, bytes);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (pool == NULL) {
+			double omega = options->method == METHOD_SOR ? (options->omega > 0 ? options->omega : optimalOmega(dimension, dimension)) : 1;
+			timing->count = relaxSequential(values, newValues, dimension, options->precision, options->method, omega);
+			timing->floatCount = 0;
+		} else {
+			ok = relaxSolve(pool, values, dimension, dimension, options, &result);
+			timing->count = result.count;
+			timing->floatCount = result.floatCount;
+			stalled = stalled || result.stalled;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (r >= warmup)
+			times[r - warmup] = elapsed(&start, &end);
+	}
+
+	if (ok)
+		summarise(times, repeats, timing);
+	if (stalled)
+		fprintf(stderr, "LOG WARNING - float stopped improving on dimension %d without reaching precision %g. Times are to where it stopped.\n",
+				dimension, options->precision);
+
+	if (pool != NULL && values != NULL)
+		relaxFree(values);
+	else
+		free(values);
+	free(newValues);
+	free(times);
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+
+	/* Values hard coded - ensure to update
+	 * debug - The level of debug output: 0, 1
+	 * threadList - comma separated thread counts to sweep. Powers of two up to the online CPUs by default
+	 * dimensionList - comma separated array dimensions to sweep
+	 * precisionList - comma separated precisions to sweep
+	 * methodList - comma separated methods to sweep: jacobi, gs, sor, multigrid
+	 * partitionList - rows, tiles or both, for each method
+	 * temporalList - comma separated -temporal sweep counts, above 1 only used with jacobi on tiles
+	 * arithmeticList - comma separated arithmetics to sweep: double, float, mixed. Only double for multigrid and temporal
+	 * warmup - untimed solves before the timed ones, to fault in memory and settle the clock
+	 * repeats - timed solves of each configuration
+	 * format - csv or json, written to outFile
+	 * outFile - where to write results, stdout if not set
+	 * seed - seed for the random grids, so every run times the same numbers. The same grids as -seed
+	 * 			gives the solvers with -g 1
+	 *
+	 * Each dimension gets one random grid, and every configuration relaxes a fresh copy of it.
+	 * Sequential runs once per method, dimension and precision, as the baseline for speedup.
+	 */
+
+	int debug = 0;
+
+	double threadList[MAX_LIST];
+	int threadCount = 0;
+	double dimensionList[MAX_LIST] = { 500 };
+	int dimensionCount = 1;
+	double precisionList[MAX_LIST] = { 0.1, 0.001 };
+	int precisionCount = 2;
+	int methodList[MAX_LIST] = { METHOD_JACOBI };
+	int methodCount = 1;
+	int useRows = 1, useTiles = 0;
+	double temporalList[MAX_LIST] = { 1 };
+	int temporalCount = 1;
+	int arithmeticList[MAX_LIST] = { ARITHMETIC_DOUBLE };
+	int arithmeticCount = 1;
+
+	int warmup = 1;
+	int repeats = 5;
+	int json = 0;
+	const char *outFile = NULL;
+	unsigned long long seed = 1;
+
+	/* End editable values */
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (threadCount = 0; threadCount < MAX_LIST && (1L << threadCount) <= (cpus > 0 ? cpus : 1); threadCount++)
+		threadList[threadCount] = 1 << threadCount;
+
+	stencilInit();
+
+	/* Parse command line input */
+	int a;
+	for (a = 1; a < argc; a++) { /* argv[0] is program name */
+		if (strcmp(argv[a], "-c") == 0 || strcmp(argv[a], "-cores") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				double list[MAX_LIST];
+				int n = parseList(argv[a+1], list);
+				if (n > 0) {
+					a++;
+					memcpy(threadList, list, n * sizeof(double));
+					threadCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -c. Comma separated positive integers required. Using powers of two up to %ld as default.\n", cpus);
+				}
+			}
+		} else if (strcmp(argv[a], "-d") == 0 || strcmp(argv[a], "-dimension") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				double list[MAX_LIST];
+				int n = parseList(argv[a+1], list);
+				if (n > 0) {
+					a++;
+					memcpy(dimensionList, list, n * sizeof(double));
+					dimensionCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -d. Comma separated positive integers required. Using %d dimension as default.\n", (int) dimensionList[0]);
+				}
+			}
+		} else if (strcmp(argv[a], "-p") == 0 || strcmp(argv[a], "-precision") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				double list[MAX_LIST];
+				int n = parseList(argv[a+1], list);
+				if (n > 0) {
+					a++;
+					memcpy(precisionList, list, n * sizeof(double));
+					precisionCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -p. Comma separated positive doubles required. Using 0.1 and 0.001 as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-method") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				int list[MAX_LIST];
+				int n = parseNames(argv[a+1], methodNames, 4, list);
+				if (n > 0) {
+					a++;
+					memcpy(methodList, list, n * sizeof(int));
+					methodCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -method. Comma separated jacobi, gs, sor or multigrid required. Using jacobi as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-partition") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "rows") == 0 || strcmp(argv[a+1], "tiles") == 0
+					|| strcmp(argv[a+1], "rows,tiles") == 0 || strcmp(argv[a+1], "tiles,rows") == 0) {
+					a++;
+					useRows = strstr(argv[a], "rows") != NULL;
+					useTiles = strstr(argv[a], "tiles") != NULL;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -partition. rows, tiles or rows,tiles required. Using rows as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-temporal") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				double list[MAX_LIST];
+				int n = parseList(argv[a+1], list);
+				if (n > 0) {
+					a++;
+					memcpy(temporalList, list, n * sizeof(double));
+					temporalCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -temporal. Comma separated positive integers required. Using 1 as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-arithmetic") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				int list[MAX_LIST];
+				int n = parseNames(argv[a+1], arithmeticNames, 3, list);
+				if (n > 0) {
+					a++;
+					memcpy(arithmeticList, list, n * sizeof(int));
+					arithmeticCount = n;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -arithmetic. Comma separated double, float or mixed required. Using double as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-warmup") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					warmup = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -warmup. Integer >= 0 required. Using %d warmup as default.\n", warmup);
+				}
+			}
+		} else if (strcmp(argv[a], "-repeats") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					repeats = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -repeats. Positive integer required. Using %d repeats as default.\n", repeats);
+				}
+			}
+		} else if (strcmp(argv[a], "-format") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "csv") == 0 || strcmp(argv[a+1], "json") == 0) {
+					a++;
+					json = strcmp(argv[a], "json") == 0;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -format. csv or json required. Using csv as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				seed = strtoull(argv[a], NULL, 10);
+			}
+		} else if (strcmp(argv[a], "-o") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-debug") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					debug = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -debug. Integer >= 0 required. Using %d debug as default.\n", debug);
+				}
+			}
+		}
+	}
+
+	FILE *out = stdout;
+	if (outFile != NULL) {
+		out = fopen(outFile, "w");
+		if (out == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", outFile);
+			return 1;
+		}
+	}
+
+	int maxThreads = 1;
+	int i;
+	for (i = 0; i < threadCount; i++) {
+		if ((int) threadList[i] > maxThreads)
+			maxThreads = (int) threadList[i];
+	}
+
+	// One pool for the whole sweep, each run takes as many of its threads as it needs
+	struct RelaxPool *pool = relaxPoolCreate(maxThreads);
+	if (pool == NULL) {
+		fprintf(stdout, "LOG ERROR - Failed to start %d threads. Exiting program", maxThreads);
+		return 1;
+	}
+
+	if (debug >= 1) {
+		fprintf(stderr, "LOG FINE - Using %s stencil.\n", stencilName());
+		fprintf(stderr, "LOG FINE - %d warmup and %d timed solves per configuration.\n", warmup, repeats);
+	}
+
+	if (json)
+		fprintf(out, "[");
+	else
+		fprintf(out, "method,partition,temporal,arithmetic,dimension,precision,threads,iterations,median_ns,p95_ns,"
+				"cells_per_s,gb_per_s,speedup,efficiency\n");
+	int rows = 0;
+
+	int d, p, m, t, ar, c, part;
+	for (d = 0; d < dimensionCount; d++) {
+		int dimension = (int) dimensionList[d];
+		size_t cells = (size_t)dimension * dimension;
+		double *grid = malloc(cells * sizeof(double));
+
+		if (grid == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to allocate array of dimension %d. Exiting program", dimension);
+			return 1;
+		}
+		rngFill(grid, 0, cells, seed, 1, 2);
+
+		double interior = (double)(dimension - 2) * (dimension - 2);
+
+		for (p = 0; p < precisionCount; p++) {
+			for (m = 0; m < methodCount; m++) {
+				struct RelaxOptions options;
+				relaxOptionsInit(&options);
+				options.method = (enum Method) methodList[m];
+				options.precision = precisionList[p];
+
+				/* Baseline. sequential.c has no multigrid, so that is measured against the
+				 * pool with one thread instead */
+				struct Timing baseline;
+				options.threads = 1;
+				if (!timeSolves(options.method == METHOD_MULTIGRID ? pool : NULL, &options, grid,
+								dimension, warmup, repeats, &baseline)) {
+					fprintf(stdout, "LOG ERROR - Failed to allocate memory for relaxation. Exiting program");
+					return 1;
+				}
+				if (debug >= 1)
+					fprintf(stderr, "LOG FINE - Sequential %s, dimension %d, precision %g: %llu Nanoseconds.\n",
+							methodNames[options.method], dimension, options.precision,
+							(long long unsigned int) baseline.median);
+
+				for (part = 0; part < 2; part++) {
+					if ((part == 0 && !useRows) || (part == 1 && !useTiles))
+						continue;
+
+					for (t = 0; t < temporalCount; t++) {
+						int sweeps = (int) temporalList[t];
+						// Temporal blocking only exists for Jacobi, and always on tiles
+						if (sweeps > 1 && (options.method != METHOD_JACOBI || part == 0))
+							continue;
+
+						for (ar = 0; ar < arithmeticCount; ar++) {
+							options.arithmetic = (enum Arithmetic) arithmeticList[ar];
+							// Float is only written for the plain sweeps of Jacobi and red-black
+							if (options.arithmetic != ARITHMETIC_DOUBLE && (options.method == METHOD_MULTIGRID || sweeps > 1))
+								continue;
+
+							for (c = 0; c < threadCount; c++) {
+								struct Timing timing;
+								options.partition = part == 0 ? PARTITION_ROWS : PARTITION_TILES;
+								options.sweeps = sweeps;
+								options.threads = (int) threadList[c];
+
+								if (!timeSolves(pool, &options, grid, dimension, warmup, repeats, &timing)) {
+									fprintf(stdout, "LOG ERROR - Failed to allocate memory for relaxation. Exiting program");
+									return 1;
+								}
+
+								double seconds = timing.median / (double) BILLION;
+								double cellsPerSecond = interior * timing.count / seconds;
+								double bytes = options.method == METHOD_JACOBI ? JACOBI_BYTES
+											   : options.method == METHOD_MULTIGRID ? 0 : RED_BLACK_BYTES;
+								// Float relaxations move half as much
+								if (timing.count > 0)
+									bytes -= bytes / 2 * timing.floatCount / timing.count;
+								double speedup = (double) baseline.median / timing.median;
+								double efficiency = speedup / options.threads;
+
+								if (debug >= 1)
+									fprintf(stderr, "LOG FINE - %s in %s on %d threads: %llu Nanoseconds, %d iterations.\n",
+											methodNames[options.method], arithmeticNames[options.arithmetic], options.threads,
+											(long long unsigned int) timing.median, timing.count);
+
+								// Multigrid moves data on every level so there's no simple figure for it
+								if (json) {
+									fprintf(out, "%s\n  {\"method\": \"%s\", \"partition\": \"%s\", \"temporal\": %d, "
+											"\"arithmetic\": \"%s\", \"dimension\": %d, \"precision\": %g, \"threads\": %d, \"iterations\": %d, "
+											"\"median_ns\": %llu, \"p95_ns\": %llu, \"cells_per_s\": %.6g, ",
+											rows > 0 ? "," : "", methodNames[options.method], part == 0 ? "rows" : "tiles",
+											sweeps, arithmeticNames[options.arithmetic], dimension, options.precision,
+											options.threads, timing.count,
+											(long long unsigned int) timing.median, (long long unsigned int) timing.p95,
+											cellsPerSecond);
+									if (bytes > 0)
+										fprintf(out, "\"gb_per_s\": %.6g, ", cellsPerSecond * bytes / 1e9);
+									else
+										fprintf(out, "\"gb_per_s\": null, ");
+									fprintf(out, "\"speedup\": %.4f, \"efficiency\": %.4f}", speedup, efficiency);
+								} else {
+									fprintf(out, "%s,%s,%d,%s,%d,%g,%d,%d,%llu,%llu,%.6g,", methodNames[options.method],
+											part == 0 ? "rows" : "tiles", sweeps, arithmeticNames[options.arithmetic],
+											dimension, options.precision,
+											options.threads, timing.count, (long long unsigned int) timing.median,
+											(long long unsigned int) timing.p95, cellsPerSecond);
+									if (bytes > 0)
+										fprintf(out, "%.6g", cellsPerSecond * bytes / 1e9);
+									fprintf(out, ",%.4f,%.4f\n", speedup, efficiency);
+								}
+								fflush(out);
+								rows++;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		free(grid);
+	}
+
+	if (json)
+		fprintf(out, "\n]\n");
+
+	relaxPoolDestroy(pool);
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
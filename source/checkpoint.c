@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "gridio.h"
+
+struct Checkpoint {
+	char *path;
+	char *tempPath; // Written first, then renamed to path
+	int rows, cols;
+	int every;
+	double *buffer;
+	struct CheckpointState state; // Of what's in buffer
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t changed; // Signalled when a checkpoint is handed over, finished or the thread stops
+	int busy; // 1 from checkpointSave until the write finishes
+	int stopping;
+	int written;
+	int failed;
+};
+
+static void writeLe32(unsigned char *bytes, uint32_t value) {
+	int i;
+	for (i = 0; i < 4; i++)
+		bytes[i] = (value >> (8 * i)) & 0xff;
+}
+
+static uint32_t readLe32(const unsigned char *bytes) {
+	return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static void writeLeDouble(unsigned char *bytes, double value) {
+	uint64_t bits;
+	int i;
+
+	memcpy(&bits, &value, sizeof(bits));
+	for (i = 0; i < 8; i++)
+		bytes[i] = (bits >> (8 * i)) & 0xff;
+}
+
+static double readLeDouble(const unsigned char *bytes) {
+	uint64_t bits = 0;
+	double value;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		bits |= (uint64_t) bytes[i] << (8 * i);
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static int writeCheckpoint(struct Checkpoint *checkpoint) {
+	struct CheckpointState *state = &checkpoint->state;
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, CHECKPOINT_MAGIC, 4);
+	writeLe32(header + 4, CHECKPOINT_VERSION);
+	writeLe32(header + 8, state->rows);
+	writeLe32(header + 12, state->method);
+	writeLe32(header + 16, state->arithmetic);
+	writeLe32(header + 20, state->norm);
+	writeLe32(header + 24, state->checkEvery);
+	writeLe32(header + 28, state->sweeps);
+	writeLe32(header + 32, state->cycleShape);
+	writeLe32(header + 36, state->count);
+	writeLe32(header + 40, state->floatCount);
+	writeLe32(header + 44, state->inFloat);
+	writeLe32(header + 48, state->convergence.nextCheck);
+	writeLe32(header + 52, state->convergence.lastCount);
+	writeLe32(header + 56, state->convergence.checks);
+	writeLe32(header + 60, state->convergence.every);
+	writeLeDouble(header + 64, state->precision);
+	writeLeDouble(header + 72, state->omega);
+	writeLeDouble(header + 80, state->convergence.last);
+	writeLeDouble(header + 88, state->convergence.initial);
+	writeLeDouble(header + 96, state->convergence.precision);
+	writeLeDouble(header + 104, state->lowest);
+	writeLe32(header + 112, state->lowestCount);
+	writeLe32(header + 116, state->cols);
+	writeLe32(header + 120, state->masked);
+
+	FILE *file = fopen(checkpoint->tempPath, "wb");
+	if (file == NULL)
+		return 0;
+
+	int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	ok = ok && gridWriteStream(file, checkpoint->buffer, checkpoint->rows, checkpoint->cols);
+	// On disk before it replaces the last one, or a crash could leave neither
+	ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok = fclose(file) == 0 && ok;
+
+	return ok && rename(checkpoint->tempPath, checkpoint->path) == 0;
+}
+
+static void* checkpointWriter(void *td) {
+	struct Checkpoint *checkpoint = (struct Checkpoint*) td;
+
+	pthread_mutex_lock(&checkpoint->lock);
+	while (1) {
+		while (!checkpoint->busy && !checkpoint->stopping)
+			pthread_cond_wait(&checkpoint->changed, &checkpoint->lock);
+		if (!checkpoint->busy)
+			break;
+
+		// The solver leaves the buffer alone while busy, so it's safe to write unlocked
+		pthread_mutex_unlock(&checkpoint->lock);
+		int ok = writeCheckpoint(checkpoint);
+		pthread_mutex_lock(&checkpoint->lock);
+
+		if (ok)
+			checkpoint->written++;
+		else
+			checkpoint->failed = 1;
+		checkpoint->busy = 0;
+		pthread_cond_broadcast(&checkpoint->changed);
+	}
+	pthread_mutex_unlock(&checkpoint->lock);
+
+	return NULL;
+}
+
+struct Checkpoint* checkpointCreate(const char *path, int rows, int cols, int every) {
+	struct Checkpoint *checkpoint = calloc(1, sizeof(struct Checkpoint));
+	if (checkpoint == NULL)
+		return NULL;
+
+	checkpoint->path = strdup(path);
+	checkpoint->tempPath = malloc(strlen(path) + 5);
+	checkpoint->buffer = malloc((size_t)rows * cols * sizeof(double));
+	if (checkpoint->path == NULL || checkpoint->tempPath == NULL || checkpoint->buffer == NULL) {
+		free(checkpoint->path);
+		free(checkpoint->tempPath);
+		free(checkpoint->buffer);
+		free(checkpoint);
+		return NULL;
+	}
+	sprintf(checkpoint->tempPath, "%s.tmp", path);
+	checkpoint->rows = rows;
+	checkpoint->cols = cols;
+	checkpoint->every = every > 0 ? every : 1;
+
+	pthread_mutex_init(&checkpoint->lock, NULL);
+	pthread_cond_init(&checkpoint->changed, NULL);
+	if (pthread_create(&checkpoint->writer, NULL, checkpointWriter, checkpoint) != 0) {
+		pthread_mutex_destroy(&checkpoint->lock);
+		pthread_cond_destroy(&checkpoint->changed);
+		free(checkpoint->path);
+		free(checkpoint->tempPath);
+		free(checkpoint->buffer);
+		free(checkpoint);
+		return NULL;
+	}
+
+	return checkpoint;
+}
+
+int checkpointEvery(struct Checkpoint *checkpoint) {
+	return checkpoint->every;
+}
+
+double* checkpointBuffer(struct Checkpoint *checkpoint) {
+	return checkpoint->buffer;
+}
+
+int checkpointBusy(struct Checkpoint *checkpoint) {
+	pthread_mutex_lock(&checkpoint->lock);
+	int busy = checkpoint->busy;
+	pthread_mutex_unlock(&checkpoint->lock);
+	return busy;
+}
+
+void checkpointSave(struct Checkpoint *checkpoint, const struct CheckpointState *state) {
+	pthread_mutex_lock(&checkpoint->lock);
+	checkpoint->state = *state;
+	checkpoint->busy = 1;
+	pthread_cond_broadcast(&checkpoint->changed);
+	pthread_mutex_unlock(&checkpoint->lock);
+}
+
+int checkpointDestroy(struct Checkpoint *checkpoint) {
+	pthread_mutex_lock(&checkpoint->lock);
+	checkpoint->stopping = 1;
+	pthread_cond_broadcast(&checkpoint->changed);
+	pthread_mutex_unlock(&checkpoint->lock);
+	pthread_join(checkpoint->writer, NULL);
+
+	int written = checkpoint->failed ? -1 : checkpoint->written;
+
+	pthread_mutex_destroy(&checkpoint->lock);
+	pthread_cond_destroy(&checkpoint->changed);
+	free(checkpoint->path);
+	free(checkpoint->tempPath);
+	free(checkpoint->buffer);
+	free(checkpoint);
+
+	return written;
+}
+
+int checkpointReadState(const char *path, struct CheckpointState *state) {
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "LOG ERROR - Failed to open checkpoint: %s.\n", path);
+		return 0;
+	}
+	size_t got = fread(header, 1, sizeof(header), file);
+	fclose(file);
+
+	if (got != sizeof(header) || memcmp(header, CHECKPOINT_MAGIC, 4) != 0
+		|| readLe32(header + 4) != CHECKPOINT_VERSION) {
+		fprintf(stderr, "LOG ERROR - %s is not a version %d checkpoint.\n", path, CHECKPOINT_VERSION);
+		return 0;
+	}
+
+	memset(state, 0, sizeof(struct CheckpointState));
+	state->rows = (int) readLe32(header + 8);
+	state->cols = (int) readLe32(header + 116);
+	if (state->cols == 0)
+		state->cols = state->rows;
+	state->masked = (int) readLe32(header + 120);
+	state->method = (enum Method) readLe32(header + 12);
+	state->arithmetic = (enum Arithmetic) readLe32(header + 16);
+	state->norm = (enum Norm) readLe32(header + 20);
+	state->checkEvery = (int) readLe32(header + 24);
+	state->sweeps = (int) readLe32(header + 28);
+	state->cycleShape = (int) readLe32(header + 32);
+	state->count = (int) readLe32(header + 36);
+	state->floatCount = (int) readLe32(header + 40);
+	state->inFloat = (int) readLe32(header + 44);
+	state->precision = readLeDouble(header + 64);
+	state->omega = readLeDouble(header + 72);
+	state->lowest = readLeDouble(header + 104);
+	state->lowestCount = (int) readLe32(header + 112);
+
+	convergenceInit(&state->convergence, state->norm, readLeDouble(header + 96), (int) readLe32(header + 60));
+	state->convergence.nextCheck = (int) readLe32(header + 48);
+	state->convergence.lastCount = (int) readLe32(header + 52);
+	state->convergence.checks = (int) readLe32(header + 56);
+	state->convergence.last = readLeDouble(header + 80);
+	state->convergence.initial = readLeDouble(header + 88);
+
+	if (state->rows < 3 || state->cols < 3 || state->method > METHOD_MULTIGRID || state->arithmetic > ARITHMETIC_MIXED
+		|| state->norm > NORM_RELATIVE) {
+		fprintf(stderr, "LOG ERROR - %s has settings this program doesn't know.\n", path);
+		return 0;
+	}
+
+	return 1;
+}
+
+int checkpointReadValues(const char *path, double *values, int rows, int cols) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "LOG ERROR - Failed to open checkpoint: %s.\n", path);
+		return 0;
+	}
+
+	int ok = fseek(file, CHECKPOINT_HEADER_SIZE, SEEK_SET) == 0
+			 && gridReadStream(file, values, (size_t)rows * cols);
+	fclose(file);
+
+	return ok;
+}
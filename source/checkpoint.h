@@ -0,0 +1,88 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "stencil.h"
+#include "convergence.h"
+
+/* Saving a solve part way through, so a long one that gets killed can carry on from
+ * where it got to rather than from the start.
+ *
+ * Every so many relaxations the solver threads copy the array into a buffer here, each
+ * its own part, and go straight back to relaxing. A thread of the checkpoint's own
+ * writes the buffer out while they do. If it's still writing the last one when the next
+ * is due, that one is skipped rather than holding up the solve.
+ *
+ * The file is written beside the real one and renamed over it once complete, so there
+ * is always a whole checkpoint on disk. It is a 128 byte header, little endian whatever
+ * machine wrote it:
+ *
+ *	bytes 0-3	"RLXC"
+ *	bytes 4-7	format version, currently 1
+ *	bytes 8-47	rows, method, arithmetic, norm, checkEvery, sweeps, cycleShape,
+ *				count, floatCount, inFloat, as 32 bit integers
+ *	bytes 48-63	convergence nextCheck, lastCount, checks, every, as 32 bit integers
+ *	bytes 64-103	precision, omega, convergence last, initial, precision, as doubles
+ *	bytes 104-111	lowest norm float has reached, as a double
+ *	bytes 112-115	lowestCount
+ *	bytes 116-119	cols, 0 in checkpoints of square arrays from before they could differ
+ *	bytes 120-123	1 if cells were fixed by a mask, which has to be given again to resume
+ *	bytes 124-127	reserved, 0
+ *
+ * followed by the array as a binary grid file (see gridio.h).
+ */
+
+#define CHECKPOINT_MAGIC "RLXC"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER_SIZE 128
+
+/* What is being solved, and how far it has got */
+struct CheckpointState {
+	int rows, cols;
+	int masked; // 1 if solved with a mask of fixed cells
+	enum Method method;
+	enum Arithmetic arithmetic;
+	enum Norm norm;
+	int checkEvery;
+	int sweeps;
+	int cycleShape;
+	double precision; // As the solver worked to it, after any raising for float
+	double omega;
+
+	int count; // Relaxations, or multigrid cycles, done
+	int floatCount; // Of count, how many in float
+	int inFloat; // 1 if still in the float part of a float or mixed solve
+	struct Convergence convergence; // Of whichever part it's in
+	double lowest; // For float, the lowest norm so far
+	int lowestCount; // and the count it was reached at
+};
+
+struct Checkpoint;
+
+/* Starts a thread to save rows x cols arrays to path, every every relaxations.
+ * Returns NULL if memory or the thread couldn't be had */
+struct Checkpoint* checkpointCreate(const char *path, int rows, int cols, int every);
+
+int checkpointEvery(struct Checkpoint *checkpoint);
+
+/* Where the solver copies the array to. Only to be written while checkpointBusy is 0 */
+double* checkpointBuffer(struct Checkpoint *checkpoint);
+
+/* 1 while the last checkpoint is still being written */
+int checkpointBusy(struct Checkpoint *checkpoint);
+
+/* Hands the buffer, filled in for state, to the thread to write out */
+void checkpointSave(struct Checkpoint *checkpoint, const struct CheckpointState *state);
+
+/* Waits for any write in progress, then stops the thread. Returns how many checkpoints
+ * were written, or -1 if any of them failed */
+int checkpointDestroy(struct Checkpoint *checkpoint);
+
+/* Reads the header of the checkpoint at path. Returns 0, with a message on stderr, if it
+ * isn't one */
+int checkpointReadState(const char *path, struct CheckpointState *state);
+
+/* Reads the array of the checkpoint at path into values, which needs room for
+ * rows x cols. Returns 0, with a message on stderr, if it can't */
+int checkpointReadValues(const char *path, double *values, int rows, int cols);
+
+#endif
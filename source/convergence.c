@@ -0,0 +1,64 @@
+#include <math.h>
+
+#include "convergence.h"
+#include "stencil.h"
+
+void convergenceInit(struct Convergence *convergence, enum Norm norm, double precision, int every) {
+	convergence->norm = norm;
+	convergence->precision = precision;
+	convergence->every = every < 0 ? 1 : every;
+	convergence->nextCheck = 1;
+	convergence->lastCount = 0;
+	convergence->last = 0;
+	convergence->initial = 0;
+	convergence->checks = 0;
+}
+
+int convergenceDue(struct Convergence *convergence, int count) {
+	return count >= convergence->nextCheck;
+}
+
+int convergenceCheck(struct Convergence *convergence, int count, double value) {
+	if (convergence->norm == NORM_RELATIVE)
+		value = convergence->initial > 0 ? value / convergence->initial : 0;
+
+	int interval = convergence->every;
+
+	if (interval == 0) {
+		interval = 1;
+		// Norms fall geometrically, so the log of the fall per relaxation gives the rate
+		if (convergence->lastCount > 0 && value > 0 && value < convergence->last) {
+			double rate = log(value / convergence->last) / (count - convergence->lastCount);
+			double remaining = log(convergence->precision / value) / rate;
+			if (remaining / 2 > ADAPTIVE_MAX_INTERVAL)
+				interval = ADAPTIVE_MAX_INTERVAL;
+			else if (remaining / 2 > 1)
+				interval = (int) (remaining / 2);
+		}
+	}
+
+	convergence->checks++;
+	convergence->last = value;
+	convergence->lastCount = count;
+	convergence->nextCheck = count + interval;
+
+	return value <= convergence->precision;
+}
+
+double convergenceValue(struct Convergence *convergence) {
+	return convergence->last;
+}
+
+double convergenceFloatFloor(enum Norm norm, int rows, int cols) {
+	if (norm == NORM_L2 && rows > 2 && cols > 2)
+		return FLOAT_FLOOR * sqrt((double)(rows - 2) * (cols - 2));
+	return FLOAT_FLOOR;
+}
+
+const char* normName(enum Norm norm) {
+	if (norm == NORM_L2)
+		return "L2";
+	if (norm == NORM_RELATIVE)
+		return "relative";
+	return "max";
+}
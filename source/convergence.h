@@ -0,0 +1,53 @@
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+/* When to check whether a solve has converged, and what has to fall below precision.
+ *
+ * Checking costs a reduction over every thread, and for the residual norms a pass over
+ * the array, so it can be done every k relaxations instead of every one. That can
+ * overshoot by up to k - 1 relaxations. With k = 0 the gap adapts: the rate the norm
+ * fell between the last two checks predicts how many relaxations are left, and the next
+ * check is made halfway there, so checks are rare early on and close together near the end.
+ *
+ * Every thread keeps its own copy, and as they all see the same norms they all agree on
+ * when to check without talking to each other.
+ */
+
+/* Max is the largest change any cell made on the last relaxation. L2 is the square root
+ * of the sum of squared residuals, the residual of a cell being the change a Jacobi
+ * relaxation would make to it now. Relative is L2 over the L2 of the starting array */
+enum Norm { NORM_MAX, NORM_L2, NORM_RELATIVE };
+
+#define ADAPTIVE_MAX_INTERVAL 1024 /* Most relaxations between adaptive checks */
+
+struct Convergence {
+	enum Norm norm;
+	double precision;
+	int every; // Relaxations between checks, 0 to adapt
+	int nextCheck; // Relaxation count at which to check next
+	int lastCount; // Relaxation count at the last check, 0 for none
+	double last; // Norm at the last check
+	double initial; // For NORM_RELATIVE, the L2 norm of the starting array
+	int checks;
+};
+
+void convergenceInit(struct Convergence *convergence, enum Norm norm, double precision, int every);
+
+/* 1 if a relaxation that takes the count to count should be checked */
+int convergenceDue(struct Convergence *convergence, int count);
+
+/* Takes the norm measured at count (the raw L2 for NORM_RELATIVE) and schedules the next
+ * check. Returns 1 once it's within precision */
+int convergenceCheck(struct Convergence *convergence, int count, double value);
+
+/* The norm at the last check, relative for NORM_RELATIVE */
+double convergenceValue(struct Convergence *convergence);
+
+/* The smallest norm that relaxing in float can be trusted to get down to, for cells of
+ * around 1 in a rows x cols array. Rounding to float leaves each cell up to FLOAT_FLOOR
+ * out, which L2 adds up over every cell */
+double convergenceFloatFloor(enum Norm norm, int rows, int cols);
+
+const char* normName(enum Norm norm);
+
+#endif
@@ -0,0 +1,670 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "convergence.h"
+#include "rng.h"
+
+#define ANSI_COLOR_RED     "\x1b[31m"
+#define ANSI_COLOR_RESET   "\x1b[0m"
+
+#define BILLION 1000000000L
+
+/* Directions halos are sent in, used as message tags */
+#define TAG_UP 0
+#define TAG_DOWN 1
+#define TAG_LEFT 2
+#define TAG_RIGHT 3
+
+/* One process's share of the array: rows rowStart up to rowEnd and cols colStart up to
+ * colEnd of the whole, held with a ring of halo cells round it, so local (1, 1) is
+ * (rowStart, colStart). The halo is either the fixed edge of the whole array or a copy
+ * of a neighbour's cells, refreshed before every relaxation that reads it */
+struct Part {
+	int rowStart, rowEnd, colStart, colEnd;
+	int rows, cols;
+	int width; // cols + 2
+	int up, down, left, right; // Neighbouring ranks, MPI_PROC_NULL along the edges
+	MPI_Datatype column; // rows cells down a column of the local array
+};
+
+void splitRange(int, int, int, int *, int *);
+void partFor(struct Part *, MPI_Comm, int, int);
+void exchangeStart(struct Part *, double *, MPI_Comm, MPI_Request *);
+double relaxCells(struct Part *, double *, double *, int, int, int, int, int, double);
+double relaxPart(struct Part *, double *, double *, int, double, MPI_Comm, double *);
+double residualPart(struct Part *, double *, MPI_Comm, double *, double *);
+
+int main(int argc, char *argv[]) {
+
+	/* Values hard coded - ensure to update
+	 * debug - The level of debug output: 0, 1, 2
+	 * dimension - how big the square array is
+	 * precision - how precise the relaxation needs to be before the program ends
+	 * isa - which version of the stencil to use: scalar, avx2 or avx512. Best supported by default
+	 * method - jacobi (two arrays), gs (red-black Gauss-Seidel in place) or sor (red-black over-relaxation in place)
+	 * omega - how far sor moves each cell past the average of its neighbours, 0 to estimate it from the dimension
+	 * norm - what has to fall below precision: max (largest change), l2 (residual) or relative (residual over starting residual)
+	 * checkEvery - relaxations between convergence checks, 0 to adapt as the solve goes. Can overshoot by up to checkEvery - 1
+	 * blocks - 0 to give each process a strip of whole rows, 1 to split both ways into a grid of blocks,
+	 * 			which sends less halo per cell once there are many processes
+	 *
+	 * outputFile - where rank 0 writes the relaxed array once it has gathered it, NULL for nowhere.
+	 * 			A binary grid file, like -f reads, or text with a line per row if outputText is 1
+	 * outputText - 0 for a binary grid file, 1 for text to GRID_TEXT_DECIMALS places
+	 *
+	 * generateNumbers - 0 to use values in setValues[][], 1 to generate them randomly, each process its own part
+	 * seed - what the random values are made from, the same seed always giving the same array whatever
+	 * 			the processes. 0 to pick one from the clock
+	 * textFile - text or binary grid file (see gridio.h) to read numbers from. Needs to be set and filled in if generateNumbers == 0
+	 * 			A binary file is read by every process, each its own part. Anything else is read by rank 0 and sent out
+	 *
+	 * The number of processes is set by mpirun -np, one to a core
+	 */
+
+	int debug = 0; /* Debug output: 0 no detail - 1 some detail - 2 all detail */
+
+	int dimension = 10;
+	double precision = 0.0001;
+
+	enum Method method = METHOD_JACOBI;
+	double omega = 0;
+
+	enum Norm norm = NORM_MAX;
+	int checkEvery = 1;
+
+	int blocks = 0;
+
+	const char *outputFile = NULL;
+	int outputText = 0;
+
+	int generateNumbers = 0;
+	unsigned long long seed = 0;
+	// textFile needs to be set and filled in if generateNumbers == 0
+	const char *textFile = "values.txt";
+
+	/* End editable values */
+
+	uint64_t diff;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	MPI_Init(&argc, &argv);
+
+	int rank, processes;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &processes);
+
+	stencilInit();
+
+	/* Parse command line input. Every process parses it, only rank 0 complains */
+	int a;
+	FILE *warnings = rank == 0 ? stderr : fopen("/dev/null", "w");
+	for (a = 1; a < argc; a++) { /* argv[0] is program name */
+		if (strcmp(argv[a], "-d") == 0 || strcmp(argv[a], "-dimension") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					dimension = atoi(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -d. Positive integer required. Using %d dimension as default.\n", dimension);
+				}
+			}
+		} else if (strcmp(argv[a], "-p") == 0 || strcmp(argv[a], "-precision") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) > 0.0) {
+					a++;
+					precision = atof(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -p. Positive double required. Using %f precision as default.\n", precision);
+				}
+			}
+		} else if (strcmp(argv[a], "-g") == 0 || strcmp(argv[a], "-generate") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					generateNumbers = atoi(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -g. Integer >= 0 required. Using %d dimension as default.\n", dimension);
+				}
+			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strtoull(argv[a+1], NULL, 10) > 0) {
+					a++;
+					seed = strtoull(argv[a], NULL, 10);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -seed. Positive integer required. Using a seed from the clock as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-method") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "jacobi") == 0) {
+					a++;
+					method = METHOD_JACOBI;
+				} else if (strcmp(argv[a+1], "gs") == 0) {
+					a++;
+					method = METHOD_GAUSS_SEIDEL;
+				} else if (strcmp(argv[a+1], "sor") == 0) {
+					a++;
+					method = METHOD_SOR;
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -method. jacobi, gs or sor required. Using jacobi as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-omega") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) >= 0.0 && atof(argv[a+1]) < 2.0) {
+					a++;
+					omega = atof(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -omega. Double from 0 up to 2 required. Estimating omega as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-norm") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "max") == 0) {
+					a++;
+					norm = NORM_MAX;
+				} else if (strcmp(argv[a+1], "l2") == 0) {
+					a++;
+					norm = NORM_L2;
+				} else if (strcmp(argv[a+1], "relative") == 0) {
+					a++;
+					norm = NORM_RELATIVE;
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -norm. max, l2 or relative required. Using max as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-check") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "adaptive") == 0) {
+					a++;
+					checkEvery = 0;
+				} else if (atoi(argv[a+1]) > 0) {
+					a++;
+					checkEvery = atoi(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -check. Positive integer or adaptive required. Using %d check as default.\n", checkEvery);
+				}
+			}
+		} else if (strcmp(argv[a], "-decomp") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "rows") == 0) {
+					a++;
+					blocks = 0;
+				} else if (strcmp(argv[a+1], "blocks") == 0) {
+					a++;
+					blocks = 1;
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -decomp. rows or blocks required. Using rows as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-isa") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (stencilUse(argv[a+1])) {
+					a++;
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -isa. scalar, avx2 or avx512 supported by this CPU required. Using %s as default.\n", stencilName());
+				}
+			}
+		} else if (strcmp(argv[a], "-o") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outputFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-oformat") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "binary") == 0) {
+					a++;
+					outputText = 0;
+				} else if (strcmp(argv[a+1], "text") == 0) {
+					a++;
+					outputText = 1;
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -oformat. binary or text required. Using binary as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-f") == 0 || strcmp(argv[a], "-filepath") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				textFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-debug") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					debug = atoi(argv[a]);
+				} else {
+					fprintf(warnings, "LOG WARNING - Invalid argument for -debug. Integer >= 0 required. Using %d debug as default.\n", debug);
+				}
+			}
+		} else {
+			/* Non optional arguments here, but we have none of those */
+		}
+	}
+	if (rank != 0)
+		fclose(warnings);
+
+	if (precision < 0.0000000001) precision = 0.0000000001;
+	if (method == METHOD_GAUSS_SEIDEL) omega = 1;
+	if (method == METHOD_SOR && omega == 0) omega = optimalOmega(dimension, dimension);
+
+	/* Lay the processes out as a grid, a column of them unless splitting into blocks */
+	int dims[2] = { processes, 1 };
+	int periods[2] = { 0, 0 };
+	if (blocks) {
+		dims[0] = 0;
+		dims[1] = 0;
+		MPI_Dims_create(processes, 2, dims);
+	}
+	if (dimension - 2 < dims[0] || dimension - 2 < dims[1]) {
+		if (rank == 0)
+			fprintf(stdout, "LOG ERROR - Array of dimension %d is too small for %dx%d processes. Exiting program", dimension, dims[0], dims[1]);
+		MPI_Finalize();
+		return 1;
+	}
+
+	MPI_Comm grid;
+	MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+
+	struct Part part;
+	partFor(&part, grid, rank, dimension);
+	size_t localCells = (size_t)(part.rows + 2) * part.width;
+
+	int binaryFile = 0;
+	int ok = 1;
+
+	if (!generateNumbers) {
+		binaryFile = gridIsBinary(textFile);
+		if (!binaryFile && access(textFile, R_OK) != 0) {
+			if (rank == 0)
+				fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", textFile);
+			MPI_Finalize();
+			return 1;
+		}
+	}
+
+	/* Rank 0 holds the whole array when it has to read it for everyone, or to show or write it */
+	struct GridMapping mapping = { NULL, 0 };
+	double *values = NULL;
+	double *local = malloc(localCells * sizeof(double));
+	double *newLocal = method == METHOD_JACOBI ? malloc(localCells * sizeof(double)) : NULL;
+	ok = local != NULL && (method != METHOD_JACOBI || newLocal != NULL);
+
+	// Every process has to make its part from the same seed
+	if (generateNumbers) {
+		if (seed == 0 && rank == 0)
+			seed = rngClockSeed();
+		MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, 0, grid);
+	}
+
+	int i, j;
+	if (rank == 0 && (!(binaryFile || generateNumbers) || debug >= 2 || outputFile != NULL)) {
+		if (binaryFile) {
+			values = gridMap(textFile, (size_t)dimension * dimension, &mapping);
+			ok = ok && values != NULL;
+		} else {
+			values = malloc((size_t)dimension * dimension * sizeof(double));
+			ok = ok && values != NULL;
+			// Only rank 0 parses the text, on one thread, and sends each process its part below
+			if (ok && !generateNumbers)
+				ok = gridLoadText(textFile, values, (size_t)dimension * dimension, 1);
+			if (ok && generateNumbers)
+				rngFill(values, 0, (size_t)dimension * dimension, seed, 1, 2);
+		}
+	}
+
+	/* Binary files are read, and random values made, by every process, only its own part
+	 * and halo. Anything else rank 0 sends out */
+	if (binaryFile) {
+		int fd = gridOpen(textFile, (size_t)dimension * dimension, 0);
+		ok = ok && fd >= 0;
+		for (i = 0; ok && i < part.rows + 2; i++)
+			ok = gridReadValues(fd, local + (size_t)i * part.width,
+								(size_t)(part.rowStart - 1 + i) * dimension + part.colStart - 1, part.width);
+		if (fd >= 0)
+			close(fd);
+		MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, grid);
+	} else if (generateNumbers) {
+		for (i = 0; ok && i < part.rows + 2; i++)
+			rngFill(local + (size_t)i * part.width, (size_t)(part.rowStart - 1 + i) * dimension + part.colStart - 1,
+					part.width, seed, 1, 2);
+		MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, grid);
+	} else {
+		MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, grid);
+		if (ok && rank == 0) {
+			int p;
+			for (p = 0; p < processes; p++) {
+				struct Part other;
+				partFor(&other, grid, p, dimension);
+				MPI_Datatype block;
+				MPI_Type_vector(other.rows + 2, other.width, dimension, MPI_DOUBLE, &block);
+				MPI_Type_commit(&block);
+				double *corner = values + (size_t)(other.rowStart - 1) * dimension + other.colStart - 1;
+				if (p == 0)
+					MPI_Sendrecv(corner, 1, block, 0, 0, local, localCells, MPI_DOUBLE, 0, 0, grid, MPI_STATUS_IGNORE);
+				else
+					MPI_Send(corner, 1, block, p, 0, grid);
+				MPI_Type_free(&block);
+			}
+		} else if (ok) {
+			MPI_Recv(local, localCells, MPI_DOUBLE, 0, 0, grid, MPI_STATUS_IGNORE);
+		}
+	}
+	if (!ok) {
+		if (rank == 0)
+			fprintf(stdout, "LOG ERROR - Failed to read file: %s. Exiting program", textFile);
+		MPI_Finalize();
+		return 1;
+	}
+
+	// Jacobi's second array needs the fixed edges too
+	if (newLocal != NULL)
+		memcpy(newLocal, local, localCells * sizeof(double));
+
+	if (debug >= 1 && rank == 0) {
+		fprintf(stdout, "LOG FINE - Using %d processes as a %dx%d grid.\n", processes, dims[0], dims[1]);
+		fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", dimension);
+		if (generateNumbers)
+			fprintf(stdout, "LOG FINE - Generated values from seed %llu.\n", seed);
+		fprintf(stdout, "LOG FINE - Working to precision of %.10lf.\n", precision);
+		fprintf(stdout, "LOG FINE - Using %s stencil.\n", stencilName());
+		if (method == METHOD_JACOBI)
+			fprintf(stdout, "LOG FINE - Using Jacobi relaxation.\n");
+		else if (method == METHOD_GAUSS_SEIDEL)
+			fprintf(stdout, "LOG FINE - Using red-black Gauss-Seidel relaxation.\n");
+		else
+			fprintf(stdout, "LOG FINE - Using red-black SOR relaxation with omega %.6lf.\n", omega);
+		if (checkEvery == 0)
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked adaptively.\n", normName(norm));
+		else
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked every %d relaxations.\n", normName(norm), checkEvery);
+	}
+
+	if (debug >= 2 && rank == 0) {
+	/* Display initial array for debugging */
+		fprintf(stdout, "LOG FINEST - Working with array:\n");
+		for (i = 0; i < dimension; i++) {
+			for (j = 0; j < dimension; j++) {
+				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
+					fprintf(stdout, ANSI_COLOR_RED);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+
+	int count = 0; // Count how many times we try to relax the square array
+	int withinPrecision = 0; // 1 when a checked pass came in within precision, i.e. finished
+	double haloWait = 0, reduceWait = 0; // Seconds this process spent waiting on the others
+	struct Convergence convergence;
+	convergenceInit(&convergence, norm, precision, checkEvery);
+	if (norm == NORM_RELATIVE)
+		convergence.initial = residualPart(&part, local, grid, &haloWait, &reduceWait);
+
+	while (!withinPrecision) {
+		count++;
+		double maxDelta;
+
+		if (method == METHOD_JACOBI) {
+			maxDelta = relaxPart(&part, local, newLocal, 0, 1, grid, &haloWait);
+
+			// Swap pointers, so we can continue working on the new array
+			double *tempValues = local;
+			local = newLocal;
+			newLocal = tempValues;
+		} else {
+			/* Each colour reads the other's latest halo, so gets an exchange of its own */
+			double red = relaxPart(&part, local, NULL, 0, omega, grid, &haloWait);
+			double black = relaxPart(&part, local, NULL, 1, omega, grid, &haloWait);
+			maxDelta = red > black ? red : black;
+		}
+
+		/* If the numbers changed more than precision anywhere, we need to do it again */
+		if (convergenceDue(&convergence, count)) {
+			double value;
+			if (norm == NORM_MAX) {
+				double waitStart = MPI_Wtime();
+				MPI_Allreduce(&maxDelta, &value, 1, MPI_DOUBLE, MPI_MAX, grid);
+				reduceWait += MPI_Wtime() - waitStart;
+			} else {
+				value = residualPart(&part, local, grid, &haloWait, &reduceWait);
+			}
+			withinPrecision = convergenceCheck(&convergence, count, value);
+		}
+	}
+
+	/* Rank 0 collects everyone's part to show or write it */
+	if (debug >= 2 || outputFile != NULL) {
+		MPI_Datatype interior;
+		MPI_Type_vector(part.rows, part.cols, part.width, MPI_DOUBLE, &interior);
+		MPI_Type_commit(&interior);
+		MPI_Request sent;
+		MPI_Isend(local + part.width + 1, 1, interior, 0, 0, grid, &sent);
+		if (rank == 0) {
+			int p;
+			for (p = 0; p < processes; p++) {
+				struct Part other;
+				partFor(&other, grid, p, dimension);
+				MPI_Datatype block;
+				MPI_Type_vector(other.rows, other.cols, dimension, MPI_DOUBLE, &block);
+				MPI_Type_commit(&block);
+				MPI_Recv(values + (size_t)other.rowStart * dimension + other.colStart, 1, block, p, 0, grid,
+						 MPI_STATUS_IGNORE);
+				MPI_Type_free(&block);
+			}
+		}
+		MPI_Wait(&sent, MPI_STATUS_IGNORE);
+		MPI_Type_free(&interior);
+	}
+
+	// Only rank 0 writes, on one thread, and everyone finds out whether it could
+	if (outputFile != NULL) {
+		int written = 1;
+		if (rank == 0) {
+			written = outputText ? gridWriteText(outputFile, values, dimension, dimension, 1)
+								 : gridWrite(outputFile, values, dimension, dimension);
+			if (!written)
+				fprintf(stdout, "LOG ERROR - Failed to write output to %s. Exiting program", outputFile);
+		}
+		MPI_Bcast(&written, 1, MPI_INT, 0, grid);
+		if (!written) {
+			MPI_Finalize();
+			return 1;
+		}
+	}
+
+	double waits[2] = { haloWait, reduceWait }, longest[2];
+	MPI_Reduce(waits, longest, 2, MPI_DOUBLE, MPI_MAX, 0, grid);
+
+	if (debug >= 1 && rank == 0) {
+		fprintf(stdout, "\nLOG FINE - Program complete. Relaxation count: %d.\n", count);
+		if (norm != NORM_MAX || checkEvery != 1)
+			fprintf(stdout, "LOG FINE - Final %s norm %.10lg after %d convergence checks.\n",
+					normName(norm), convergenceValue(&convergence), convergence.checks);
+		fprintf(stdout, "LOG FINE - Longest any process waited: %.6lf s for halos, %.6lf s for convergence checks.\n",
+				longest[0], longest[1]);
+		if (outputFile != NULL)
+			fprintf(stdout, "LOG FINE - Wrote relaxed array as %s to %s.\n", outputText ? "text" : "a binary grid", outputFile);
+	}
+	if (debug >= 2 && rank == 0) {
+		fprintf(stdout, "LOG FINEST - Final array:\n");
+		for (i = 0; i < dimension; i++) {
+			for (j = 0; j < dimension; j++) {
+				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
+					fprintf(stdout, ANSI_COLOR_RED);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
+			}
+			fprintf(stdout, "\n");
+		}
+	}
+
+	if (mapping.base != NULL)
+		gridUnmap(&mapping);
+	else
+		free(values);
+	free(local);
+	free(newLocal);
+	MPI_Type_free(&part.column);
+	MPI_Comm_free(&grid);
+	MPI_Finalize();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);	/* mark the end time */
+
+	diff = BILLION * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec;
+	if (debug >= 1 && rank == 0) printf("LOG FINE - Completed in %llu Nanoseconds\n",  (long long unsigned int) diff);
+
+	return 0;
+}
+
+/* Splits the cells 1 up to cells + 1 into parts as even as they go, giving part index
+ * start up to end */
+void splitRange(int cells, int parts, int index, int *start, int *end) {
+	*start = 1 + (int) ((long) cells * index / parts);
+	*end = 1 + (int) ((long) cells * (index + 1) / parts);
+}
+
+/* The part of the array rank gets, splitting the cells inside the fixed edge as evenly as
+ * possible over the grid of processes */
+void partFor(struct Part *part, MPI_Comm grid, int rank, int dimension) {
+	int dims[2], periods[2], coords[2];
+
+	MPI_Cart_get(grid, 2, dims, periods, coords);
+	MPI_Cart_coords(grid, rank, 2, coords);
+	splitRange(dimension - 2, dims[0], coords[0], &part->rowStart, &part->rowEnd);
+	splitRange(dimension - 2, dims[1], coords[1], &part->colStart, &part->colEnd);
+	part->rows = part->rowEnd - part->rowStart;
+	part->cols = part->colEnd - part->colStart;
+	part->width = part->cols + 2;
+
+	int self;
+	MPI_Comm_rank(grid, &self);
+	if (rank != self) // Only used to find where another's part goes
+		return;
+
+	MPI_Cart_shift(grid, 0, 1, &part->up, &part->down);
+	MPI_Cart_shift(grid, 1, 1, &part->left, &part->right);
+	MPI_Type_vector(part->rows, 1, part->width, MPI_DOUBLE, &part->column);
+	MPI_Type_commit(&part->column);
+}
+
+/* Starts sending the outermost cells of the part to the neighbours and receiving theirs
+ * into the halo. Along the edge of the whole array the neighbour is MPI_PROC_NULL, so
+ * nothing is sent and the fixed edge stays in the halo. Finish with MPI_Waitall on the
+ * 8 requests */
+void exchangeStart(struct Part *part, double *values, MPI_Comm grid, MPI_Request *requests) {
+	int width = part->width;
+	double *firstRow = values + width + 1;
+	double *lastRow = values + (size_t)part->rows * width + 1;
+
+	MPI_Irecv(values + 1, part->cols, MPI_DOUBLE, part->up, TAG_DOWN, grid, &requests[0]);
+	MPI_Irecv(lastRow + width, part->cols, MPI_DOUBLE, part->down, TAG_UP, grid, &requests[1]);
+	MPI_Irecv(values + width, 1, part->column, part->left, TAG_RIGHT, grid, &requests[2]);
+	MPI_Irecv(values + width + part->cols + 1, 1, part->column, part->right, TAG_LEFT, grid, &requests[3]);
+
+	MPI_Isend(firstRow, part->cols, MPI_DOUBLE, part->up, TAG_UP, grid, &requests[4]);
+	MPI_Isend(lastRow, part->cols, MPI_DOUBLE, part->down, TAG_DOWN, grid, &requests[5]);
+	MPI_Isend(firstRow, 1, part->column, part->left, TAG_LEFT, grid, &requests[6]);
+	MPI_Isend(firstRow + part->cols - 1, 1, part->column, part->right, TAG_RIGHT, grid, &requests[7]);
+}
+
+/* Relaxes local rows rowStart up to rowEnd, cols colStart up to colEnd, from values into
+ * newValues for Jacobi, or in place for one colour of red-black when newValues is NULL.
+ * Colours go by where the cell is in the whole array, so match the other programs.
+ * Returns the largest change */
+double relaxCells(struct Part *part, double *values, double *newValues, int rowStart, int rowEnd,
+				  int colStart, int colEnd, int colour, double omega) {
+	int width = part->width;
+	double maxDelta = 0;
+	int row;
+
+	for (row = rowStart; row < rowEnd; row++) {
+		double *current = values + (size_t)row * width;
+		double delta;
+
+		if (newValues != NULL) {
+			delta = relaxRow(current, current - width, current + width, newValues + (size_t)row * width,
+							 colStart, colEnd);
+		} else {
+			int globalRow = part->rowStart + row - 1;
+			int globalCol = part->colStart + colStart - 1;
+			int first = colStart + ((globalRow + globalCol) % 2 != colour);
+			delta = relaxRowColour(current, current - width, current + width, first, colEnd, omega);
+		}
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+/* One relaxation of the part, or one colour of it. The cells that don't touch the halo
+ * are relaxed while it is on its way, which the stencil never reads past colEnd for (see
+ * stencil.h), then the ring of cells round them once it's in.
+ * Time spent waiting for it is added to haloWait. Returns the largest change */
+double relaxPart(struct Part *part, double *values, double *newValues, int colour, double omega,
+				 MPI_Comm grid, double *haloWait) {
+	MPI_Request requests[8];
+	int rows = part->rows, cols = part->cols;
+	double maxDelta, delta;
+
+	exchangeStart(part, values, grid, requests);
+
+	maxDelta = relaxCells(part, values, newValues, 2, rows, 2, cols, colour, omega);
+
+	double waitStart = MPI_Wtime();
+	MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+	*haloWait += MPI_Wtime() - waitStart;
+
+	// First and last rows whole, then what's left of the first and last columns
+	delta = relaxCells(part, values, newValues, 1, 2, 1, cols + 1, colour, omega);
+	if (delta > maxDelta)
+		maxDelta = delta;
+	if (rows > 1) {
+		delta = relaxCells(part, values, newValues, rows, rows + 1, 1, cols + 1, colour, omega);
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+	delta = relaxCells(part, values, newValues, 2, rows, 1, 2, colour, omega);
+	if (delta > maxDelta)
+		maxDelta = delta;
+	if (cols > 1) {
+		delta = relaxCells(part, values, newValues, 2, rows, cols, cols + 1, colour, omega);
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+/* The L2 norm of the residual over the whole array. The halo has to be brought up to
+ * date for it first */
+double residualPart(struct Part *part, double *values, MPI_Comm grid, double *haloWait, double *reduceWait) {
+	MPI_Request requests[8];
+	double sum = 0, total;
+	int row;
+
+	double waitStart = MPI_Wtime();
+	exchangeStart(part, values, grid, requests);
+	MPI_Waitall(8, requests, MPI_STATUSES_IGNORE);
+	*haloWait += MPI_Wtime() - waitStart;
+
+	for (row = 1; row <= part->rows; row++) {
+		double *current = values + (size_t)row * part->width;
+		sum += residualSquares(current, current - part->width, current + part->width, 1, part->cols + 1);
+	}
+
+	waitStart = MPI_Wtime();
+	MPI_Allreduce(&sum, &total, 1, MPI_DOUBLE, MPI_SUM, grid);
+	*reduceWait += MPI_Wtime() - waitStart;
+
+	return sqrt(total);
+}
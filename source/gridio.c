@@ -0,0 +1,924 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "gridio.h"
+
+#define WRITE_CHUNK (1 << 16) /* Values converted at a time on big endian machines */
+#define MAX_EXACT_DIGITS 19 /* Most decimal digits that always fit in 64 bits */
+#define MAX_EXACT_MANTISSA (1ULL << 53) /* Largest integer a double holds exactly */
+#define MAX_EXACT_POWER 22 /* Largest power of 10 a double holds exactly */
+#define MAX_TOKEN 512 /* Longest number handed to strtod */
+#define TEXT_WIDTH 24 /* Most bytes a value takes written as text, with the space after it */
+#define TEXT_SLICE_CELLS (1 << 16) /* Values each thread formats between writes */
+
+static const double powersOfTen[MAX_EXACT_POWER + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+struct TextRange {
+	const char *text;
+	size_t start, end; // Numbers starting in these bytes belong to this range
+	size_t count; // Numbers found in the range
+	size_t first; // Index of the range's first number in the file
+	double *values;
+	size_t cells;
+	int failed;
+};
+
+// Holds gridWriteText's threads until it knows how many it has
+struct TextStart {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int open;
+};
+
+struct TextSlice {
+	const double *values;
+	int rows, cols;
+	int bandRows; // Rows formatted by all the threads between writes
+	int fd;
+	char *buffer;
+	size_t length; // Bytes of buffer holding this band's text
+	int failed;
+	pthread_barrier_t *barrier;
+	struct TextStart *start;
+	struct TextSlice *slices;
+	int id, threads;
+};
+
+static uint32_t readLe32(const unsigned char *bytes) {
+	return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static void writeLe32(unsigned char *bytes, uint32_t value) {
+	bytes[0] = value & 0xff;
+	bytes[1] = (value >> 8) & 0xff;
+	bytes[2] = (value >> 16) & 0xff;
+	bytes[3] = (value >> 24) & 0xff;
+}
+
+static int littleEndian(void) {
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+}
+
+static void swapValues(double *values, size_t count) {
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		uint64_t bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+		bits = __builtin_bswap64(bits);
+		memcpy(&values[i], &bits, sizeof(bits));
+	}
+}
+
+/* pwrite that keeps going until everything is written, as a write can come back short */
+static int writeBytes(int fd, const void *data, size_t length, off_t offset) {
+	const char *bytes = (const char*) data;
+
+	while (length > 0) {
+		ssize_t put = pwrite(fd, bytes, length, offset);
+		if (put <= 0)
+			return 0;
+		bytes += put;
+		length -= put;
+		offset += put;
+	}
+
+	return 1;
+}
+
+static int isSpace(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/* Parses the number from *pos up to the next space or end, moving *pos past it.
+ *
+ * Decimal numbers of up to 19 significant digits whose digits fit exactly in a double,
+ * scaled by a power of 10 that also fits, come out of a single multiply or divide,
+ * which IEEE rounds exactly. Anything else (long numbers, huge exponents, inf, nan) is
+ * left to strtod. Returns 0 if it isn't a number. */
+static int parseNumber(const char **pos, const char *end, double *value) {
+	const char *p = *pos;
+	const char *token = p;
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0, negative = 0, exact = 1, seen = 0;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		seen = 1;
+		if (digits < MAX_EXACT_DIGITS) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0)
+				digits++;
+		} else {
+			exponent++;
+			exact = exact && *p == '0';
+		}
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			seen = 1;
+			if (digits < MAX_EXACT_DIGITS) {
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+				if (mantissa != 0)
+					digits++;
+			} else {
+				exact = exact && *p == '0';
+			}
+		}
+	}
+
+	if (seen && p < end && (*p == 'e' || *p == 'E')) {
+		const char *e = p + 1;
+		int expNegative = 0, expValue = 0, expSeen = 0;
+
+		if (e < end && (*e == '-' || *e == '+')) {
+			expNegative = *e == '-';
+			e++;
+		}
+		for (; e < end && *e >= '0' && *e <= '9'; e++) {
+			expSeen = 1;
+			if (expValue < 100000)
+				expValue = expValue * 10 + (*e - '0');
+		}
+		if (expSeen) {
+			exponent += expNegative ? -expValue : expValue;
+			p = e;
+		}
+	}
+
+	if (seen && (p == end || isSpace(*p)) && exact && mantissa <= MAX_EXACT_MANTISSA
+		&& exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+		double result = (double) mantissa;
+		if (exponent < 0)
+			result /= powersOfTen[-exponent];
+		else
+			result *= powersOfTen[exponent];
+
+		*value = negative ? -result : result;
+		*pos = p;
+		return 1;
+	}
+
+	// Not a simple decimal, hand it to strtod with a terminator the mapped file lacks
+	char buffer[MAX_TOKEN];
+	size_t length = 0;
+	char *parsedEnd;
+
+	for (p = token; p < end && !isSpace(*p); p++) {
+		if (length == MAX_TOKEN - 1)
+			return 0;
+		buffer[length++] = *p;
+	}
+	buffer[length] = '\0';
+
+	*value = strtod(buffer, &parsedEnd);
+	if (length == 0 || *parsedEnd != '\0')
+		return 0;
+
+	*pos = p;
+	return 1;
+}
+
+// Counts the numbers starting in a range so each range knows where its numbers go
+static void* countTextRange(void *td) {
+	struct TextRange *range = (struct TextRange*) td;
+	const char *p = range->text + range->start;
+	const char *end = range->text + range->end;
+
+	range->count = 0;
+	while (p < end) {
+		while (p < end && isSpace(*p))
+			p++;
+		if (p == end)
+			break;
+		range->count++;
+		while (p < end && !isSpace(*p))
+			p++;
+	}
+
+	return NULL;
+}
+
+static void* parseTextRange(void *td) {
+	struct TextRange *range = (struct TextRange*) td;
+	const char *p = range->text + range->start;
+	const char *end = range->text + range->end;
+
+	/* Ranges always end at a space or the end of the file, so a number
+	 * starting in this range ends in it too */
+	size_t index = range->first;
+	while (p < end && index < range->cells) {
+		while (p < end && isSpace(*p))
+			p++;
+		if (p == end)
+			break;
+		if (!parseNumber(&p, end, &range->values[index])) {
+			range->failed = 1;
+			break;
+		}
+		index++;
+	}
+
+	return NULL;
+}
+
+/* Runs pass over every range, one thread each. A range whose thread can't be created
+ * is run by the caller instead, so the pass still covers the whole file */
+static void runTextRanges(void* (*pass)(void*), struct TextRange *ranges, int threads) {
+	pthread_t thread[threads];
+	int started[threads];
+	int t;
+
+	for (t = 1; t < threads; t++)
+		started[t] = pthread_create(&thread[t], NULL, pass, &ranges[t]) == 0;
+	pass(&ranges[0]);
+	for (t = 1; t < threads; t++) {
+		if (started[t])
+			pthread_join(thread[t], NULL);
+		else
+			pass(&ranges[t]);
+	}
+}
+
+struct GridText {
+	const char *path;
+	const char *text; // The mapped file, NULL if it's empty
+	size_t length;
+	size_t cells;
+	int count; // Ranges the file is cut into
+	struct TextRange *ranges;
+};
+
+struct GridText* gridTextOpen(const char *path, double *values, size_t cells, int ranges) {
+	struct stat info;
+	const char *text = NULL;
+	int t;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "LOG ERROR - Failed to open file: %s.\n", path);
+		return NULL;
+	}
+
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t length = info.st_size;
+	if (length > 0) {
+		text = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (text == MAP_FAILED) {
+			close(fd);
+			fprintf(stderr, "LOG ERROR - Failed to map file: %s.\n", path);
+			return NULL;
+		}
+		madvise((void*) text, length, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	if (ranges < 1)
+		ranges = 1;
+
+	struct GridText *grid = malloc(sizeof(struct GridText));
+	struct TextRange *range = malloc(ranges * sizeof(struct TextRange));
+	if (grid == NULL || range == NULL) {
+		fprintf(stderr, "LOG ERROR - Out of memory reading file: %s.\n", path);
+		if (text != NULL)
+			munmap((void*) text, length);
+		free(grid);
+		free(range);
+		return NULL;
+	}
+	grid->path = path;
+	grid->text = text;
+	grid->length = length;
+	grid->cells = cells;
+	grid->count = ranges;
+	grid->ranges = range;
+
+	/* Split into equal byte ranges, then push each split forward until it isn't in the
+	 * middle of a number, so every number starts in exactly one range */
+	size_t split[ranges + 1];
+	for (t = 0; t <= ranges; t++) {
+		size_t at = (size_t) ((unsigned long long) length * t / ranges);
+		while (at > 0 && at < length && !isSpace(text[at - 1]))
+			at++;
+		split[t] = at;
+	}
+
+	for (t = 0; t < ranges; t++) {
+		range[t].text = text;
+		range[t].start = split[t];
+		range[t].end = split[t + 1] > split[t] ? split[t + 1] : split[t];
+		range[t].count = 0;
+		range[t].first = 0;
+		range[t].values = values;
+		range[t].cells = cells;
+		range[t].failed = 0;
+	}
+
+	return grid;
+}
+
+void gridTextCount(struct GridText *grid, int range) {
+	countTextRange(&grid->ranges[range]);
+}
+
+void gridTextParse(struct GridText *grid, int range) {
+	int t;
+
+	grid->ranges[range].first = 0;
+	for (t = 0; t < range; t++)
+		grid->ranges[range].first += grid->ranges[t].count;
+	parseTextRange(&grid->ranges[range]);
+}
+
+int gridTextClose(struct GridText *grid) {
+	const char *path = grid->path;
+	size_t cells = grid->cells;
+	size_t found = 0;
+	int failed = 0;
+	int t;
+
+	for (t = 0; t < grid->count; t++) {
+		found += grid->ranges[t].count;
+		failed = failed || grid->ranges[t].failed;
+	}
+	if (grid->text != NULL)
+		munmap((void*) grid->text, grid->length);
+	int empty = grid->length == 0;
+	free(grid->ranges);
+	free(grid);
+
+	if (empty) {
+		if (cells > 0)
+			fprintf(stderr, "LOG ERROR - %s is empty, %zu numbers needed.\n", path, cells);
+		return cells == 0;
+	}
+	if (failed) {
+		fprintf(stderr, "LOG ERROR - %s contains something that isn't a number.\n", path);
+		return 0;
+	}
+	if (found < cells) {
+		fprintf(stderr, "LOG ERROR - %s holds %zu numbers, %zu needed.\n", path, found, cells);
+		return 0;
+	}
+
+	return 1;
+}
+
+int gridLoadText(const char *path, double *values, size_t cells, int threads) {
+	int t;
+
+	struct GridText *grid = gridTextOpen(path, values, cells, threads);
+	if (grid == NULL)
+		return 0;
+
+	struct TextRange *ranges = grid->ranges;
+	runTextRanges(countTextRange, ranges, grid->count);
+	for (t = 1; t < grid->count; t++)
+		ranges[t].first = ranges[t - 1].first + ranges[t - 1].count;
+	runTextRanges(parseTextRange, ranges, grid->count);
+
+	return gridTextClose(grid);
+}
+
+int gridIsBinary(const char *path) {
+	char magic[4];
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return 0;
+
+	size_t got = fread(magic, 1, sizeof(magic), file);
+	fclose(file);
+
+	return got == sizeof(magic) && memcmp(magic, GRID_MAGIC, sizeof(magic)) == 0;
+}
+
+double* gridMap(const char *path, size_t cells, struct GridMapping *mapping) {
+	struct stat info;
+	unsigned char *header;
+
+	mapping->base = NULL;
+	mapping->length = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "LOG ERROR - Failed to open grid file: %s.\n", path);
+		return NULL;
+	}
+
+	if (fstat(fd, &info) != 0 || info.st_size < GRID_HEADER_SIZE) {
+		fprintf(stderr, "LOG ERROR - %s is too short to be a grid file.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	// Private and writable, so the solver can work on the values in place
+	mapping->length = info.st_size;
+	mapping->base = mmap(NULL, mapping->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping->base == MAP_FAILED) {
+		fprintf(stderr, "LOG ERROR - Failed to map grid file: %s.\n", path);
+		mapping->base = NULL;
+		return NULL;
+	}
+
+	header = mapping->base;
+	uint32_t rows = readLe32(header + 8);
+	uint32_t cols = readLe32(header + 12);
+
+	if (memcmp(header, GRID_MAGIC, 4) != 0 || readLe32(header + 4) != GRID_VERSION
+		|| readLe32(header + 16) != GRID_FLOAT64) {
+		fprintf(stderr, "LOG ERROR - %s is not a version %d grid file of doubles.\n", path, GRID_VERSION);
+		gridUnmap(mapping);
+		return NULL;
+	}
+
+	if ((size_t) rows * cols < cells
+		|| (mapping->length - GRID_HEADER_SIZE) / sizeof(double) < (size_t) rows * cols) {
+		fprintf(stderr, "LOG ERROR - %s holds %ux%u values, %zu needed.\n", path, rows, cols, cells);
+		gridUnmap(mapping);
+		return NULL;
+	}
+
+	double *values = (double*) (header + GRID_HEADER_SIZE);
+	if (!littleEndian())
+		swapValues(values, cells);
+
+	// The solver reads every value straight away, so start bringing them all in now
+	madvise(mapping->base, GRID_HEADER_SIZE + cells * sizeof(double), MADV_WILLNEED);
+
+	return values;
+}
+
+void gridUnmap(struct GridMapping *mapping) {
+	if (mapping->base != NULL)
+		munmap(mapping->base, mapping->length);
+	mapping->base = NULL;
+	mapping->length = 0;
+}
+
+int gridLoadMask(const char *path, unsigned char *mask, size_t cells, int threads) {
+	struct GridMapping mapping = { NULL, 0 };
+	double *values;
+	size_t i;
+
+	if (gridIsBinary(path)) {
+		values = gridMap(path, cells, &mapping);
+		if (values == NULL)
+			return 0;
+	} else {
+		values = malloc(cells * sizeof(double));
+		if (values == NULL) {
+			fprintf(stderr, "LOG ERROR - Out of memory reading mask: %s.\n", path);
+			return 0;
+		}
+		if (!gridLoadText(path, values, cells, threads)) {
+			free(values);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < cells; i++)
+		mask[i] = values[i] != 0;
+
+	if (mapping.base != NULL)
+		gridUnmap(&mapping);
+	else
+		free(values);
+	return 1;
+}
+
+/* path with .tmp on the end, for a file to be written whole before it replaces path.
+ * NULL if out of memory */
+static char* temporaryPath(const char *path) {
+	char *temp = malloc(strlen(path) + 5);
+	if (temp != NULL)
+		sprintf(temp, "%s.tmp", path);
+	return temp;
+}
+
+/* Renames temp over path if ok, otherwise removes it, and frees temp. Returns 0 if
+ * either wasn't ok */
+static int replaceFile(char *temp, const char *path, int ok) {
+	ok = ok && rename(temp, path) == 0;
+	if (!ok)
+		unlink(temp);
+	free(temp);
+	return ok;
+}
+
+int gridWrite(const char *path, const double *values, int rows, int cols) {
+	char *temp = temporaryPath(path);
+	if (temp == NULL)
+		return 0;
+
+	FILE *file = fopen(temp, "wb");
+	if (file == NULL) {
+		free(temp);
+		return 0;
+	}
+
+	int ok = gridWriteStream(file, values, rows, cols);
+	ok = fclose(file) == 0 && ok;
+	return replaceFile(temp, path, ok);
+}
+
+int gridWriteStream(FILE *file, const double *values, int rows, int cols) {
+	unsigned char header[GRID_HEADER_SIZE];
+	size_t cells = (size_t) rows * cols;
+	size_t written = 0;
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, GRID_MAGIC, 4);
+	writeLe32(header + 4, GRID_VERSION);
+	writeLe32(header + 8, rows);
+	writeLe32(header + 12, cols);
+	writeLe32(header + 16, GRID_FLOAT64);
+
+	int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+	if (littleEndian()) {
+		ok = ok && fwrite(values, sizeof(double), cells, file) == cells;
+	} else {
+		double *chunk = malloc(WRITE_CHUNK * sizeof(double));
+		ok = ok && chunk != NULL;
+		while (ok && written < cells) {
+			size_t count = cells - written < WRITE_CHUNK ? cells - written : WRITE_CHUNK;
+			memcpy(chunk, values + written, count * sizeof(double));
+			swapValues(chunk, count);
+			ok = fwrite(chunk, sizeof(double), count, file) == count;
+			written += count;
+		}
+		free(chunk);
+	}
+
+	return ok;
+}
+
+int gridReadStream(FILE *file, double *values, size_t cells) {
+	unsigned char header[GRID_HEADER_SIZE];
+
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, GRID_MAGIC, 4) != 0
+		|| readLe32(header + 4) != GRID_VERSION || readLe32(header + 16) != GRID_FLOAT64) {
+		fprintf(stderr, "LOG ERROR - Not a version %d grid of doubles.\n", GRID_VERSION);
+		return 0;
+	}
+	if ((size_t) readLe32(header + 8) * readLe32(header + 12) != cells) {
+		fprintf(stderr, "LOG ERROR - Grid holds %ux%u values, %zu needed.\n",
+				readLe32(header + 8), readLe32(header + 12), cells);
+		return 0;
+	}
+	if (fread(values, sizeof(double), cells, file) != cells) {
+		fprintf(stderr, "LOG ERROR - Grid is cut short.\n");
+		return 0;
+	}
+
+	if (!littleEndian())
+		swapValues(values, cells);
+	return 1;
+}
+
+int gridOpen(const char *path, size_t cells, int writable) {
+	unsigned char header[GRID_HEADER_SIZE];
+	struct stat info;
+
+	int fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "LOG ERROR - Failed to open grid file: %s.\n", path);
+		return -1;
+	}
+
+	if (fstat(fd, &info) != 0 || pread(fd, header, sizeof(header), 0) != sizeof(header)
+		|| memcmp(header, GRID_MAGIC, 4) != 0 || readLe32(header + 4) != GRID_VERSION
+		|| readLe32(header + 16) != GRID_FLOAT64) {
+		fprintf(stderr, "LOG ERROR - %s is not a version %d grid file of doubles.\n", path, GRID_VERSION);
+		close(fd);
+		return -1;
+	}
+
+	uint32_t rows = readLe32(header + 8);
+	uint32_t cols = readLe32(header + 12);
+	if ((size_t) rows * cols < cells || (info.st_size - GRID_HEADER_SIZE) / sizeof(double) < cells) {
+		fprintf(stderr, "LOG ERROR - %s holds %ux%u values, %zu needed.\n", path, rows, cols, cells);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int gridCreate(const char *path, int rows, int cols) {
+	unsigned char header[GRID_HEADER_SIZE];
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "LOG ERROR - Failed to create grid file: %s.\n", path);
+		return -1;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, GRID_MAGIC, 4);
+	writeLe32(header + 4, GRID_VERSION);
+	writeLe32(header + 8, rows);
+	writeLe32(header + 12, cols);
+	writeLe32(header + 16, GRID_FLOAT64);
+
+	// Sized up front, so the file is sparse until written rather than grown a piece at a time
+	if (pwrite(fd, header, sizeof(header), 0) != sizeof(header)
+		|| ftruncate(fd, GRID_HEADER_SIZE + (off_t) rows * cols * sizeof(double)) != 0) {
+		fprintf(stderr, "LOG ERROR - Failed to write grid file: %s.\n", path);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int gridReadValues(int fd, double *values, size_t first, size_t count) {
+	char *bytes = (char*) values;
+	size_t left = count * sizeof(double);
+	off_t offset = GRID_HEADER_SIZE + (off_t) first * sizeof(double);
+
+	// A read can come back short, so keep going until it's all in
+	while (left > 0) {
+		ssize_t got = pread(fd, bytes, left, offset);
+		if (got <= 0)
+			return 0;
+		bytes += got;
+		left -= got;
+		offset += got;
+	}
+
+	if (!littleEndian())
+		swapValues(values, count);
+	return 1;
+}
+
+int gridWriteValues(int fd, double *values, size_t first, size_t count) {
+	if (!littleEndian())
+		swapValues(values, count);
+
+	return writeBytes(fd, values, count * sizeof(double), GRID_HEADER_SIZE + (off_t) first * sizeof(double));
+}
+
+/* Writes value into out to GRID_TEXT_DECIMALS places without going through printf,
+ * returning the bytes used. The value is scaled to a whole number of the last decimal
+ * place, so below GRID_TEXT_LARGE it always fits in 64 bits */
+static int formatValue(char *out, double value) {
+	const uint64_t scale = (uint64_t) powersOfTen[GRID_TEXT_DECIMALS];
+	char digits[MAX_EXACT_DIGITS + 1];
+	char *p = out;
+	int n = 0;
+	int d;
+
+	if (!isfinite(value) || fabs(value) >= GRID_TEXT_LARGE)
+		return snprintf(out, TEXT_WIDTH, "%.*e", GRID_TEXT_DECIMALS, value);
+
+	uint64_t scaled = (uint64_t) (fabs(value) * scale + 0.5);
+	if (value < 0 && scaled > 0)
+		*p++ = '-';
+
+	uint64_t whole = scaled / scale;
+	uint64_t part = scaled % scale;
+	do {
+		digits[n++] = '0' + whole % 10;
+		whole /= 10;
+	} while (whole > 0);
+	while (n > 0)
+		*p++ = digits[--n];
+
+	*p++ = '.';
+	for (d = GRID_TEXT_DECIMALS - 1; d >= 0; d--) {
+		p[d] = '0' + part % 10;
+		part /= 10;
+	}
+
+	return p + GRID_TEXT_DECIMALS - out;
+}
+
+static void* writeTextSlice(void *td) {
+	struct TextSlice *slice = (struct TextSlice*) td;
+	const int cols = slice->cols;
+	off_t offset = 0;
+	int band, i, j, t;
+
+	pthread_mutex_lock(&slice->start->lock);
+	while (!slice->start->open)
+		pthread_cond_wait(&slice->start->ready, &slice->start->lock);
+	pthread_mutex_unlock(&slice->start->lock);
+
+	for (band = 0; band < slice->rows; band += slice->bandRows) {
+		int count = slice->rows - band < slice->bandRows ? slice->rows - band : slice->bandRows;
+		int first = band + (int) ((long) count * slice->id / slice->threads);
+		int last = band + (int) ((long) count * (slice->id + 1) / slice->threads);
+
+		char *p = slice->buffer;
+		for (i = first; i < last; i++) {
+			const double *row = slice->values + (size_t) i * cols;
+			for (j = 0; j < cols; j++) {
+				p += formatValue(p, row[j]);
+				*p++ = j == cols - 1 ? '\n' : ' ';
+			}
+		}
+		slice->length = p - slice->buffer;
+
+		// Once every slice of the band is formatted, each knows where in the file its text goes
+		pthread_barrier_wait(slice->barrier);
+
+		off_t at = offset;
+		for (t = 0; t < slice->threads; t++) {
+			if (t < slice->id)
+				at += slice->slices[t].length;
+			offset += slice->slices[t].length;
+		}
+		if (!slice->failed && !writeBytes(slice->fd, slice->buffer, slice->length, at))
+			slice->failed = 1;
+
+		// Lengths are read by everyone, so none can be overwritten by the next band until then
+		pthread_barrier_wait(slice->barrier);
+	}
+
+	return NULL;
+}
+
+int gridWriteText(const char *path, const double *values, int rows, int cols, int threads) {
+	int t;
+
+	if (threads > rows)
+		threads = rows;
+	if (threads < 1)
+		threads = 1;
+
+	char *temp = temporaryPath(path);
+	int fd = temp != NULL ? open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+	if (fd < 0) {
+		fprintf(stderr, "LOG ERROR - Failed to create text file: %s.\n", path);
+		free(temp);
+		return 0;
+	}
+
+	int bandRows = cols > 0 ? (int) ((long) threads * TEXT_SLICE_CELLS / cols) : rows;
+	if (bandRows < threads)
+		bandRows = threads;
+	size_t capacity = (size_t) ((bandRows + threads - 1) / threads) * cols * TEXT_WIDTH;
+
+	struct TextSlice slices[threads];
+	pthread_t thread[threads];
+	pthread_barrier_t barrier;
+	struct TextStart start = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+
+	int failed = 0;
+	for (t = 0; t < threads; t++) {
+		slices[t].values = values;
+		slices[t].rows = rows;
+		slices[t].cols = cols;
+		slices[t].bandRows = bandRows;
+		slices[t].fd = fd;
+		slices[t].buffer = malloc(capacity > 0 ? capacity : 1);
+		slices[t].length = 0;
+		slices[t].failed = 0;
+		slices[t].barrier = &barrier;
+		slices[t].start = &start;
+		slices[t].slices = slices;
+		slices[t].id = t;
+		slices[t].threads = threads;
+		failed = failed || slices[t].buffer == NULL;
+	}
+
+	if (!failed) {
+		int started = 1;
+		while (started < threads && pthread_create(&thread[started], NULL, writeTextSlice, &slices[started]) == 0)
+			started++;
+
+		/* Threads that couldn't be created leave their rows to those that were, with bands
+		 * cut so no slice formats more rows of one than its buffer holds */
+		if (started < threads) {
+			int sliceRows = (bandRows + threads - 1) / threads;
+			for (t = 0; t < started; t++) {
+				slices[t].threads = started;
+				slices[t].bandRows = sliceRows * started;
+			}
+		}
+
+		pthread_barrier_init(&barrier, NULL, started);
+		pthread_mutex_lock(&start.lock);
+		start.open = 1;
+		pthread_cond_broadcast(&start.ready);
+		pthread_mutex_unlock(&start.lock);
+
+		writeTextSlice(&slices[0]);
+		for (t = 1; t < started; t++)
+			pthread_join(thread[t], NULL);
+		pthread_barrier_destroy(&barrier);
+	}
+
+	for (t = 0; t < threads; t++) {
+		failed = failed || slices[t].failed;
+		free(slices[t].buffer);
+	}
+
+	failed = close(fd) != 0 || failed;
+	if (!replaceFile(temp, path, !failed)) {
+		fprintf(stderr, "LOG ERROR - Failed to write text file: %s.\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+int gridWriteImage(const char *path, const double *values, int rows, int cols, int side,
+				   double *low, double *high) {
+	int i, j;
+
+	if (rows < 1 || cols < 1 || side < 1) {
+		fprintf(stderr, "LOG ERROR - Nothing to draw in image: %s.\n", path);
+		return 0;
+	}
+
+	int height = rows < side ? rows : side;
+	int width = cols < side ? cols : side;
+	double *sums = calloc((size_t) height * width, sizeof(double));
+	int *pixelOfCol = malloc(cols * sizeof(int));
+	int *colsInPixel = calloc(width, sizeof(int));
+	int *rowsInPixel = calloc(height, sizeof(int));
+	unsigned char *pixels = malloc((size_t) height * width);
+	int ok = sums != NULL && pixelOfCol != NULL && colsInPixel != NULL && rowsInPixel != NULL && pixels != NULL;
+
+	if (ok) {
+		for (j = 0; j < cols; j++) {
+			pixelOfCol[j] = (int) ((long) j * width / cols);
+			colsInPixel[pixelOfCol[j]]++;
+		}
+
+		// One pass through the grid in order, adding each cell to the pixel it falls in
+		double smallest = values[0], largest = values[0];
+		for (i = 0; i < rows; i++) {
+			const double *row = values + (size_t) i * cols;
+			int pixelRow = (int) ((long) i * height / rows);
+			double *sum = sums + (size_t) pixelRow * width;
+			rowsInPixel[pixelRow]++;
+			for (j = 0; j < cols; j++) {
+				sum[pixelOfCol[j]] += row[j];
+				if (row[j] < smallest)
+					smallest = row[j];
+				if (row[j] > largest)
+					largest = row[j];
+			}
+		}
+		if (low != NULL)
+			*low = smallest;
+		if (high != NULL)
+			*high = largest;
+
+		double lowMean = INFINITY, highMean = -INFINITY;
+		for (i = 0; i < height; i++) {
+			for (j = 0; j < width; j++) {
+				double mean = sums[(size_t) i * width + j] / ((double) rowsInPixel[i] * colsInPixel[j]);
+				sums[(size_t) i * width + j] = mean;
+				if (mean < lowMean)
+					lowMean = mean;
+				if (mean > highMean)
+					highMean = mean;
+			}
+		}
+
+		double range = highMean > lowMean ? highMean - lowMean : 1;
+		for (i = 0; i < height * width; i++)
+			pixels[i] = (unsigned char) ((sums[i] - lowMean) / range * 255 + 0.5);
+
+		FILE *file = fopen(path, "wb");
+		ok = file != NULL;
+		ok = ok && fprintf(file, "P5\n%d %d\n255\n", width, height) > 0;
+		ok = ok && fwrite(pixels, 1, (size_t) height * width, file) == (size_t) height * width;
+		if (file != NULL)
+			ok = fclose(file) == 0 && ok;
+	}
+
+	free(sums);
+	free(pixelOfCol);
+	free(colsInPixel);
+	free(rowsInPixel);
+	free(pixels);
+
+	if (!ok)
+		fprintf(stderr, "LOG ERROR - Failed to write image: %s.\n", path);
+	return ok;
+}
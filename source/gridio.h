@@ -0,0 +1,122 @@
+#ifndef GRIDIO_H
+#define GRIDIO_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary grid files. A 32 byte header followed by rows * cols values, row after row,
+ * stored little endian whatever machine wrote them:
+ *
+ *	bytes 0-3	"RLXG"
+ *	bytes 4-7	format version, currently 1
+ *	bytes 8-11	rows
+ *	bytes 12-15	cols
+ *	bytes 16-19	type of each value, GRID_FLOAT64
+ *	bytes 20-31	reserved, 0
+ *
+ * As with text files, a file can be used for any array with no more cells than it has,
+ * the values are taken in order from the start.
+ */
+
+#define GRID_MAGIC "RLXG"
+#define GRID_VERSION 1
+#define GRID_HEADER_SIZE 32
+#define GRID_FLOAT64 1
+
+#define GRID_TEXT_DECIMALS 10
+#define GRID_TEXT_LARGE 1e9 /* Smallest magnitude written with an exponent */
+#define GRID_IMAGE_SIDE 1024 /* Default largest side of an image, in pixels */
+
+struct GridMapping {
+	void *base; // NULL if nothing is mapped
+	size_t length;
+};
+
+/* 1 if path is a binary grid file, 0 if it's anything else (such as text) or can't be read */
+int gridIsBinary(const char *path);
+
+/* Maps the first cells values of the binary grid file at path into memory, privately so
+ * changes never reach the file. Returns the values, or NULL with a message on stderr if
+ * the file is not a usable grid or has fewer than cells values.
+ * Release with gridUnmap. */
+double* gridMap(const char *path, size_t cells, struct GridMapping *mapping);
+
+void gridUnmap(struct GridMapping *mapping);
+
+/* Reads the first cells numbers of the whitespace separated text file at path into
+ * values, using threads threads. The file is mapped, cut into one range of bytes per
+ * thread at gaps between numbers, and each thread counts then parses its own range.
+ * Numbers are parsed without the locale and rounded exactly as strtod would.
+ * Returns 0, with a message on stderr, if the file can't be read, holds something that
+ * isn't a number, or has fewer than cells numbers. */
+int gridLoadText(const char *path, double *values, size_t cells, int threads);
+
+struct GridText;
+
+/* gridLoadText a pass at a time, for callers with threads of their own. gridTextOpen maps
+ * the file and cuts it into ranges ranges, returning NULL with a message on stderr if it
+ * can't be read. Each range is then given to gridTextCount, from any thread, and once
+ * every range has been counted to gridTextParse. gridTextClose releases the file and
+ * returns what gridLoadText would */
+struct GridText* gridTextOpen(const char *path, double *values, size_t cells, int ranges);
+void gridTextCount(struct GridText *grid, int range);
+void gridTextParse(struct GridText *grid, int range);
+int gridTextClose(struct GridText *grid);
+
+/* Reads a mask of cells to hold fixed from the first cells values of a text or binary
+ * grid file, setting mask to 1 where a value is nonzero and 0 where it is 0. Returns 0,
+ * with a message on stderr, if the file can't be read as gridMap or gridLoadText would */
+int gridLoadMask(const char *path, unsigned char *mask, size_t cells, int threads);
+
+/* Writes a rows x cols binary grid file. It's written to path.tmp and renamed over path
+ * once whole, so path can be the file values is mapped from with gridMap. Returns 0 on
+ * failure */
+int gridWrite(const char *path, const double *values, int rows, int cols);
+
+/* gridWrite to a file that is already open, from where it is, so a grid can follow
+ * something else in the same file. Leaves the file open. Returns 0 on failure */
+int gridWriteStream(FILE *file, const double *values, int rows, int cols);
+
+/* Writes the rows x cols values to a text file at path, a line per row, each value to
+ * GRID_TEXT_DECIMALS decimal places. threads threads each format a slice of rows into
+ * their own buffer and write it straight to its place in the file, a band of rows at a
+ * time, so memory stays bounded whatever the size of the grid. Values of GRID_TEXT_LARGE
+ * or more, and those that aren't finite, are written with an exponent. Values are scaled
+ * and rounded in binary rather than printf's exact decimal, so one just short of halfway
+ * between two last places can round up, and -0 loses its sign. The file reads back with
+ * gridLoadText. Like gridWrite it goes through path.tmp. Returns 0, with a message on
+ * stderr, on failure */
+int gridWriteText(const char *path, const double *values, int rows, int cols, int threads);
+
+/* Writes a greyscale binary PGM image of the rows x cols values to path, shrunk so
+ * neither side is over side pixels, each pixel the mean of the cells it covers. Black is
+ * the smallest mean and white the largest. If low and high are not NULL they are set to
+ * the smallest and largest value in the grid. Returns 0, with a message on stderr, on failure */
+int gridWriteImage(const char *path, const double *values, int rows, int cols, int side,
+				   double *low, double *high);
+
+/* Reads a grid written by gridWriteStream from where file is into values, which must
+ * hold exactly cells values. Returns 0, with a message on stderr, if it isn't a grid of
+ * that many values or can't be read */
+int gridReadStream(FILE *file, double *values, size_t cells);
+
+/* Opens the binary grid file at path to read its values, and if writable is 1 to write
+ * them in place, checking it holds at least cells values. Returns the file descriptor,
+ * or -1 with a message on stderr */
+int gridOpen(const char *path, size_t cells, int writable);
+
+/* Creates, or empties and replaces, a rows x cols binary grid file at path, at its full
+ * length with every value 0. Returns the file descriptor open for reading and writing,
+ * or -1 with a message on stderr */
+int gridCreate(const char *path, int rows, int cols);
+
+/* Reads count values, from value first on, of a grid file opened by gridOpen or
+ * gridCreate. Returns 0 on failure */
+int gridReadValues(int fd, double *values, size_t first, size_t count);
+
+/* Writes count values from value first on. On big endian machines values are swapped
+ * into file order as they are written, and left that way. Returns 0 on failure */
+int gridWriteValues(int fd, double *values, size_t first, size_t count);
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "stencil.h"
+#include "multigrid.h"
+
+#define COARSEST_DIMENSION 5
+
+int multigridLevelCount(int dimension) {
+	int count = 1;
+
+	while (dimension > COARSEST_DIMENSION) {
+		dimension = dimension / 2 + 1; // (dimension - 1) / 2 intervals, rounded up
+		count++;
+	}
+
+	return count;
+}
+
+/* Works out how coarse lines up with a fine level of fineDimension. Returns 0 if
+ * allocation failed */
+static int mapLevel(struct Level *coarse, int fineDimension) {
+	int coarseDimension = coarse->dimension;
+	// Coarse cells per fine cell, 0.5 when they line up exactly
+	double ratio = (double) (coarseDimension - 1) / (fineDimension - 1);
+	int i, k;
+
+	coarse->support = malloc((size_t)coarseDimension * SUPPORT * sizeof(int));
+	coarse->supportWeight = malloc((size_t)coarseDimension * SUPPORT * sizeof(double));
+	coarse->below = malloc((size_t)fineDimension * sizeof(int));
+	coarse->fraction = malloc((size_t)fineDimension * sizeof(double));
+	if (coarse->support == NULL || coarse->supportWeight == NULL
+		|| coarse->below == NULL || coarse->fraction == NULL)
+		return 0;
+
+	for (i = 0; i < coarseDimension * SUPPORT; i++)
+		coarse->support[i] = -1;
+
+	for (i = 0; i < fineDimension; i++) {
+		double position = i * ratio;
+		int below = (int) position;
+		if (below > coarseDimension - 2)
+			below = coarseDimension - 2;
+
+		coarse->below[i] = below;
+		coarse->fraction[i] = position - below;
+
+		// This fine cell takes part of the coarse cells either side of it
+		for (k = 0; k < 2; k++) {
+			int c = below + k;
+			double weight = 1 - fabs(position - c);
+			if (weight <= 0)
+				continue;
+
+			int slot = 0;
+			while (slot < SUPPORT - 1 && coarse->support[c * SUPPORT + slot] != -1)
+				slot++;
+			coarse->support[c * SUPPORT + slot] = i;
+			coarse->supportWeight[c * SUPPORT + slot] = weight;
+		}
+	}
+
+	return 1;
+}
+
+int multigridInit(struct Level *levels, int levelCount, double *values, int dimension) {
+	int l;
+
+	levels[0].dimension = dimension;
+	levels[0].values = values;
+	levels[0].rhs = NULL;
+	levels[0].support = NULL;
+	levels[0].supportWeight = NULL;
+	levels[0].below = NULL;
+	levels[0].fraction = NULL;
+
+	for (l = 1; l < levelCount; l++) {
+		int coarse = levels[l-1].dimension / 2 + 1;
+		levels[l].dimension = coarse;
+		levels[l].values = calloc((size_t)coarse * coarse, sizeof(double));
+		levels[l].rhs = calloc((size_t)coarse * coarse, sizeof(double));
+		if (levels[l].values == NULL || levels[l].rhs == NULL
+			|| !mapLevel(&levels[l], levels[l-1].dimension)) {
+			multigridFree(levels, l + 1);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void multigridFree(struct Level *levels, int levelCount) {
+	int l;
+
+	for (l = 1; l < levelCount; l++) {
+		free(levels[l].values);
+		free(levels[l].rhs);
+		free(levels[l].support);
+		free(levels[l].supportWeight);
+		free(levels[l].below);
+		free(levels[l].fraction);
+		levels[l].values = NULL;
+		levels[l].rhs = NULL;
+		levels[l].support = NULL;
+		levels[l].supportWeight = NULL;
+		levels[l].below = NULL;
+		levels[l].fraction = NULL;
+	}
+}
+
+void multigridSmooth(struct Level *level, int rowStart, int rowEnd, int colour) {
+	int dimension = level->dimension;
+	int row, col;
+
+	for (row = rowStart; row < rowEnd; row++) {
+		double *current = level->values + (size_t)row * dimension;
+		int first = (row + 1) % 2 == colour ? 1 : 2;
+
+		// The finest level is exactly the plain relaxation
+		if (level->rhs == NULL) {
+			relaxRowColour(current, current - dimension, current + dimension, first, dimension - 1, 1.0);
+			continue;
+		}
+
+		double *rhs = level->rhs + (size_t)row * dimension;
+		for (col = first; col < dimension - 1; col += 2)
+			current[col] = (current[col - dimension] + current[col + dimension]
+							+ current[col-1] + current[col+1] + rhs[col]) / 4.0;
+	}
+}
+
+/* Leftover error at one cell, scaled to the cell size: how far it is from satisfying
+ * its equation. Edges are always satisfied */
+static inline double defect(struct Level *level, int row, int col) {
+	int dimension = level->dimension;
+
+	if (row <= 0 || row >= dimension - 1 || col <= 0 || col >= dimension - 1)
+		return 0;
+
+	double *current = level->values + (size_t)row * dimension;
+	double result = current[col - dimension] + current[col + dimension]
+					+ current[col-1] + current[col+1] - 4 * current[col];
+	if (level->rhs != NULL)
+		result += level->rhs[(size_t)row * dimension + col];
+	return result;
+}
+
+void multigridRestrict(struct Level *fine, struct Level *coarse, int rowStart, int rowEnd) {
+	int dimension = coarse->dimension;
+	int row, col, k, m;
+
+	for (row = rowStart; row < rowEnd; row++) {
+		double *rhs = coarse->rhs + (size_t)row * dimension;
+		double *values = coarse->values + (size_t)row * dimension;
+		int *rowSupport = coarse->support + row * SUPPORT;
+		double *rowWeight = coarse->supportWeight + row * SUPPORT;
+
+		for (col = 1; col < dimension - 1; col++) {
+			int *colSupport = coarse->support + col * SUPPORT;
+			double *colWeight = coarse->supportWeight + col * SUPPORT;
+			double weighted = 0;
+
+			/* The transpose of interpolation. The coarse equation is scaled to its cell
+			 * size, which exactly cancels the 1 / (cells covered) of an average */
+			for (k = 0; k < SUPPORT && rowSupport[k] != -1; k++) {
+				for (m = 0; m < SUPPORT && colSupport[m] != -1; m++)
+					weighted += rowWeight[k] * colWeight[m] * defect(fine, rowSupport[k], colSupport[m]);
+			}
+
+			rhs[col] = weighted;
+			values[col] = 0;
+		}
+	}
+}
+
+void multigridProlong(struct Level *coarse, struct Level *fine, int rowStart, int rowEnd) {
+	int dimension = fine->dimension;
+	int coarseDimension = coarse->dimension;
+	int row, col;
+
+	for (row = rowStart; row < rowEnd; row++) {
+		double *values = fine->values + (size_t)row * dimension;
+		// Coarse rows either side of this one
+		double *up = coarse->values + (size_t)coarse->below[row] * coarseDimension;
+		double *down = up + coarseDimension;
+		double t = coarse->fraction[row];
+
+		for (col = 1; col < dimension - 1; col++) {
+			int left = coarse->below[col];
+			double s = coarse->fraction[col];
+
+			values[col] += (1 - t) * ((1 - s) * up[left] + s * up[left+1])
+						   + t * ((1 - s) * down[left] + s * down[left+1]);
+		}
+	}
+}
+
+double multigridChange(struct Level *level, int rowStart, int rowEnd) {
+	int dimension = level->dimension;
+	double maxDelta = 0;
+	int row, col;
+
+	for (row = rowStart; row < rowEnd; row++) {
+		double *current = level->values + (size_t)row * dimension;
+
+		for (col = 1; col < dimension - 1; col++) {
+			double average = (current[col - dimension] + current[col + dimension]
+							  + current[col-1] + current[col+1]) / 4.0;
+			double delta = fabs(current[col] - average);
+			if (delta > maxDelta)
+				maxDelta = delta;
+		}
+	}
+
+	return maxDelta;
+}
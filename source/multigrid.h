@@ -0,0 +1,66 @@
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+/* Geometric multigrid for the relaxation. Relaxing only smooths out the error quickly
+ * where it changes from cell to cell; the smooth error left over shrinks by a tiny
+ * amount each sweep on a big array. Multigrid moves what's left to an array half the
+ * size each way, where it's less smooth relative to the cells, relaxes there, and
+ * carries the correction back. Done recursively down to a few cells, the total work
+ * ends up close to a constant number of sweeps of the full array.
+ *
+ * Each level solves (4u - sum of neighbours) = rhs, where the finest level has no rhs
+ * (just averaging, as before) and coarser ones have the restricted leftover error scaled
+ * to their cell size. Edges are fixed on the finest level and 0 on coarser ones.
+ *
+ * Each level spreads its cells evenly over the same square, with just over half as many
+ * each way as the level above. Moving between levels interpolates by position, so any
+ * dimension works: when dimension - 1 is even every other fine cell lines up with a
+ * coarse one and this is plain full weighting and bilinear interpolation.
+ *
+ * The functions here work on a range of rows so threads can share each step out.
+ */
+
+#define SUPPORT 4 /* Most fine cells one coarse cell's interpolation reaches each way */
+
+struct Level {
+	int dimension;
+	double *values;
+	double *rhs; // NULL on the finest level
+
+	/* How a coarse level lines up with the level above it, the same for rows and columns.
+	 * Coarse cell I interpolates onto fine cells support[I * SUPPORT + k], weighted by
+	 * supportWeight[I * SUPPORT + k], with -1 for unused entries. Fine cell i sits
+	 * fraction[i] of the way from coarse cell below[i] to the next one. */
+	int *support;
+	double *supportWeight;
+	int *below;
+	double *fraction;
+};
+
+/* Number of levels from an array of dimension down to the coarsest */
+int multigridLevelCount(int dimension);
+
+/* Sets up levels[0] over values and allocates the coarser levels with zero values.
+ * Returns 0 if allocation failed */
+int multigridInit(struct Level *levels, int levelCount, double *values, int dimension);
+
+/* Frees the coarser levels, levels[0].values belongs to the caller */
+void multigridFree(struct Level *levels, int levelCount);
+
+/* Red-black Gauss-Seidel on one colour of rows rowStart up to but not including rowEnd */
+void multigridSmooth(struct Level *level, int rowStart, int rowEnd, int colour);
+
+/* Sets coarse rows rowStart to rowEnd (not including) of the rhs from the leftover error
+ * on fine, weighting each fine cell by how close it is, and zeroes their values ready
+ * to find the correction */
+void multigridRestrict(struct Level *fine, struct Level *coarse, int rowStart, int rowEnd);
+
+/* Adds the correction found on coarse to fine rows rowStart to rowEnd (not including),
+ * interpolating between coarse cells */
+void multigridProlong(struct Level *coarse, struct Level *fine, int rowStart, int rowEnd);
+
+/* Largest change a Jacobi sweep would make to rows rowStart to rowEnd (not including) of
+ * the finest level - the same test of precision as the other methods use */
+double multigridChange(struct Level *level, int rowStart, int rowEnd);
+
+#endif
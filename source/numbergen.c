@@ -2,31 +2,99 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
-#include <time.h>
 
-double fRand(double, double);
+#include "gridio.h"
+#include "rng.h"
+
+int main(int argc, char *argv[]) {
+
+	/* Values hard coded - ensure to update
+	 * dimension - how big the square array is
+	 * outFile - file to write the numbers to
+	 * binary - 0 to write text, 1 to write a binary grid file (see gridio.h)
+	 * seed - what the numbers are made from, the same seed giving the same numbers as -seed does for
+	 * 			the solvers' -g 1. 0 to pick one from the clock
+	 */
 
-int main() {
 	int i;
 	int dimension = 100;
+	const char *outFile = "valuesSmall.txt";
+	int binary = 0;
+	unsigned long long seed = 0;
 	double val;
 
+	/* Parse command line input */
+	int a;
+	for (a = 1; a < argc; a++) { /* argv[0] is program name */
+		if (strcmp(argv[a], "-d") == 0 || strcmp(argv[a], "-dimension") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					dimension = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -d. Positive integer required. Using %d dimension as default.\n", dimension);
+				}
+			}
+		} else if (strcmp(argv[a], "-f") == 0 || strcmp(argv[a], "-filepath") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-b") == 0 || strcmp(argv[a], "-binary") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					binary = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -b. Integer >= 0 required. Writing text as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strtoull(argv[a+1], NULL, 10) > 0) {
+					a++;
+					seed = strtoull(argv[a], NULL, 10);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -seed. Positive integer required. Using a seed from the clock as default.\n");
+				}
+			}
+		}
+	}
+
+	if (seed == 0)
+		seed = rngClockSeed();
+
+	if (binary) {
+		double *values = malloc((size_t)dimension * dimension * sizeof(double));
+		if (values == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to allocate values. Exiting program");
+			return 1;
+		}
+
+		rngFill(values, 0, (size_t)dimension * dimension, seed, 1, 2);
+
+		if (!gridWrite(outFile, values, dimension, dimension)) {
+			fprintf(stdout, "LOG ERROR - Failed to write file. Exiting program");
+			free(values);
+			return 1;
+		}
+
+		free(values);
+		return 0;
+	}
+
 	FILE *valueFile;
-	valueFile = fopen("valuesSmall.txt", "w");
+	valueFile = fopen(outFile, "w");
 	if (valueFile == NULL) {
 		fprintf(stdout, "LOG ERROR - Failed to open file. Exiting program");
 		return 1;
 	}
 
-	srand((unsigned)time(NULL));
-
 	for (i = 0; i < dimension * dimension; i++) {
-		val = fRand(1, 2);
+		val = rngUniform(seed, i, 1, 2);
 		fprintf(valueFile, "%.5lf ", val);
 	}
-}
 
-double fRand(double fMin, double fMax) {
-    double f = (double)rand() / RAND_MAX;
-    return fMin + f * (fMax - fMin);
-}
\ No newline at end of file
+	fclose(valueFile);
+	return 0;
+}
@@ -0,0 +1,23 @@
+#include <stddef.h>
+
+#include "relax.h"
+
+void relaxOptionsInit(struct RelaxOptions *options) {
+	options->method = METHOD_JACOBI;
+	options->precision = 0.0000000001;
+	options->threads = 0;
+	options->partition = PARTITION_ROWS;
+	options->sweeps = 1;
+	options->omega = 0;
+	options->cycleShape = 1;
+	options->profile = NULL;
+	options->hugePages = 0;
+	options->norm = NORM_MAX;
+	options->checkEvery = 1;
+	options->arithmetic = ARITHMETIC_DOUBLE;
+	options->checkpoint = NULL;
+	options->resume = NULL;
+	options->mask = NULL;
+	options->active = 0;
+	options->sync = SYNC_GLOBAL;
+}
@@ -1,132 +1,141 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <math.h>
 #include <time.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <unistd.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "relax.h"
+#include "profile.h"
+#include "checkpoint.h"
+#include "stream.h"
+#include "rng.h"
 
 #define ANSI_COLOR_RED     ""
 #define ANSI_COLOR_RESET   ""
 
 #define BILLION 1000000000L
 
-pthread_mutex_t precisionLock;
-pthread_barrier_t barrier;
-
-double fRand(double, double);
+int isFixed(int, int, int, int, int, const unsigned char *);
 void setValue(int, int);
 
-struct RelaxData {
-    int chunkStart, chunkEnd;
-    double *values;
-    double *newValues;
-    int *withinPrecision;
-    int dimension;
-    double precision;
-};
-
-void* relaxArray(void *td) {
-	struct RelaxData *data = (struct RelaxData*) td;
-
-	int chunkStart = data->chunkStart;
-	int chunkEnd = data->chunkEnd;
-	double *values = data->values;
-	double *newValues = data->newValues;
-	int *withinPrecision = data->withinPrecision;
-	int dimension = data->dimension;
-	double precision = data->precision;
-	int outOfPrecision = 1;
-
-	while (outOfPrecision) {
-		outOfPrecision = 0;
-
-		int i;
-
-		for (i = chunkStart; i < chunkEnd + 1; i++) {
-			if ((i % dimension) == 0 || (i % dimension) == (dimension-1))
-				continue;
-
-			double above, below, left, right;
-			// Get the neighbouring values for this index
-			above = values[i-dimension];
-			below = values[i+dimension];
-			left = values[i-1];
-			right = values[i+1];
-			// Set the new value to the average of the neighbouring values
-			newValues[i] = (above + below + left + right) / 4.0;
-
-			if (fabs(values[i] - newValues[i]) > precision) {
-				outOfPrecision = 1;
-			}
-		}
-		
-		if (outOfPrecision) {
-			pthread_mutex_lock(&precisionLock);
-			*withinPrecision = 0;
-			pthread_mutex_unlock(&precisionLock);
-		}
-
-		// Wait until all the newValues are calculated
-		pthread_barrier_wait(&barrier);
-
-		if (*withinPrecision == 0) {
-			outOfPrecision = 1; // So the while loop continues
-			for (i = chunkStart; i < chunkEnd + 1; i++) {
-				if ((i % dimension) == 0 || (i % dimension) == (dimension-1))
-					continue;
-
-				// Move relaxed numbers back into original arra
-				values[i] = newValues[i];
-			}
-
-			// Wait until all the newValues have moved in to values
-			pthread_barrier_wait(&barrier);
-
-			// Update withinPrecision back to 1 to reset precision check
-			if (*withinPrecision == 0) {
-				pthread_mutex_lock(&precisionLock);
-				*withinPrecision = 1;
-				pthread_mutex_unlock(&precisionLock);
-			}
-
-			pthread_barrier_wait(&barrier);
-		}
-					
-	}
-
-	return NULL;
-}
-
 int main(int argc, char *argv[]) {
 
 	/* Values hard coded - ensure to update
 	 * debug - The level of debug output: 0, 1, 2
 	 * cores - number of cores to use for the program
 	 * dimension - how big the square array is
+	 * rows, cols - how many rows and columns the array has, to make it rectangular. 0 to use dimension
+	 * planes - 1 for a 2D array, or how many rows x cols planes deep a 3D one is, relaxed with the 7 point
+	 * 				stencil. 3D is always jacobi in double, without masks, checkpoints or streaming
 	 * precision - how precise the relaxation needs to be before the program ends
+	 * isa - which version of the stencil to use: scalar, avx2 or avx512. Best supported by default
+	 * method - jacobi (two arrays), gs (red-black Gauss-Seidel in place) or sor (red-black over-relaxation in place)
+	 * omega - how far sor moves each cell past the average of its neighbours, 0 to estimate it from the dimension
+	 * cycleShape - for multigrid, how many times each level visits the next coarser: 1 (v) or 2 (w)
+	 * partition - how the array is split between threads: rows (a strip each) or tiles (sized to L2 cache)
+	 * sweeps - relaxations done on a tile at a time while it's in cache, checking precision after the last.
+	 * 			Above 1 always uses tiles. Can overshoot precision by up to sweeps - 1 relaxations
+	 * active - 1 to stop relaxing tiles once they and their neighbours have settled, looking at them again
+	 * 			every few sweeps, with idle threads taking tiles from busy ones. Ends with a sweep of every tile.
+	 * 			Jacobi in double without temporal blocking, planes or checkpoints only, and always uses tiles
+	 * sync - how threads keep in step: global (everyone waits for everyone after each relaxation) or
+	 * 			neighbours (each waits only for the threads next to it, checking convergence a few relaxations
+	 * 			behind). Neighbours is for jacobi in double on the max norm, without active, temporal or checkpoints
+	 * arithmetic - double, float (half the memory traffic, can't go below FLOAT_FLOOR) or mixed (float, then double
+	 * 				to finish). Only for jacobi, gs and sor without temporal blocking
+	 *
+	 * norm - what has to fall below precision: max (largest change), l2 (residual) or relative (residual over starting residual)
+	 * checkEvery - relaxations between convergence checks, 0 to adapt as the solve goes. Can overshoot by up to checkEvery - 1
+	 * profile - 0 off, 1 to print where each thread spent its time, 2 to add hardware counters
+	 * traceFile - Chrome trace JSON of every thread's compute and sync spans, NULL for none. Implies profile
+	 * affinity - how threads are pinned to CPUs: compact (fill a socket first), scatter (across sockets), none, or cpuList
+	 * cpuList - CPUs to pin threads to in order, like 0,2,4-7, used when affinity is AFFINITY_LIST
+	 * hugePages - 1 to back the arrays with 2MB pages where the system allows
+	 *
+	 * checkpointFile - where to save progress as the solve goes, NULL for nowhere
+	 * checkpointEvery - relaxations, or multigrid cycles, between checkpoints. One still being written when
+	 * 				the next is due means that one is skipped
+	 * resumeFile - checkpoint to carry on from, NULL to start afresh. Its settings replace those given, and
+	 * 				it's checkpointed to again unless checkpointFile is set
+	 *
+	 * streamFile - binary grid file to relax textFile into out of core, a band of rows at a time, NULL to
+	 * 				relax in memory. Jacobi only, doing sweeps relaxations each pass through the file
+	 * bandRows - rows streamed through at a time, 0 for about 8MB of them
+	 *
+	 * maskFile - text or binary grid file with a nonzero value for each cell to hold fixed along with the
+	 * 				outer ring, NULL for just the ring. Not for multigrid, which uses sor instead, or streaming
+	 *
+	 * outputFile - where to write the relaxed array, NULL for nowhere. A binary grid file, like -f reads,
+	 * 				or text with a line per row if outputText is 1. 3D arrays are written a plane after another
+	 * outputText - 0 for a binary grid file, 1 for text to GRID_TEXT_DECIMALS places
+	 * imageFile - greyscale PGM of the relaxed array, shrunk to at most GRID_IMAGE_SIDE pixels a side,
+	 * 				NULL for none. Shows the middle plane of a 3D array
 	 *
 	 * generateNumbers - 0 to use values in setValues[][], 1 to generate them randomly
-	 * textFile[] - text file to read numbers from. Needs to be set and filled in if generateNumbers == 0
-	 * 				needs to contain at least dimension*dimension numbers, can contain more but not less
+	 * seed - what the random values are made from, the same seed always giving the same array whatever
+	 * 				the cores. 0 to pick one from the clock
+	 * textFile - text or binary grid file (see gridio.h) to read numbers from. Needs to be set and filled in if generateNumbers == 0
+	 * 				needs to contain at least planes*rows*cols numbers, can contain more but not less
 	 */
 
 	int debug = 0; /* Debug output: 0 no detail - 1 some detail - 2 all detail */
 
 	int cores = 4; 
 	int dimension = 10;
+	int rows = 0;
+	int cols = 0;
+	int planes = 1;
 	double precision = 0.0000000001;
+	enum Partition partition = PARTITION_ROWS;
+	int sweeps = 1;
+	int active = 0;
+	enum Sync sync = SYNC_GLOBAL;
+	enum Arithmetic arithmetic = ARITHMETIC_DOUBLE;
+
+	enum Method method = METHOD_JACOBI;
+	double omega = 0;
+	int cycleShape = 1;
+
+	enum Norm norm = NORM_MAX;
+	int checkEvery = 1;
+
+	int profile = 0;
+	const char *traceFile = NULL;
+
+	enum Affinity affinity = AFFINITY_COMPACT;
+	const char *cpuList = NULL;
+	int hugePages = 0;
+
+	const char *checkpointFile = NULL;
+	int checkpointEvery = 1000;
+	const char *resumeFile = NULL;
+
+	const char *streamFile = NULL;
+	int bandRows = 0;
+
+	const char *maskFile = NULL;
+
+	const char *outputFile = NULL;
+	int outputText = 0;
+	const char *imageFile = NULL;
 
 	int generateNumbers = 1;
+	unsigned long long seed = 0;
 	// textFile needs to be set and filled in if generateNumbers == 0
-	char textFile[] = "scratch/valuesSmall.txt";
+	const char *textFile = "scratch/valuesSmall.txt";
 	
 	/* End editable values */
 
 	uint64_t diff;
-	struct timespec start, end;
+	struct timespec start, loaded, solved, end;
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
+	stencilInit();
+
 	/* Parse command line input */
 	int a;
 	for (a = 1; a < argc; a++) { /* argv[0] is program name */
@@ -148,6 +157,38 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "LOG WARNING - Invalid argument for -d. Positive integer required. Using %d dimension as default.\n", dimension);
 				}
 			}
+		} else if (strcmp(argv[a], "-rows") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					rows = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -rows. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-cols") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					cols = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -cols. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-planes") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) == 1 || atoi(argv[a+1]) >= 3) {
+					a++;
+					planes = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -planes. 1, or an integer of at least 3, required. Using %d planes as default.\n", planes);
+				}
+			}
+		} else if (strcmp(argv[a], "-mask") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				maskFile = argv[a];
+			}
 		} else if (strcmp(argv[a], "-p") == 0 || strcmp(argv[a], "-precision") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
 				if (atof(argv[a+1]) > 0.0) {
@@ -166,6 +207,15 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "LOG WARNING - Invalid argument for -g. Integer >= 0 required. Using %d dimension as default.\n", dimension);
 				}
 			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strtoull(argv[a+1], NULL, 10) > 0) {
+					a++;
+					seed = strtoull(argv[a], NULL, 10);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -seed. Positive integer required. Using a seed from the clock as default.\n");
+				}
+			}
 		} else if (strcmp(argv[a], "-debug") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
 				if (atoi(argv[a+1]) >= 0) {
@@ -175,157 +225,652 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "LOG WARNING - Invalid argument for -debug. Integer >= 0 required. Using %d debug as default.\n", debug);
 				}
 			}
+		} else if (strcmp(argv[a], "-partition") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "rows") == 0) {
+					a++;
+					partition = PARTITION_ROWS;
+				} else if (strcmp(argv[a+1], "tiles") == 0) {
+					a++;
+					partition = PARTITION_TILES;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -partition. rows or tiles required. Using rows as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-temporal") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					sweeps = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -temporal. Positive integer required. Using %d sweeps as default.\n", sweeps);
+				}
+			}
+		} else if (strcmp(argv[a], "-active") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "0") == 0 || strcmp(argv[a+1], "1") == 0) {
+					a++;
+					active = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -active. 0 or 1 required. Using %d active as default.\n", active);
+				}
+			}
+		} else if (strcmp(argv[a], "-sync") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "global") == 0) {
+					a++;
+					sync = SYNC_GLOBAL;
+				} else if (strcmp(argv[a+1], "neighbours") == 0) {
+					a++;
+					sync = SYNC_NEIGHBOURS;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -sync. global or neighbours required. Using global as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-method") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "jacobi") == 0) {
+					a++;
+					method = METHOD_JACOBI;
+				} else if (strcmp(argv[a+1], "gs") == 0) {
+					a++;
+					method = METHOD_GAUSS_SEIDEL;
+				} else if (strcmp(argv[a+1], "sor") == 0) {
+					a++;
+					method = METHOD_SOR;
+				} else if (strcmp(argv[a+1], "multigrid") == 0) {
+					a++;
+					method = METHOD_MULTIGRID;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -method. jacobi, gs, sor or multigrid required. Using jacobi as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-cycle") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "v") == 0) {
+					a++;
+					cycleShape = 1;
+				} else if (strcmp(argv[a+1], "w") == 0) {
+					a++;
+					cycleShape = 2;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -cycle. v or w required. Using v as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-omega") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) >= 0.0 && atof(argv[a+1]) < 2.0) {
+					a++;
+					omega = atof(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -omega. Double from 0 up to 2 required. Estimating omega as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-norm") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "max") == 0) {
+					a++;
+					norm = NORM_MAX;
+				} else if (strcmp(argv[a+1], "l2") == 0) {
+					a++;
+					norm = NORM_L2;
+				} else if (strcmp(argv[a+1], "relative") == 0) {
+					a++;
+					norm = NORM_RELATIVE;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -norm. max, l2 or relative required. Using max as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-check") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "adaptive") == 0) {
+					a++;
+					checkEvery = 0;
+				} else if (atoi(argv[a+1]) > 0) {
+					a++;
+					checkEvery = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -check. Positive integer or adaptive required. Using %d check as default.\n", checkEvery);
+				}
+			}
+		} else if (strcmp(argv[a], "-profile") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0 && atoi(argv[a+1]) <= 2) {
+					a++;
+					profile = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -profile. 0, 1 or 2 required. Using %d profile as default.\n", profile);
+				}
+			}
+		} else if (strcmp(argv[a], "-trace") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				traceFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-affinity") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				int cpus[RELAX_MAX_CPUS];
+				if (strcmp(argv[a+1], "compact") == 0) {
+					a++;
+					affinity = AFFINITY_COMPACT;
+				} else if (strcmp(argv[a+1], "scatter") == 0) {
+					a++;
+					affinity = AFFINITY_SCATTER;
+				} else if (strcmp(argv[a+1], "none") == 0) {
+					a++;
+					affinity = AFFINITY_NONE;
+				} else if (relaxParseCpuList(argv[a+1], cpus) > 0) {
+					a++;
+					affinity = AFFINITY_LIST;
+					cpuList = argv[a];
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -affinity. compact, scatter, none or a CPU list like 0,2,4-7 required. Using compact as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-hugepages") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) == 0 || atoi(argv[a+1]) == 1) {
+					a++;
+					hugePages = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -hugepages. 0 or 1 required. Using %d hugepages as default.\n", hugePages);
+				}
+			}
+		} else if (strcmp(argv[a], "-arithmetic") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "double") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_DOUBLE;
+				} else if (strcmp(argv[a+1], "float") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_FLOAT;
+				} else if (strcmp(argv[a+1], "mixed") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_MIXED;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -arithmetic. double, float or mixed required. Using double as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-checkpoint") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				checkpointFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-checkpointevery") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					checkpointEvery = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -checkpointevery. Positive integer required. Using %d relaxations as default.\n", checkpointEvery);
+				}
+			}
+		} else if (strcmp(argv[a], "-resume") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				resumeFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-stream") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				streamFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-band") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 2) {
+					a++;
+					bandRows = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -band. Integer of at least 2 required. Using about 8MB of rows as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-o") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outputFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-oformat") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "binary") == 0) {
+					a++;
+					outputText = 0;
+				} else if (strcmp(argv[a+1], "text") == 0) {
+					a++;
+					outputText = 1;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -oformat. binary or text required. Using binary as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-image") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				imageFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-isa") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (stencilUse(argv[a+1])) {
+					a++;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -isa. scalar, avx2 or avx512 supported by this CPU required. Using %s as default.\n", stencilName());
+				}
+			}
 		} else if (strcmp(argv[a], "-f") == 0 || strcmp(argv[a], "-filepath") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
 				a++;
-				strncpy(textFile, argv[a], sizeof(textFile));
+				textFile = argv[a];
 			}
 		} else {
 			/* Non optional arguments here, but we have none of those */
 		}
 	}
 
-	FILE *valueFile;
+	if (rows == 0) rows = dimension;
+	if (cols == 0) cols = dimension;
 
-	if (!generateNumbers) {
-		valueFile = fopen(textFile, "r");
-		if (valueFile == NULL) {
-			fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", textFile);
+	if (planes > 1) {
+		if (method != METHOD_JACOBI || arithmetic != ARITHMETIC_DOUBLE || sweeps > 1 || maskFile != NULL
+			|| checkpointFile != NULL || resumeFile != NULL || streamFile != NULL) {
+			fprintf(stderr, "LOG WARNING - -planes relaxes with jacobi in double. Ignoring -method, -arithmetic, -temporal, -mask, -checkpoint, -resume and -stream.\n");
+		}
+		method = METHOD_JACOBI;
+		arithmetic = ARITHMETIC_DOUBLE;
+		sweeps = 1;
+		maskFile = NULL;
+		checkpointFile = NULL;
+		resumeFile = NULL;
+		streamFile = NULL;
+	}
+
+	/* A resumed solve carries on exactly as it was started, whatever is asked for now */
+	struct CheckpointState resumeState;
+	if (resumeFile != NULL) {
+		if (!checkpointReadState(resumeFile, &resumeState)) {
+			fprintf(stdout, "LOG ERROR - Failed to resume from checkpoint: %s. Exiting program", resumeFile);
 			return 1;
 		}
+		if (resumeState.masked && maskFile == NULL) {
+			fprintf(stdout, "LOG ERROR - %s was solved with a mask, give it again with -mask. Exiting program", resumeFile);
+			return 1;
+		}
+		if (!resumeState.masked && maskFile != NULL) {
+			fprintf(stderr, "LOG WARNING - %s was solved without a mask. Ignoring -mask.\n", resumeFile);
+			maskFile = NULL;
+		}
+		rows = resumeState.rows;
+		cols = resumeState.cols;
+		method = resumeState.method;
+		arithmetic = resumeState.arithmetic;
+		norm = resumeState.norm;
+		checkEvery = resumeState.checkEvery;
+		sweeps = resumeState.sweeps;
+		cycleShape = resumeState.cycleShape;
+		precision = resumeState.precision;
+		omega = resumeState.omega;
+		generateNumbers = 0;
+		if (checkpointFile == NULL)
+			checkpointFile = resumeFile;
 	}
 
-	/* Set up two arrays, one to store current results & one to store changes */
-	double *values = malloc(dimension * dimension * sizeof(double));
-	double *newValues = malloc(dimension * dimension * sizeof(double));
-	
-	srand((unsigned)time(NULL));
+	int binaryFile = 0;
 
-	/* Put numbers into the value arrays */
-	int i, j;
-	for (i = 0; i < dimension; i++) {
-		for (j = 0; j < dimension; j++) {
-			// If we're going to generate the numbers, or use predetermined ones
-			if (generateNumbers)
-				values[i*dimension+j] = fRand(1, 2);
-			else
-				fscanf(valueFile, "%lf", &values[i*dimension+j] );
-			// And copy them to the new array as well
-			newValues[i*dimension+j] = values[i*dimension+j];
+	if (!generateNumbers && resumeFile == NULL) {
+		binaryFile = gridIsBinary(textFile);
+		if (!binaryFile && access(textFile, R_OK) != 0) {
+			fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", textFile);
+			return 1;
 		}
 	}
+
 	if (cores < 1) cores = 1;
 	if (precision < 0.0000000001) precision = 0.0000000001;
+	if (traceFile != NULL && profile == 0) profile = 1;
 
-	if (debug >= 1) {
-		fprintf(stdout, "LOG FINE - Using %d cores.\n", cores);
-		fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", dimension);
-		fprintf(stdout, "LOG FINE - Working to precision of %.10lf.\n", precision);
-	}
+	/* Out of core the grid never comes into memory whole, so there's no pool or array */
+	if (streamFile != NULL) {
+		if (!binaryFile) {
+			fprintf(stdout, "LOG ERROR - -stream needs -g 0 and -f a binary grid file, made with numbergen -b 1. Exiting program");
+			return 1;
+		}
+		if (method != METHOD_JACOBI || norm != NORM_MAX || arithmetic != ARITHMETIC_DOUBLE || resumeFile != NULL
+			|| checkpointFile != NULL || maskFile != NULL || profile || outputFile != NULL || imageFile != NULL) {
+			fprintf(stderr, "LOG WARNING - -stream relaxes with jacobi in double, checking the max norm after each pass. Ignoring other options.\n");
+		}
 
-	if (debug >= 2) {
-	/* Display initial array for debugging */
-		fprintf(stdout, "LOG FINEST - Working with array:\n");
-		for (i = 0; i < dimension; i++) {
-			for (j = 0; j < dimension; j++) {
-				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
-					fprintf(stdout, ANSI_COLOR_RED);
-				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
-			}
-			fprintf(stdout, "\n");
+		struct StreamOptions streamOptions;
+		streamOptionsInit(&streamOptions);
+		streamOptions.precision = precision;
+		streamOptions.sweeps = sweeps;
+		streamOptions.bandRows = bandRows;
+		streamOptions.threads = cores;
+
+		if (debug >= 1) {
+			fprintf(stdout, "LOG FINE - Using %d cores.\n", cores);
+			if (rows == cols)
+				fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", rows);
+			else
+				fprintf(stdout, "LOG FINE - Using array of %d rows and %d columns.\n", rows, cols);
+			fprintf(stdout, "LOG FINE - Working to precision of %.10lf.\n", precision);
+			fprintf(stdout, "LOG FINE - Using %s stencil.\n", stencilName());
+			fprintf(stdout, "LOG FINE - Streaming Jacobi relaxation from %s into %s, %d relaxations each pass.\n",
+					textFile, streamFile, streamOptions.sweeps);
 		}
+
+		struct StreamResult streamResult;
+		if (!streamSolve(textFile, streamFile, rows, cols, &streamOptions, &streamResult)) {
+			fprintf(stdout, "LOG ERROR - Failed to stream %s through to %s. Exiting program", textFile, streamFile);
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (debug >= 1) {
+			fprintf(stdout, "LOG FINE - Streamed in bands of %d rows, holding %.1lf MB in memory.\n",
+					streamResult.bandRows, streamResult.memory / (1 << 20));
+			fprintf(stdout, "\nLOG FINE - Program complete. Relaxation count: %d.\n", streamResult.count);
+			fprintf(stdout, "LOG FINE - Largest change on final relaxation: %.10lf.\n", streamResult.maxDelta);
+			fprintf(stdout, "LOG FINE - %d passes read %.1lf MB and wrote %.1lf MB.\n", streamResult.passes,
+					streamResult.bytesRead / (1 << 20), streamResult.bytesWritten / (1 << 20));
+			diff = BILLION * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec;
+			printf("LOG FINE - Completed in %llu Nanoseconds\n", (long long unsigned int) diff);
+		}
+		return 0;
 	}
 
-	// init precision lock
-	if (pthread_mutex_init(&precisionLock, NULL) != 0) {
-        printf("\n mutex init failed\n");
-        return 1;
-    }
+	if (method == METHOD_MULTIGRID && (rows != cols || maskFile != NULL)) {
+		fprintf(stderr, "LOG WARNING - multigrid needs a square array without -mask. Using sor.\n");
+		method = METHOD_SOR;
+	}
+	if (active && (method != METHOD_JACOBI || arithmetic != ARITHMETIC_DOUBLE || sweeps > 1 || planes > 1
+				   || checkpointFile != NULL || resumeFile != NULL)) {
+		fprintf(stderr, "LOG WARNING - -active needs jacobi in double without -temporal, -planes, -checkpoint or -resume. Relaxing every tile.\n");
+		active = 0;
+	}
+	if (sync == SYNC_NEIGHBOURS && (method != METHOD_JACOBI || arithmetic != ARITHMETIC_DOUBLE || sweeps > 1
+									|| planes > 1 || active || norm != NORM_MAX || checkpointFile != NULL || resumeFile != NULL)) {
+		fprintf(stderr, "LOG WARNING - -sync neighbours needs jacobi in double on the max norm without -active, -temporal, -planes, -checkpoint or -resume. Using global.\n");
+		sync = SYNC_GLOBAL;
+	}
+	if (method == METHOD_GAUSS_SEIDEL) omega = 1;
+	if (method == METHOD_SOR && omega == 0) omega = optimalOmega(rows, cols);
 
-	/* Make threads & distribute workload */
+	/* Start the pool of threads first, so the array can be placed next to them */
 
-    pthread_barrier_init(&barrier, NULL, cores);
+	if (sweeps > 1 && method != METHOD_JACOBI) {
+		fprintf(stderr, "LOG WARNING - -temporal only works with jacobi. Checking precision every relaxation.\n");
+		sweeps = 1;
+	}
+	if (arithmetic != ARITHMETIC_DOUBLE && (method == METHOD_MULTIGRID || sweeps > 1)) {
+		fprintf(stderr, "LOG WARNING - -arithmetic only works with jacobi, gs and sor without -temporal. Using double.\n");
+		arithmetic = ARITHMETIC_DOUBLE;
+	}
+	if (arithmetic == ARITHMETIC_FLOAT && precision < convergenceFloatFloor(norm, rows, cols)) {
+		precision = convergenceFloatFloor(norm, rows, cols);
+		fprintf(stderr, "LOG WARNING - float can't be trusted below a %s norm of %.10lg. Using that as precision, -arithmetic mixed goes further.\n",
+				normName(norm), precision);
+	}
 
-	pthread_t thread[cores];
-	struct RelaxData data[cores];
+	struct RelaxPool *pool = relaxPoolCreateAffinity(cores, affinity, cpuList);
+	if (pool == NULL) {
+		fprintf(stdout, "LOG ERROR - Failed to start %d threads. Exiting program", cores);
+		return 1;
+	}
 
-	int chunks = (dimension-2)*(dimension-2);
-	int chunksPerCore = chunks/cores;
-	int remain = chunks % cores;
-	
-	if (debug >= 2) {
-		fprintf(stdout, "\nLOG FINEST - Calculations required: %d\n", chunks);
-		fprintf(stdout, "LOG FINEST - Chunking to size: %d\n", chunksPerCore);
+	struct RelaxOptions options;
+	relaxOptionsInit(&options);
+	options.method = method;
+	options.precision = precision;
+	options.threads = cores;
+	options.partition = partition;
+	options.sweeps = sweeps;
+	options.omega = omega;
+	options.cycleShape = cycleShape;
+	options.hugePages = hugePages;
+	options.active = active;
+	options.sync = sync;
+	options.norm = norm;
+	options.checkEvery = checkEvery;
+	options.arithmetic = arithmetic;
+	if (resumeFile != NULL)
+		options.resume = &resumeState;
+
+	struct Checkpoint *checkpoint = NULL;
+	if (checkpointFile != NULL) {
+		checkpoint = checkpointCreate(checkpointFile, rows, cols, checkpointEvery);
+		if (checkpoint == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to set up checkpoints to %s. Exiting program", checkpointFile);
+			return 1;
+		}
+		options.checkpoint = checkpoint;
+	}
+
+	/* Set up the array, each part first touched by the thread that will relax it.
+	 * The solver makes its own second array for Jacobi. Binary files are mapped straight in */
+	struct GridMapping mapping = { NULL, 0 };
+	double *values;
+	if (resumeFile != NULL) {
+		values = relaxAllocateVolume(pool, planes, rows, cols, &options);
+		if (values == NULL || !checkpointReadValues(resumeFile, values, rows, cols)) {
+			fprintf(stdout, "LOG ERROR - Failed to read checkpoint: %s. Exiting program", resumeFile);
+			return 1;
+		}
+	} else if (binaryFile) {
+		values = gridMap(textFile, (size_t)planes * rows * cols, &mapping);
+		if (values == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to read grid file: %s. Exiting program", textFile);
+			return 1;
+		}
+	} else if (generateNumbers) {
+		// Each thread makes its own part of the array as it first touches it
+		if (seed == 0)
+			seed = rngClockSeed();
+		values = relaxAllocateRandomVolume(pool, planes, rows, cols, &options, seed, 1, 2);
+		if (values == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to allocate array of %d x %d. Exiting program", rows, cols);
+			return 1;
+		}
+	} else {
+		values = relaxAllocateVolume(pool, planes, rows, cols, &options);
+		if (values == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to allocate array of %d x %d. Exiting program", rows, cols);
+			return 1;
+		}
 	}
 
+	// The outer ring is always fixed, so the mask only matters inside it
+	unsigned char *mask = NULL;
+	if (maskFile != NULL) {
+		mask = malloc((size_t)rows * cols);
+		if (mask == NULL || !gridLoadMask(maskFile, mask, (size_t)rows * cols, cores)) {
+			fprintf(stdout, "LOG ERROR - Failed to read mask file: %s. Exiting program", maskFile);
+			return 1;
+		}
+		options.mask = mask;
+	}
 	
+	/* Put numbers into the value arrays */
+	int i, j;
+	if (!generateNumbers && !binaryFile && resumeFile == NULL) {
+		// Text is parsed by the pool's threads straight into the array they placed
+		if (!relaxLoadText(pool, textFile, values, planes, rows, cols, &options)) {
+			fprintf(stdout, "LOG ERROR - Failed to read file: %s. Exiting program", textFile);
+			return 1;
+		}
+	}
 
-	/* End thread making */
+	clock_gettime(CLOCK_MONOTONIC, &loaded);
 
-	int curIndex = 0;
-	int chunkToGive;
+	/* Hand the array to the pool */
 
-	int withinPrecision = 0;
+	if (debug >= 1) {
+		fprintf(stdout, "LOG FINE - Using %d cores.\n", cores);
+		if (rows == cols)
+			fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", rows);
+		else
+			fprintf(stdout, "LOG FINE - Using array of %d rows and %d columns.\n", rows, cols);
+		if (planes > 1)
+			fprintf(stdout, "LOG FINE - Using %d planes of the array, relaxed with the 7 point stencil.\n", planes);
+		if (mask != NULL)
+			fprintf(stdout, "LOG FINE - Holding the cells set in %s fixed.\n", maskFile);
+		if (generateNumbers)
+			fprintf(stdout, "LOG FINE - Generated values from seed %llu.\n", seed);
+		fprintf(stdout, "LOG FINE - Working to precision of %.10lf.\n", precision);
+		fprintf(stdout, "LOG FINE - Using %s stencil in %s arithmetic.\n", stencilName(), arithmeticName(arithmetic));
+		if (method == METHOD_JACOBI)
+			fprintf(stdout, "LOG FINE - Using Jacobi relaxation.\n");
+		else if (method == METHOD_GAUSS_SEIDEL)
+			fprintf(stdout, "LOG FINE - Using red-black Gauss-Seidel relaxation.\n");
+		else if (method == METHOD_MULTIGRID)
+			fprintf(stdout, "LOG FINE - Using multigrid %c cycles.\n", cycleShape == 1 ? 'V' : 'W');
+		else
+			fprintf(stdout, "LOG FINE - Using red-black SOR relaxation with omega %.6lf.\n", omega);
+		if (checkEvery == 0)
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked adaptively.\n", normName(norm));
+		else
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked every %d relaxations.\n", normName(norm), checkEvery);
+		if (resumeFile != NULL)
+			fprintf(stdout, "LOG FINE - Resuming from %s after %d relaxations.\n", resumeFile, resumeState.count);
+		if (checkpoint != NULL)
+			fprintf(stdout, "LOG FINE - Checkpointing to %s every %d relaxations.\n", checkpointFile, checkpointEvery);
+	}
 
-	for (i = 0; i < cores; i++) {
-		chunkToGive = chunksPerCore;
-		if (remain > 0) { 
-			chunkToGive++;
-			remain--;
+	if (debug >= 2) {
+	/* Display initial array for debugging */
+		fprintf(stdout, "LOG FINEST - Working with array:\n");
+		for (i = 0; i < planes * rows; i++) {
+			if (i > 0 && i % rows == 0)
+				fprintf(stdout, "\n");
+			for (j = 0; j < cols; j++) {
+				if (isFixed(i, j, planes, rows, cols, mask))
+					fprintf(stdout, ANSI_COLOR_RED);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*cols+j]);
+			}
+			fprintf(stdout, "\n");
 		}
-
-		/* curIndex only refers to the actionable array */
-		/* Perform arithmetic to convert position in actionable array to position in full array */
-		data[i].chunkStart = curIndex + ((curIndex / (dimension-2)) * 2) + (dimension+1);
-		data[i].chunkEnd = curIndex + (chunkToGive - 1) + 
-							(((curIndex + (chunkToGive - 1)) / (dimension-2)) * 2) + (dimension+1);
-		
-		curIndex = curIndex + chunkToGive;
-
-		data[i].values = values;
-		data[i].newValues = newValues;
-		data[i].withinPrecision = &withinPrecision;
-		data[i].dimension = dimension;
-		data[i].precision = precision;
-
-		pthread_create(&thread[i], NULL, relaxArray, &data[i]);
 	}
 
+	struct Profile threadProfile;
+	if (profile) {
+		profileInit(&threadProfile, traceFile != NULL ? PROFILE_DEFAULT_EVENTS : 0, profile >= 2);
+		options.profile = &threadProfile;
+	}
 
-	// Wait for all threads to finish
-	for (i = 0; i < cores; i++)
-		pthread_join(thread[i], NULL);
+	struct RelaxResult result;
+	if (!relaxSolveVolume(pool, values, planes, rows, cols, &options, &result)) {
+		fprintf(stdout, "LOG ERROR - Failed to allocate memory for relaxation. Exiting program");
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &solved);
+	if (result.stalled)
+		fprintf(stderr, "LOG WARNING - float stopped improving after %d relaxations without reaching precision. -arithmetic mixed goes on in double.\n",
+				result.count);
+
+	// Waits for the last checkpoint to be written, so a kill after this loses nothing
+	int checkpoints = checkpoint != NULL ? checkpointDestroy(checkpoint) : 0;
+	if (checkpoints < 0)
+		fprintf(stderr, "LOG WARNING - Failed to write a checkpoint to %s.\n", checkpointFile);
+
+	if (outputFile != NULL) {
+		int written = outputText ? gridWriteText(outputFile, values, planes * rows, cols, cores)
+								 : gridWrite(outputFile, values, planes * rows, cols);
+		if (!written) {
+			fprintf(stdout, "LOG ERROR - Failed to write output to %s. Exiting program", outputFile);
+			return 1;
+		}
+	}
 
+	double low = 0, high = 0;
+	if (imageFile != NULL
+		&& !gridWriteImage(imageFile, values + (size_t) (planes / 2) * rows * cols, rows, cols, GRID_IMAGE_SIDE, &low, &high)) {
+		fprintf(stdout, "LOG ERROR - Failed to write image to %s. Exiting program", imageFile);
+		return 1;
+	}
 
-	// Swap pointers, so we have the final array in values
-	double *tempValues = values;
-	values = newValues;
-	newValues = tempValues;
+	if (debug >= 1) {
+		if (result.tileRows > 0)
+			fprintf(stdout, "LOG FINE - Partitioned into %d tiles of %dx%d.\n", result.blocks, result.tileRows, result.tileCols);
+		else
+			fprintf(stdout, "LOG FINE - Partitioned into rows.\n");
+		if (result.sweeps > 1)
+			fprintf(stdout, "LOG FINE - Relaxed each tile %d times between precision checks.\n", result.sweeps);
+		if (result.sync == SYNC_NEIGHBOURS)
+			fprintf(stdout, "LOG FINE - Threads only waited for their neighbours, checking convergence behind them.\n");
+		if (result.active)
+			fprintf(stdout, "LOG FINE - Skipped %ld of %ld tile relaxations as settled.\n",
+					result.tilesSkipped, result.tilesRelaxed + result.tilesSkipped);
+		if (result.levelCount > 0)
+			fprintf(stdout, "LOG FINE - Used %d multigrid levels down to dimension %d.\n",
+					result.levelCount, result.coarsestDimension);
+		if (method == METHOD_MULTIGRID)
+			fprintf(stdout, "\nLOG FINE - Program complete. Multigrid cycles: %d.\n", result.count);
+		else
+			fprintf(stdout, "\nLOG FINE - Program complete. Relaxation count: %d.\n", result.count);
+		fprintf(stdout, "LOG FINE - Largest change on final relaxation: %.10lf.\n", result.maxDelta);
+		if (arithmetic == ARITHMETIC_MIXED)
+			fprintf(stdout, "LOG FINE - %d relaxations in float, then %d in double.\n",
+					result.floatCount, result.count - result.floatCount);
+		if (norm != NORM_MAX || checkEvery != 1)
+			fprintf(stdout, "LOG FINE - Final %s norm %.10lg after %d convergence checks.\n",
+					normName(norm), result.residual, result.checks);
+		if (checkpoints > 0)
+			fprintf(stdout, "LOG FINE - Wrote %d checkpoints to %s.\n", checkpoints, checkpointFile);
+		if (outputFile != NULL)
+			fprintf(stdout, "LOG FINE - Wrote relaxed array as %s to %s.\n", outputText ? "text" : "a binary grid", outputFile);
+		if (imageFile != NULL)
+			fprintf(stdout, "LOG FINE - Drew %s of values from %.10lf to %.10lf.\n", imageFile, low, high);
+	}
 
 	if (debug >= 2) {
 		fprintf(stdout, "LOG FINEST - Final array:\n");
-		for (i = 0; i < dimension; i++) {
-			for (j = 0; j < dimension; j++) {
-				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
+		for (i = 0; i < planes * rows; i++) {
+			if (i > 0 && i % rows == 0)
+				fprintf(stdout, "\n");
+			for (j = 0; j < cols; j++) {
+				if (isFixed(i, j, planes, rows, cols, mask))
 					fprintf(stdout, ANSI_COLOR_RED);
-				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*cols+j]);
 			}
 			fprintf(stdout, "\n");
 		}
 	}
 
-	free(values);
-	free(newValues);
+	if (profile) {
+		fprintf(stdout, "LOG FINE - Time spent by each thread:\n");
+		profilePrint(stdout, &threadProfile);
+		if (traceFile != NULL) {
+			if (profileWriteTrace(traceFile, &threadProfile))
+				fprintf(stdout, "LOG FINE - Trace written to %s.\n", traceFile);
+			else
+				fprintf(stderr, "LOG WARNING - Failed to write trace file: %s.\n", traceFile);
+		}
+		profileFree(&threadProfile);
+	}
+
+	if (mapping.base != NULL)
+		gridUnmap(&mapping);
+	else
+		relaxFree(values);
+	free(mask);
+	relaxPoolDestroy(pool);
 
 
 	clock_gettime(CLOCK_MONOTONIC, &end);	/* mark the end time */
 
 	diff = BILLION * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec;
+	if (profile) {
+		fprintf(stdout, "LOG FINE - Loading %llu, solving %llu, reporting and freeing %llu Nanoseconds\n",
+				(long long unsigned int) (BILLION * (loaded.tv_sec - start.tv_sec) + loaded.tv_nsec - start.tv_nsec),
+				(long long unsigned int) (BILLION * (solved.tv_sec - loaded.tv_sec) + solved.tv_nsec - loaded.tv_nsec),
+				(long long unsigned int) (BILLION * (end.tv_sec - solved.tv_sec) + end.tv_nsec - solved.tv_nsec));
+	}
 	if (debug >= 1) printf("LOG FINE - Completed in %llu Nanoseconds\n",  (long long unsigned int) diff);
 	
 }
 
-double fRand(double fMin, double fMax) {
-    double f = (double)rand() / RAND_MAX;
-    return fMin + f * (fMax - fMin);
+/* 1 if the cell in row i (counting through every plane) and column j never changes */
+int isFixed(int i, int j, int planes, int rows, int cols, const unsigned char *mask) {
+	int row = i % rows;
+	if (row == 0 || row == rows - 1 || j == 0 || j == cols - 1)
+		return 1;
+	if (planes > 1 && (i < rows || i >= (planes - 1) * rows))
+		return 1;
+	return mask != NULL && mask[i*cols+j];
 }
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#define PROFILE_PERF
+#endif
+
+#include "profile.h"
+
+#define BILLION 1000000000L
+
+static const char *phaseNames[PHASE_COUNT] = { "compute", "sync", "wait", "setup", "copy" };
+
+uint64_t profileNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return BILLION * now.tv_sec + now.tv_nsec;
+}
+
+void profileInit(struct Profile *profile, int eventMax, int counters) {
+	memset(profile, 0, sizeof(struct Profile));
+	profile->eventMax = eventMax;
+	profile->counters = counters;
+}
+
+int profileAllocate(struct Profile *profile, int threads) {
+	int i, c;
+
+	profile->threads = threads;
+	profile->thread = calloc(threads, sizeof(struct ThreadProfile));
+	if (profile->thread == NULL)
+		return 0;
+
+	for (i = 0; i < threads; i++) {
+		struct ThreadProfile *thread = &profile->thread[i];
+		for (c = 0; c < COUNTER_COUNT; c++)
+			thread->perfFds[c] = -1;
+
+		// Allocated up front so recording never allocates in the middle of a sweep
+		if (profile->eventMax > 0) {
+			thread->events = malloc(profile->eventMax * sizeof(struct TraceEvent));
+			if (thread->events == NULL)
+				return 0;
+			thread->eventMax = profile->eventMax;
+		}
+	}
+
+	return 1;
+}
+
+void profileFree(struct Profile *profile) {
+	int i;
+
+	if (profile->thread != NULL) {
+		for (i = 0; i < profile->threads; i++)
+			free(profile->thread[i].events);
+		free(profile->thread);
+	}
+	profile->thread = NULL;
+	profile->threads = 0;
+}
+
+#ifdef PROFILE_PERF
+static int openCounter(unsigned long long config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	// pid 0 and cpu -1 count this thread wherever it runs
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void profileThreadStart(struct Profile *profile, int id) {
+	struct ThreadProfile *thread = &profile->thread[id];
+	int c;
+
+#ifdef PROFILE_PERF
+	if (profile->counters) {
+		static const unsigned long long configs[COUNTER_COUNT] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+		};
+
+		thread->countersValid = 1;
+		for (c = 0; c < COUNTER_COUNT; c++) {
+			thread->perfFds[c] = openCounter(configs[c]);
+			if (thread->perfFds[c] < 0)
+				thread->countersValid = 0;
+		}
+		for (c = 0; c < COUNTER_COUNT; c++) {
+			if (thread->perfFds[c] >= 0) {
+				ioctl(thread->perfFds[c], PERF_EVENT_IOC_RESET, 0);
+				ioctl(thread->perfFds[c], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+#else
+	(void) c;
+#endif
+
+	thread->start = profileNow() - profile->origin;
+}
+
+void profileThreadStop(struct Profile *profile, int id) {
+	struct ThreadProfile *thread = &profile->thread[id];
+	int c;
+
+	thread->end = profileNow() - profile->origin;
+
+	for (c = 0; c < COUNTER_COUNT; c++) {
+		if (thread->perfFds[c] < 0)
+			continue;
+#ifdef PROFILE_PERF
+		ioctl(thread->perfFds[c], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+		if (read(thread->perfFds[c], &thread->counters[c], sizeof(long long)) != sizeof(long long))
+			thread->countersValid = 0;
+		close(thread->perfFds[c]);
+		thread->perfFds[c] = -1;
+	}
+}
+
+void profileRecord(struct Profile *profile, int id, enum Phase phase, uint64_t start, uint64_t end) {
+	struct ThreadProfile *thread = &profile->thread[id];
+
+	thread->time[phase] += end - start;
+
+	if (thread->eventCount < thread->eventMax) {
+		struct TraceEvent *event = &thread->events[thread->eventCount++];
+		event->start = start - profile->origin;
+		event->duration = end - start;
+		event->phase = phase;
+	} else if (thread->eventMax > 0) {
+		thread->eventsDropped++;
+	}
+}
+
+void profilePrint(FILE *out, struct Profile *profile) {
+	uint64_t slowest = 0, fastest = UINT64_MAX;
+	double computeTotal = 0;
+	uint64_t computeMax = 0;
+	int i;
+
+	fprintf(out, "Thread      Cells  Iterations   Compute ms   Wait ms   Reduce ms   Total ms");
+	if (profile->counters)
+		fprintf(out, "         Cycles   Instructions   IPC   Cache misses");
+	fprintf(out, "\n");
+
+	for (i = 0; i < profile->threads; i++) {
+		struct ThreadProfile *thread = &profile->thread[i];
+		uint64_t total = thread->end - thread->start;
+
+		fprintf(out, "%6d %10ld %11d %12.3f %9.3f %11.3f %10.3f", i, thread->cells, thread->iterations,
+				thread->time[PHASE_COMPUTE] / 1e6, thread->time[PHASE_WAIT] / 1e6,
+				(thread->time[PHASE_SYNC] - thread->time[PHASE_WAIT]) / 1e6, total / 1e6);
+
+		if (profile->counters && thread->countersValid) {
+			fprintf(out, " %14lld %14lld %5.2f %14lld", thread->counters[COUNTER_CYCLES],
+					thread->counters[COUNTER_INSTRUCTIONS],
+					thread->counters[COUNTER_CYCLES] > 0 ? (double) thread->counters[COUNTER_INSTRUCTIONS]
+														   / thread->counters[COUNTER_CYCLES] : 0,
+					thread->counters[COUNTER_CACHE_MISSES]);
+		} else if (profile->counters) {
+			fprintf(out, "   counters unavailable");
+		}
+		fprintf(out, "\n");
+
+		if (total > slowest)
+			slowest = total;
+		if (total < fastest)
+			fastest = total;
+		computeTotal += thread->time[PHASE_COMPUTE];
+		if (thread->time[PHASE_COMPUTE] > computeMax)
+			computeMax = thread->time[PHASE_COMPUTE];
+	}
+
+	fprintf(out, "Setup %.3f ms, copy back %.3f ms.\n", profile->setup.duration / 1e6, profile->copyBack.duration / 1e6);
+	int dropped = 0;
+	for (i = 0; i < profile->threads; i++)
+		dropped += profile->thread[i].eventsDropped;
+	if (dropped > 0)
+		fprintf(out, "%d spans past the first %d per thread are in the totals but not the trace.\n",
+				dropped, profile->eventMax);
+	if (profile->threads > 0 && computeTotal > 0) {
+		// 1.0 is perfectly balanced, 2.0 means the busiest thread did twice the average work
+		fprintf(out, "Compute imbalance (max / mean) %.3f, slowest thread %.3f ms, fastest %.3f ms.\n",
+				computeMax / (computeTotal / profile->threads), slowest / 1e6, fastest / 1e6);
+	}
+}
+
+static void writeEvent(FILE *file, int *first, const char *name, int tid, const struct TraceEvent *event) {
+	// Chrome traces are in microseconds
+	fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			*first ? "" : ",", name, tid, event->start / 1e3, event->duration / 1e3);
+	*first = 0;
+}
+
+int profileWriteTrace(const char *path, struct Profile *profile) {
+	FILE *file = fopen(path, "w");
+	int first = 1;
+	int i, e;
+
+	if (file == NULL)
+		return 0;
+
+	fprintf(file, "{\"traceEvents\":[");
+
+	// The caller's setup and copy back go on a row of their own after the threads
+	fprintf(file, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"caller\"}}",
+			profile->threads);
+	first = 0;
+	writeEvent(file, &first, phaseNames[PHASE_SETUP], profile->threads, &profile->setup);
+	if (profile->copyBack.duration > 0)
+		writeEvent(file, &first, phaseNames[PHASE_COPY], profile->threads, &profile->copyBack);
+
+	for (i = 0; i < profile->threads; i++) {
+		struct ThreadProfile *thread = &profile->thread[i];
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+				i, i);
+		for (e = 0; e < thread->eventCount; e++)
+			writeEvent(file, &first, phaseNames[thread->events[e].phase], i, &thread->events[e]);
+	}
+
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
@@ -0,0 +1,83 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Where each solver thread spends its time. Every thread records how long it spends
+ * relaxing and how long it spends in the synchronisation between relaxations, split into
+ * the time it sat waiting for other threads and the time it spent combining their
+ * results. Spans are also kept as a timeline (up to a limit per thread) so they can be
+ * written out as a Chrome trace and viewed in chrome://tracing or Perfetto.
+ *
+ * Hardware counters are read through perf_event_open where the kernel allows it.
+ */
+
+enum Phase {
+	PHASE_COMPUTE, // Relaxing cells
+	PHASE_SYNC, // Inside the reduction, including waiting
+	PHASE_WAIT, // Spinning for other threads, inside PHASE_SYNC
+	PHASE_SETUP, // Partitioning and allocating before the threads start, by the caller
+	PHASE_COPY, // Copying the result back into the caller's array, by the caller
+	PHASE_COUNT
+};
+
+enum Counter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_CACHE_MISSES, COUNTER_COUNT };
+
+#define PROFILE_DEFAULT_EVENTS 100000 /* Spans kept per thread for the trace */
+
+struct TraceEvent {
+	uint64_t start; // Nanoseconds since the profile's origin
+	uint64_t duration;
+	enum Phase phase;
+};
+
+struct ThreadProfile {
+	uint64_t time[PHASE_COUNT]; // Nanoseconds spent in each phase
+	uint64_t start, end; // When the thread started and finished its share
+	int iterations; // Relaxations, or multigrid cycles
+	long cells; // Interior cells in this thread's blocks
+	long long counters[COUNTER_COUNT];
+	int countersValid; // 0 if the kernel wouldn't give us counters
+	int perfFds[COUNTER_COUNT];
+	struct TraceEvent *events;
+	int eventCount, eventMax;
+	int eventsDropped;
+};
+
+struct Profile {
+	int threads;
+	struct ThreadProfile *thread;
+	uint64_t origin; // profileNow() when the solve was submitted
+	struct TraceEvent setup; // Setting up the solve before the threads start
+	struct TraceEvent copyBack; // Copying the result into the caller's array, 0 long if not needed
+	int eventMax; // Trace spans to keep per thread, 0 for totals only
+	int counters; // 1 to try for hardware counters
+};
+
+/* Nanoseconds on the monotonic clock */
+uint64_t profileNow(void);
+
+/* Ready to be passed in RelaxOptions. The threads are filled in by the solver */
+void profileInit(struct Profile *profile, int eventMax, int counters);
+
+/* Makes room for threads threads. Returns 0 if memory ran out */
+int profileAllocate(struct Profile *profile, int threads);
+
+void profileFree(struct Profile *profile);
+
+/* Called by a thread on itself before and after its share of the solve. Opens and reads
+ * the counters, which only count the calling thread */
+void profileThreadStart(struct Profile *profile, int id);
+void profileThreadStop(struct Profile *profile, int id);
+
+/* Adds a span from start to end to a thread's totals and timeline */
+void profileRecord(struct Profile *profile, int id, enum Phase phase, uint64_t start, uint64_t end);
+
+/* One line per thread, then the spread between the fastest and slowest */
+void profilePrint(FILE *out, struct Profile *profile);
+
+/* Writes the timeline as Chrome trace JSON. Returns 0 if the file couldn't be written */
+int profileWriteTrace(const char *path, struct Profile *profile);
+
+#endif
@@ -0,0 +1,2522 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "multigrid.h"
+#include "convergence.h"
+#include "checkpoint.h"
+#include "relax.h"
+#include "profile.h"
+#include "rng.h"
+
+#define CACHE_LINE 64
+#define SPIN_LIMIT 100 /* Spins before a waiting thread gives up its core */
+#define DEFAULT_L2_CACHE (256 * 1024) /* Used if the system can't tell us */
+#define TILE_MAX_COLS 1024
+#define SOLO_CELLS (256 * 256) /* Grids smaller than this get one thread to themselves */
+#define HUGE_PAGE (2 * 1024 * 1024)
+#define SPARE_ARRAYS 16 /* Second arrays a pool keeps from finished jobs for later ones */
+#define SPARE_LARGEST (16 << 20) /* Bytes of the largest array worth keeping */
+
+#define ACTIVE_MARGIN 16 /* A tile has settled once it and its neighbours change by less than precision over this */
+#define ACTIVE_REVISIT 8 /* Sweeps a settled tile goes without being relaxed before it's looked at again */
+#define ACTIVE_TILE_ROWS 32 /* Tiles small enough to tell settled regions from busy ones */
+#define ACTIVE_TILE_COLS 128
+
+#define NEIGHBOUR_SLACK 4 /* With neighbour sync, relaxations a thread can get ahead of a convergence check before it waits for it */
+
+#define FLOAT_STALL 1000 /* Relaxations float can go without lowering the norm before it's given up on */
+
+#define SMOOTH_SWEEPS 2 /* Gauss-Seidel sweeps before and after each multigrid correction */
+#define COARSEST_SWEEPS 20 /* Enough to solve the few cells of the coarsest multigrid level */
+
+/* Convergence is found with a tree reduction rather than a shared flag and a lock.
+ * Each thread has its own slot on its own cache line. On each sweep, thread t takes
+ * the max change of thread t+1, then t+2, t+4... while t is a multiple of twice the
+ * stride, then publishes its subtree's max in its slot and waits. Thread 0 ends up
+ * with the max over the whole array and publishes it for everyone to read.
+ *
+ * As every thread has to arrive before thread 0 publishes, this also acts as the
+ * barrier between sweeps.
+ */
+struct ReductionSlot {
+	_Alignas(CACHE_LINE) atomic_int arrived; // Last sweep this thread's subtree finished
+	double maxDelta; // Largest change seen in this thread's subtree on that sweep
+	double sumSquares; // Sum of squared residuals over this thread's subtree, when asked for
+};
+
+struct Reduction {
+	int threads;
+	struct ReductionSlot *slots;
+	_Alignas(CACHE_LINE) atomic_int released; // Last sweep with its result published
+	double maxDelta; // Largest change over the whole array on that sweep
+	double sumSquares;
+};
+
+/* A rectangle of interior cells, from rowStart/colStart up to but not including rowEnd/colEnd */
+struct Block {
+	int rowStart, rowEnd;
+	int colStart, colEnd;
+	int masked; // 1 if the mask fixes any cell relaxed for it, so it needs the masked kernels
+};
+
+/* One thread's run of tiles for the sweep. Its owner takes tiles from the front, and so
+ * does any thread that has run out of its own */
+struct TileQueue {
+	_Alignas(CACHE_LINE) atomic_int next;
+	int start, end;
+};
+
+/* Which tiles have settled, for Jacobi that skips them (see relaxArrayActive). A tile is
+ * handled by one thread a sweep, and the reduction between sweeps publishes what it did */
+struct ActiveTiles {
+	struct Block *tiles; // Every tile, row major
+	int tileCount;
+	int across; // Tiles in each row of tiles
+	double *delta[2]; // Largest change each tile made when last relaxed, as of even and odd sweeps
+	int *idle; // Sweeps since each tile was last relaxed
+	unsigned char *settled; // 1 where values and newValues hold the same numbers for the tile
+	struct TileQueue *queues; // One for each thread
+	atomic_long relaxed; // Tile relaxations done and skipped, added in as threads finish
+	atomic_long skipped;
+};
+
+/* With neighbour sync, how far a thread has got. Each thread has its own, on its own
+ * cache lines, and only its neighbours wait on it. delta keeps the thread's largest
+ * change on its last few relaxations, for the convergence checks that follow behind */
+struct Progress {
+	_Alignas(CACHE_LINE) atomic_int completed; // Relaxations finished
+	double delta[2 * NEIGHBOUR_SLACK]; // Largest change on relaxation n is in delta[n % (2 * NEIGHBOUR_SLACK)]
+};
+
+struct RelaxData {
+    int id;
+    struct Block *blocks;
+    int blockCount;
+    double *values;
+    double *newValues;
+    struct Reduction *reduction;
+    int *count;
+    double **result;
+    int rows, cols; // Of the whole array, cols being the distance from one row to the next
+    int planes; // 1 for a 2D array, otherwise how many rows x cols planes the 3D one has
+    const unsigned char *mask; // Nonzero for cells fixed besides the outer ring, NULL if there are none
+    double precision;
+    int sweeps; // Relaxations done on each block before synchronising, 1 for a plain sweep
+    double omega; // For red-black relaxation, 1 for Gauss-Seidel
+    struct Level *levels; // For multigrid, finest first
+    int levelCount;
+    int cycleShape; // Times each multigrid level visits the next coarser, 1 for V cycles, 2 for W
+    struct Profile *profile; // NULL unless profiling
+    enum Norm norm;
+    int checkEvery; // Relaxations between convergence checks, 0 to adapt
+    struct Convergence *convergence; // Where thread 0 leaves its convergence state at the end
+    double *maxDelta; // Where thread 0 leaves the largest change on the last relaxation
+    enum Arithmetic arithmetic;
+    float *floatValues; // Float copies of values and newValues, NULL in double arithmetic
+    float *floatNewValues;
+    int *floatCount; // Where thread 0 leaves how many relaxations were done in float
+    int *stalled; // Where thread 0 leaves whether float alone gave up above precision
+    int syncs; // Reductions an earlier phase of the solve has made, which the next carries on from
+    int done; // Relaxations an earlier phase has made
+    double initial; // For NORM_RELATIVE, the starting norm if an earlier phase found it, otherwise 0
+    struct Checkpoint *checkpoint; // NULL unless saving progress
+    const struct CheckpointState *settings; // What's being solved, for the checkpoints
+    const struct CheckpointState *resume; // Progress to carry on from, NULL to start afresh
+    int generate; // For relaxTouch, 1 to fill with random values from seed rather than zeroes
+    uint64_t seed;
+    double low, high; // Range of the random values
+    struct GridText *text; // For relaxTouch, a text file to parse a range of rather than touching blocks
+    struct ActiveTiles *active; // NULL unless settled tiles are skipped
+    struct Progress *progress; // Every thread's, with neighbour sync, otherwise NULL
+    const int *neighbours; // Threads whose blocks border this thread's
+    int neighbourCount;
+};
+
+void waitForSweep(atomic_int *counter, int sweep) {
+	int spins = 0;
+	while (atomic_load_explicit(counter, memory_order_acquire) < sweep) {
+		if (++spins == SPIN_LIMIT) {
+			spins = 0;
+			sched_yield();
+		}
+	}
+}
+
+/* Waits for a sweep, recording the wait if profiling */
+void waitForSweepProfiled(atomic_int *counter, int sweep, struct Profile *profile, int id) {
+	if (profile == NULL) {
+		waitForSweep(counter, sweep);
+		return;
+	}
+
+	uint64_t start = profileNow();
+	waitForSweep(counter, sweep);
+	profileRecord(profile, id, PHASE_WAIT, start, profileNow());
+}
+
+/* Returns the largest change anywhere in the array on this sweep. If sumSquares isn't
+ * NULL it's totalled over every thread as well, and replaced with the total */
+double reduceMaxDelta(struct Reduction *reduction, int id, int sweep, double maxDelta, double *sumSquares,
+					  struct Profile *profile) {
+	uint64_t start = profile != NULL ? profileNow() : 0;
+	int stride;
+
+	for (stride = 1; stride < reduction->threads; stride *= 2) {
+		if (id % (stride * 2) != 0)
+			break;
+
+		int child = id + stride;
+		if (child < reduction->threads) {
+			waitForSweepProfiled(&reduction->slots[child].arrived, sweep, profile, id);
+			if (reduction->slots[child].maxDelta > maxDelta)
+				maxDelta = reduction->slots[child].maxDelta;
+			if (sumSquares != NULL)
+				*sumSquares += reduction->slots[child].sumSquares;
+		}
+	}
+
+	if (id == 0) {
+		reduction->maxDelta = maxDelta;
+		if (sumSquares != NULL)
+			reduction->sumSquares = *sumSquares;
+		atomic_store_explicit(&reduction->released, sweep, memory_order_release);
+		if (profile != NULL)
+			profileRecord(profile, id, PHASE_SYNC, start, profileNow());
+		return maxDelta;
+	}
+
+	reduction->slots[id].maxDelta = maxDelta;
+	if (sumSquares != NULL)
+		reduction->slots[id].sumSquares = *sumSquares;
+	atomic_store_explicit(&reduction->slots[id].arrived, sweep, memory_order_release);
+
+	waitForSweepProfiled(&reduction->released, sweep, profile, id);
+	if (sumSquares != NULL)
+		*sumSquares = reduction->sumSquares;
+	if (profile != NULL)
+		profileRecord(profile, id, PHASE_SYNC, start, profileNow());
+	return reduction->maxDelta;
+}
+
+/* Sum of the squared residuals of a thread's blocks */
+double residualSquaresBlocks(struct RelaxData *data, double *values) {
+	int cols = data->cols;
+	double sum = 0;
+	int b, row;
+
+	for (b = 0; b < data->blockCount; b++) {
+		struct Block *block = &data->blocks[b];
+		for (row = block->rowStart; row < block->rowEnd; row++) {
+			double *current = values + (size_t)row * cols;
+			if (block->masked)
+				sum += residualSquaresMasked(current, current - cols, current + cols, data->mask + (size_t)row * cols,
+											 block->colStart, block->colEnd);
+			else
+				sum += residualSquares(current, current - cols, current + cols, block->colStart, block->colEnd);
+		}
+	}
+
+	return sum;
+}
+
+/* The same for a 3D array, through every plane */
+double residualSquaresVolumeBlocks(struct RelaxData *data, double *values) {
+	size_t plane = (size_t)data->rows * data->cols;
+	double sum = 0;
+	int b, z, row;
+
+	for (b = 0; b < data->blockCount; b++) {
+		struct Block *block = &data->blocks[b];
+		for (z = 1; z < data->planes - 1; z++) {
+			for (row = block->rowStart; row < block->rowEnd; row++) {
+				double *current = values + z * plane + (size_t)row * data->cols;
+				sum += residualSquaresVolume(current, current - data->cols, current + data->cols,
+											 current - plane, current + plane, block->colStart, block->colEnd);
+			}
+		}
+	}
+
+	return sum;
+}
+
+/* Square root of the sum of squared residuals of values over the whole array. Each thread
+ * sums its own blocks, then they're totalled in one more reduction */
+double reduceResidual(struct RelaxData *data, double *values, int *syncs) {
+	uint64_t start = data->profile != NULL ? profileNow() : 0;
+	double sum;
+
+	if (data->planes > 1)
+		sum = residualSquaresVolumeBlocks(data, values);
+	else
+		sum = residualSquaresBlocks(data, values);
+
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+	(*syncs)++;
+	reduceMaxDelta(data->reduction, data->id, *syncs, 0, &sum, data->profile);
+	return sqrt(sum);
+}
+
+/* reduceResidual for float arithmetic. The squares are still summed in double */
+double reduceResidualFloat(struct RelaxData *data, float *values, int *syncs) {
+	uint64_t start = data->profile != NULL ? profileNow() : 0;
+	int cols = data->cols;
+	double sum = 0;
+	int b, row;
+
+	for (b = 0; b < data->blockCount; b++) {
+		struct Block *block = &data->blocks[b];
+		for (row = block->rowStart; row < block->rowEnd; row++) {
+			float *current = values + (size_t)row * cols;
+			if (block->masked)
+				sum += residualSquaresFloatMasked(current, current - cols, current + cols,
+												  data->mask + (size_t)row * cols, block->colStart, block->colEnd);
+			else
+				sum += residualSquaresFloat(current, current - cols, current + cols,
+											block->colStart, block->colEnd);
+		}
+	}
+
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+	(*syncs)++;
+	reduceMaxDelta(data->reduction, data->id, *syncs, 0, &sum, data->profile);
+	return sqrt(sum);
+}
+
+/* Sets up a thread's convergence checks, finding the starting residual if it's needed.
+ * A resumed solve picks up its checks where they were */
+void startConvergence(struct RelaxData *data, struct Convergence *convergence, int *syncs) {
+	if (data->resume != NULL) {
+		*convergence = data->resume->convergence;
+		return;
+	}
+
+	convergenceInit(convergence, data->norm, data->precision, data->checkEvery);
+	if (data->norm == NORM_RELATIVE)
+		convergence->initial = data->initial > 0 ? data->initial : reduceResidual(data, data->values, syncs);
+}
+
+/* The count of the first checkpoint after count relaxations. Every thread keeps its own,
+ * and as they all count the same they agree on it without talking */
+int nextCheckpointAfter(struct RelaxData *data, int count) {
+	if (data->checkpoint == NULL)
+		return INT_MAX;
+
+	int every = checkpointEvery(data->checkpoint);
+	return (count / every + 1) * every;
+}
+
+/* 1 if a checkpoint is due after count relaxations, moving nextCheckpoint on if so */
+int checkpointDue(struct RelaxData *data, int count, int *nextCheckpoint) {
+	if (count < *nextCheckpoint)
+		return 0;
+
+	*nextCheckpoint = nextCheckpointAfter(data, count);
+	return 1;
+}
+
+void blockWithEdges(struct Block *block, int rows, int cols, int *rowLow, int *rowHigh, int *colLow, int *colHigh);
+
+/* Every thread copies its blocks into the checkpoint's buffer, from floatValues if it
+ * isn't NULL and values otherwise, then thread 0 hands it over to be written with the
+ * progress so far. Fixed cells always come from values, as float would round them. If
+ * the last checkpoint is still being written this one is skipped rather than wait. Only
+ * thread 0 can ask, so it passes the answer on through the reduction as the largest
+ * change, 1 to go ahead */
+void saveCheckpoint(struct RelaxData *data, double *values, float *floatValues, int count,
+					struct Convergence *convergence, double lowest, int lowestCount, int *syncs) {
+	int rowLow, rowHigh, colLow, colHigh, row, col, b;
+	int cols = data->cols;
+
+	(*syncs)++;
+	// A double only because it travels through the max-reduction
+	double goAhead = data->id == 0 && !checkpointBusy(data->checkpoint);
+	if (reduceMaxDelta(data->reduction, data->id, *syncs, goAhead, NULL, data->profile) == 0)
+		return;
+
+	uint64_t start = data->profile != NULL ? profileNow() : 0;
+	double *buffer = checkpointBuffer(data->checkpoint);
+	for (b = 0; b < data->blockCount; b++) {
+		blockWithEdges(&data->blocks[b], data->rows, cols, &rowLow, &rowHigh, &colLow, &colHigh);
+		for (row = rowLow; row < rowHigh; row++) {
+			size_t first = (size_t)row * cols;
+			memcpy(buffer + first + colLow, values + first + colLow, (colHigh - colLow) * sizeof(double));
+		}
+		if (floatValues == NULL)
+			continue;
+
+		struct Block *block = &data->blocks[b];
+		for (row = block->rowStart; row < block->rowEnd; row++) {
+			size_t first = (size_t)row * cols;
+			if (block->masked) {
+				for (col = block->colStart; col < block->colEnd; col++)
+					buffer[first + col] = data->mask[first + col] ? values[first + col] : floatValues[first + col];
+				continue;
+			}
+			for (col = block->colStart; col < block->colEnd; col++)
+				buffer[first + col] = floatValues[first + col];
+		}
+	}
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COPY, start, profileNow());
+
+	(*syncs)++;
+	reduceMaxDelta(data->reduction, data->id, *syncs, 0, NULL, data->profile);
+
+	if (data->id == 0) {
+		struct CheckpointState state = *data->settings;
+		state.count = count;
+		state.inFloat = floatValues != NULL;
+		state.floatCount = state.inFloat ? count : *data->floatCount;
+		state.convergence = *convergence;
+		state.lowest = lowest;
+		state.lowestCount = lowestCount;
+		checkpointSave(data->checkpoint, &state);
+	}
+}
+
+/* The block grown to take in the fixed edge cells next to it, so that between them the
+ * blocks cover the whole array */
+void blockWithEdges(struct Block *block, int rows, int cols, int *rowLow, int *rowHigh, int *colLow, int *colHigh) {
+	*rowLow = block->rowStart == 1 ? 0 : block->rowStart;
+	*rowHigh = block->rowEnd == rows - 1 ? rows : block->rowEnd;
+	*colLow = block->colStart == 1 ? 0 : block->colStart;
+	*colHigh = block->colEnd == cols - 1 ? cols : block->colEnd;
+}
+
+/* Copies the fixed edge cells next to a block from values into newValues. The interior
+ * of newValues is written by the first sweep, cells fixed by the mask included, so this
+ * is all it needs before the second reads from it, and every page of it is first touched
+ * by the thread that relaxes it */
+void copyEdges(double *values, double *newValues, int rows, int cols, struct Block *block) {
+	int rowLow, rowHigh, colLow, colHigh, row;
+
+	blockWithEdges(block, rows, cols, &rowLow, &rowHigh, &colLow, &colHigh);
+
+	for (row = rowLow; row < rowHigh; row++) {
+		size_t first = (size_t)row * cols;
+		if (row == 0 || row == rows - 1) {
+			memcpy(newValues + first + colLow, values + first + colLow, (colHigh - colLow) * sizeof(double));
+			continue;
+		}
+		if (colLow == 0)
+			newValues[first] = values[first];
+		if (colHigh == cols)
+			newValues[first + cols - 1] = values[first + cols - 1];
+	}
+}
+
+/* copyEdges for a 3D array, where a block runs through every plane. The front and back
+ * planes are fixed all over */
+void copyVolumeEdges(double *values, double *newValues, int planes, int rows, int cols, struct Block *block) {
+	size_t plane = (size_t)rows * cols;
+	int rowLow, rowHigh, colLow, colHigh, row, z;
+
+	blockWithEdges(block, rows, cols, &rowLow, &rowHigh, &colLow, &colHigh);
+
+	for (z = 0; z < planes; z++) {
+		if (z > 0 && z < planes - 1) {
+			copyEdges(values + z * plane, newValues + z * plane, rows, cols, block);
+			continue;
+		}
+		for (row = rowLow; row < rowHigh; row++) {
+			size_t first = z * plane + (size_t)row * cols;
+			memcpy(newValues + first + colLow, values + first + colLow, (colHigh - colLow) * sizeof(double));
+		}
+	}
+}
+
+/* Zeroes a thread's blocks and the edge cells next to them, so the pages are first
+ * touched by, and on NUMA machines placed next to, the thread that will relax them.
+ * With generate set they get their random values instead, each from its own index, so
+ * it makes no difference which thread makes which, or that edge cells are made twice.
+ * With text set the thread parses its range of the file into the placed array instead */
+void* relaxTouch(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+	size_t plane = (size_t)data->rows * data->cols;
+	int rowLow, rowHigh, colLow, colHigh, row, z, b;
+
+	if (data->text != NULL) {
+		// No range knows where its numbers go until every range has been counted
+		gridTextCount(data->text, data->id);
+		reduceMaxDelta(data->reduction, data->id, 1, 0, NULL, NULL);
+		gridTextParse(data->text, data->id);
+		return NULL;
+	}
+
+	for (b = 0; b < data->blockCount; b++) {
+		blockWithEdges(&data->blocks[b], data->rows, data->cols, &rowLow, &rowHigh, &colLow, &colHigh);
+		for (z = 0; z < data->planes; z++) {
+			for (row = rowLow; row < rowHigh; row++) {
+				size_t first = z * plane + (size_t)row * data->cols + colLow;
+				if (data->generate)
+					rngFill(data->values + first, first, colHigh - colLow, data->seed, data->low, data->high);
+				else
+					memset(data->values + first, 0, (colHigh - colLow) * sizeof(double));
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs sweeps relaxations of one block while it sits in cache, reading from values as it
+ * was before the first and writing into newValues as it is after the last.
+ *
+ * The block is copied into scratch along with a halo sweeps cells deep on each side.
+ * Each relaxation then works on one less cell of halo than the last, so the cells it
+ * needs from the previous one are always there, and after the final relaxation only
+ * the block itself is left. This is exactly what sweeps plain relaxations would have
+ * given it. Halo cells are relaxed by more than one thread, that's the price of not
+ * synchronising between relaxations.
+ *
+ * scratch needs room for two copies of the block with its halo. mask is only used if
+ * the block is masked, the halo included.
+ * Returns the largest change made on the last relaxation.
+ */
+double relaxBlockTemporal(double *values, double *newValues, int rows, int cols, const unsigned char *mask,
+						  struct Block *block, int sweeps, double *scratch) {
+	int rowLow = block->rowStart - sweeps > 0 ? block->rowStart - sweeps : 0;
+	int rowHigh = block->rowEnd + sweeps < rows ? block->rowEnd + sweeps : rows;
+	int colLow = block->colStart - sweeps > 0 ? block->colStart - sweeps : 0;
+	int colHigh = block->colEnd + sweeps < cols ? block->colEnd + sweeps : cols;
+	int width = colHigh - colLow;
+	double *buffers[2] = { scratch, scratch + (size_t)(rowHigh - rowLow) * width };
+	double maxDelta = 0;
+	int row, s;
+
+	// Both copies need the fixed edge cells, so load the window into each
+	for (row = rowLow; row < rowHigh; row++) {
+		memcpy(buffers[0] + (size_t)(row - rowLow) * width, values + (size_t)row * cols + colLow,
+			   width * sizeof(double));
+		memcpy(buffers[1] + (size_t)(row - rowLow) * width, values + (size_t)row * cols + colLow,
+			   width * sizeof(double));
+	}
+
+	for (s = 1; s <= sweeps; s++) {
+		double *in = buffers[(s - 1) % 2];
+		double *out = buffers[s % 2];
+		int halo = sweeps - s;
+
+		// Area left to relax this time round, never touching the fixed outer ring
+		int first = block->rowStart - halo > 1 ? block->rowStart - halo : 1;
+		int last = block->rowEnd + halo < rows - 1 ? block->rowEnd + halo : rows - 1;
+		int colStart = (block->colStart - halo > 1 ? block->colStart - halo : 1) - colLow;
+		int colEnd = (block->colEnd + halo < cols - 1 ? block->colEnd + halo : cols - 1) - colLow;
+
+		for (row = first; row < last; row++) {
+			double *current = in + (size_t)(row - rowLow) * width;
+			double *relaxed;
+
+			// The last relaxation writes straight out, lined up so the columns match scratch
+			if (s == sweeps)
+				relaxed = newValues + (size_t)row * cols + colLow;
+			else
+				relaxed = out + (size_t)(row - rowLow) * width;
+
+			double delta;
+			if (block->masked)
+				delta = relaxRowMasked(current, current - width, current + width, relaxed,
+									   mask + (size_t)row * cols + colLow, colStart, colEnd);
+			else
+				delta = relaxRow(current, current - width, current + width, relaxed, colStart, colEnd);
+			if (s == sweeps && delta > maxDelta)
+				maxDelta = delta;
+		}
+	}
+
+	return maxDelta;
+}
+
+/* Each thread keeps its own view of which array is read from and which is written to,
+ * and swaps them after every sweep in lock step with the others. This means one
+ * synchronisation per sweep and no copying back from newValues into values.
+ *
+ * With data->sweeps above 1, each block is relaxed that many times before moving on
+ * (see relaxBlockTemporal) and convergence is only checked after the last of them.
+ */
+void* relaxArray(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+
+	double *values = data->values;
+	double *newValues = data->newValues;
+	int cols = data->cols;
+	int sweeps = data->sweeps;
+	double globalDelta = 0;
+	struct Convergence convergence;
+	int converged = 0;
+	int count = data->done;
+	int syncs = data->syncs;
+	int nextCheckpoint = nextCheckpointAfter(data, count);
+	int b, row;
+
+	startConvergence(data, &convergence, &syncs);
+
+	double *scratch = NULL;
+	if (sweeps > 1) {
+		size_t scratchSize = 0;
+		for (b = 0; b < data->blockCount; b++) {
+			struct Block *block = &data->blocks[b];
+			size_t window = (size_t)(block->rowEnd - block->rowStart + 2 * sweeps)
+							* (block->colEnd - block->colStart + 2 * sweeps);
+			if (2 * window > scratchSize)
+				scratchSize = 2 * window;
+		}
+		scratch = malloc((scratchSize > 0 ? scratchSize : 1) * sizeof(double));
+	}
+
+	for (b = 0; b < data->blockCount; b++)
+		copyEdges(values, newValues, data->rows, cols, &data->blocks[b]);
+
+	while (!converged) {
+		double maxDelta = 0;
+		uint64_t start = data->profile != NULL ? profileNow() : 0;
+
+		for (b = 0; b < data->blockCount; b++) {
+			struct Block *block = &data->blocks[b];
+
+			if (sweeps > 1) {
+				double delta = relaxBlockTemporal(values, newValues, data->rows, cols, data->mask, block, sweeps, scratch);
+				if (delta > maxDelta)
+					maxDelta = delta;
+				continue;
+			}
+
+			for (row = block->rowStart; row < block->rowEnd; row++) {
+				double *current = values + (size_t)row * cols;
+				double *above = current - cols;
+				double *below = current + cols;
+				double *relaxed = newValues + (size_t)row * cols;
+
+				double delta;
+				if (block->masked)
+					delta = relaxRowMasked(current, above, below, relaxed, data->mask + (size_t)row * cols,
+										   block->colStart, block->colEnd);
+				else
+					delta = relaxRow(current, above, below, relaxed, block->colStart, block->colEnd);
+				if (delta > maxDelta)
+					maxDelta = delta;
+			}
+		}
+
+		if (data->profile != NULL)
+			profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+		count += sweeps;
+		// Wait until all the newValues are calculated, and find the biggest change
+		syncs++;
+		globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+
+		// Swap pointers, the relaxed numbers become the ones to read from next sweep
+		double *tempValues = values;
+		values = newValues;
+		newValues = tempValues;
+
+		if (convergenceDue(&convergence, count)) {
+			double norm = globalDelta;
+			if (data->norm != NORM_MAX)
+				norm = reduceResidual(data, values, &syncs);
+			converged = convergenceCheck(&convergence, count, norm);
+		}
+
+		if (!converged && checkpointDue(data, count, &nextCheckpoint))
+			saveCheckpoint(data, values, NULL, count, &convergence, 0, 0, &syncs);
+	}
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	free(scratch);
+
+	return NULL;
+}
+
+/* 1 if tile t and the tiles beside it all changed by no more than threshold when last
+ * relaxed, and it hasn't gone too long without a look */
+int tileSettled(struct ActiveTiles *active, int t, const double *delta, double threshold) {
+	int across = active->across;
+
+	if (active->idle[t] >= ACTIVE_REVISIT || delta[t] > threshold)
+		return 0;
+	if (t >= across && delta[t - across] > threshold)
+		return 0;
+	if (t + across < active->tileCount && delta[t + across] > threshold)
+		return 0;
+	if (t % across > 0 && delta[t - 1] > threshold)
+		return 0;
+	if ((t + 1) % across > 0 && t + 1 < active->tileCount && delta[t + 1] > threshold)
+		return 0;
+	return 1;
+}
+
+/* Jacobi that stops relaxing tiles once they have settled. Most of a grid often settles
+ * long before a few busy regions do, and there's no need to keep relaxing it meanwhile.
+ *
+ * A tile is skipped while it and its neighbours last changed by less than the precision
+ * over ACTIVE_MARGIN, and relaxed again every ACTIVE_REVISIT sweeps, or as soon as
+ * a neighbour starts changing, in case it has drifted. The first time it's skipped its
+ * values are copied into newValues, so both arrays hold them and neighbours read the same
+ * numbers whichever way round the arrays are.
+ *
+ * Busy tiles are seldom spread evenly, so each thread works through its own run of tiles
+ * then takes tiles from the front of the others' runs until every run is empty. The
+ * first sweep takes none, so each thread first touches the newValues of its own tiles.
+ *
+ * The largest change only covers the tiles that were relaxed, so on the max norm a sweep
+ * that looks converged is followed by one of every tile, and that is what's checked. The
+ * residual norms are found over the whole array already.
+ */
+void* relaxArrayActive(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+	struct ActiveTiles *active = data->active;
+
+	double *values = data->values;
+	double *newValues = data->newValues;
+	int cols = data->cols;
+	int threads = data->reduction->threads;
+	double globalDelta = 0;
+	struct Convergence convergence;
+	int converged = 0;
+	int verifying = 0;
+	int count = data->done;
+	int syncs = data->syncs;
+	long tilesRelaxed = 0, tilesSkipped = 0;
+	int b, t, v, row;
+
+	startConvergence(data, &convergence, &syncs);
+
+	// What a cell can change by for the norm to be met if every cell changed alike
+	double interior = (double)(data->rows - 2) * (cols - 2);
+	double threshold = data->precision / ACTIVE_MARGIN;
+	if (data->norm != NORM_MAX)
+		threshold /= sqrt(interior > 1 ? interior : 1);
+	if (data->norm == NORM_RELATIVE)
+		threshold *= convergence.initial;
+
+	for (b = 0; b < data->blockCount; b++)
+		copyEdges(values, newValues, data->rows, cols, &data->blocks[b]);
+
+	while (!converged) {
+		double *lastDelta = active->delta[(count + 1) % 2];
+		double *thisDelta = active->delta[count % 2];
+		double maxDelta = 0;
+		uint64_t start = data->profile != NULL ? profileNow() : 0;
+
+		atomic_store_explicit(&active->queues[data->id].next, active->queues[data->id].start, memory_order_relaxed);
+
+		for (v = 0; v < (count > data->done ? threads : 1); v++) {
+			struct TileQueue *queue = &active->queues[(data->id + v) % threads];
+
+			while ((t = atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed)) < queue->end) {
+				struct Block *tile = &active->tiles[t];
+
+				if (!verifying && tileSettled(active, t, lastDelta, threshold)) {
+					if (!active->settled[t]) {
+						for (row = tile->rowStart; row < tile->rowEnd; row++) {
+							size_t first = (size_t)row * cols + tile->colStart;
+							memcpy(newValues + first, values + first, (tile->colEnd - tile->colStart) * sizeof(double));
+						}
+						active->settled[t] = 1;
+					}
+					thisDelta[t] = lastDelta[t];
+					active->idle[t]++;
+					tilesSkipped++;
+					continue;
+				}
+
+				double tileDelta = 0;
+				for (row = tile->rowStart; row < tile->rowEnd; row++) {
+					double *current = values + (size_t)row * cols;
+					double *relaxed = newValues + (size_t)row * cols;
+
+					double delta;
+					if (tile->masked)
+						delta = relaxRowMasked(current, current - cols, current + cols, relaxed,
+											   data->mask + (size_t)row * cols, tile->colStart, tile->colEnd);
+					else
+						delta = relaxRow(current, current - cols, current + cols, relaxed, tile->colStart, tile->colEnd);
+					if (delta > tileDelta)
+						tileDelta = delta;
+				}
+				thisDelta[t] = tileDelta;
+				active->idle[t] = 0;
+				active->settled[t] = 0;
+				tilesRelaxed++;
+				if (tileDelta > maxDelta)
+					maxDelta = tileDelta;
+			}
+		}
+
+		if (data->profile != NULL)
+			profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+		count++;
+		syncs++;
+		globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+
+		double *tempValues = values;
+		values = newValues;
+		newValues = tempValues;
+
+		if (verifying || convergenceDue(&convergence, count)) {
+			double norm = globalDelta;
+			if (data->norm != NORM_MAX)
+				norm = reduceResidual(data, values, &syncs);
+			converged = convergenceCheck(&convergence, count, norm);
+			if (converged && data->norm == NORM_MAX && !verifying) {
+				converged = 0;
+				verifying = 1;
+			} else {
+				verifying = 0;
+			}
+		}
+	}
+
+	atomic_fetch_add(&active->relaxed, tilesRelaxed);
+	atomic_fetch_add(&active->skipped, tilesSkipped);
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	return NULL;
+}
+
+/* Waits for a thread to finish relaxation count, recording the wait if profiling */
+void waitForProgress(struct Progress *progress, int count, struct Profile *profile, int id) {
+	if (atomic_load_explicit(&progress->completed, memory_order_acquire) >= count)
+		return;
+	waitForSweepProfiled(&progress->completed, count, profile, id);
+}
+
+/* Jacobi where threads only wait for their neighbours. Relaxation n of a block reads the
+ * cells round it as relaxation n - 1 left them, and writes over what relaxation n - 2
+ * left, so before starting it a thread only needs the threads bordering it to have
+ * finished n - 1. Nobody waits for the whole array, so a thread held up for a moment
+ * only holds up its neighbours, and they only for as long as it takes to catch up.
+ *
+ * Convergence is checked NEIGHBOUR_SLACK relaxations behind: before relaxation n a thread
+ * waits for every thread to have finished n - NEIGHBOUR_SLACK, by which time they
+ * usually have, and takes the largest change on it from their Progress. Every thread sees
+ * the same changes so they all stop after the same relaxation, NEIGHBOUR_SLACK - 1 after
+ * the one that met precision. On the max norm Jacobi's largest change never grows, so
+ * the extra relaxations only take it further below. That's also why the residual norms,
+ * which need the whole array at once, aren't offered.
+ */
+void* relaxArrayNeighbours(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+	struct Progress *progress = data->progress;
+
+	double *values = data->values;
+	double *newValues = data->newValues;
+	int cols = data->cols;
+	int threads = data->reduction->threads;
+	struct Convergence convergence;
+	int converged = 0;
+	int count = data->done;
+	int syncs = data->syncs;
+	int b, i, row;
+
+	startConvergence(data, &convergence, &syncs);
+
+	for (b = 0; b < data->blockCount; b++)
+		copyEdges(values, newValues, data->rows, cols, &data->blocks[b]);
+
+	while (1) {
+		// The check that decides whether this relaxation is needed. Waiting for it even when
+		// there's nothing to check keeps everyone close enough that delta still holds it
+		int checked = count + 1 - NEIGHBOUR_SLACK;
+		if (checked > data->done) {
+			double norm = 0;
+			for (i = 0; i < threads; i++) {
+				waitForProgress(&progress[i], checked, data->profile, data->id);
+				if (progress[i].delta[checked % (2 * NEIGHBOUR_SLACK)] > norm)
+					norm = progress[i].delta[checked % (2 * NEIGHBOUR_SLACK)];
+			}
+			if (convergenceDue(&convergence, checked))
+				converged = convergenceCheck(&convergence, checked, norm);
+		}
+		if (converged)
+			break;
+
+		for (i = 0; i < data->neighbourCount; i++)
+			waitForProgress(&progress[data->neighbours[i]], count, data->profile, data->id);
+
+		double maxDelta = 0;
+		uint64_t start = data->profile != NULL ? profileNow() : 0;
+
+		for (b = 0; b < data->blockCount; b++) {
+			struct Block *block = &data->blocks[b];
+
+			for (row = block->rowStart; row < block->rowEnd; row++) {
+				double *current = values + (size_t)row * cols;
+				double *relaxed = newValues + (size_t)row * cols;
+
+				double delta;
+				if (block->masked)
+					delta = relaxRowMasked(current, current - cols, current + cols, relaxed,
+										   data->mask + (size_t)row * cols, block->colStart, block->colEnd);
+				else
+					delta = relaxRow(current, current - cols, current + cols, relaxed, block->colStart, block->colEnd);
+				if (delta > maxDelta)
+					maxDelta = delta;
+			}
+		}
+
+		if (data->profile != NULL)
+			profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+		count++;
+		progress[data->id].delta[count % (2 * NEIGHBOUR_SLACK)] = maxDelta;
+		atomic_store_explicit(&progress[data->id].completed, count, memory_order_release);
+
+		double *tempValues = values;
+		values = newValues;
+		newValues = tempValues;
+	}
+
+	if (data->id == 0) {
+		double globalDelta = 0;
+		for (i = 0; i < threads; i++) {
+			waitForProgress(&progress[i], count, NULL, 0);
+			if (count > data->done && progress[i].delta[count % (2 * NEIGHBOUR_SLACK)] > globalDelta)
+				globalDelta = progress[i].delta[count % (2 * NEIGHBOUR_SLACK)];
+		}
+		*data->count = count;
+		*data->result = values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	return NULL;
+}
+
+/* Jacobi on a 3D array with 2.5D blocking. Threads share out tiles of the plane just as
+ * they would for a 2D array, then relax each tile a plane at a time from front to back.
+ * The planes of the tile either side of the one being relaxed stay in cache as it moves
+ * on, so each cell comes in from memory once a sweep rather than once for each of the
+ * three planes that read it.
+ */
+void* relaxArrayVolume(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+
+	double *values = data->values;
+	double *newValues = data->newValues;
+	int cols = data->cols;
+	size_t plane = (size_t)data->rows * cols;
+	double globalDelta = 0;
+	struct Convergence convergence;
+	int converged = 0;
+	int count = data->done;
+	int syncs = data->syncs;
+	int b, z, row;
+
+	startConvergence(data, &convergence, &syncs);
+
+	for (b = 0; b < data->blockCount; b++)
+		copyVolumeEdges(values, newValues, data->planes, data->rows, cols, &data->blocks[b]);
+
+	while (!converged) {
+		double maxDelta = 0;
+		uint64_t start = data->profile != NULL ? profileNow() : 0;
+
+		for (b = 0; b < data->blockCount; b++) {
+			struct Block *block = &data->blocks[b];
+
+			for (z = 1; z < data->planes - 1; z++) {
+				for (row = block->rowStart; row < block->rowEnd; row++) {
+					double *current = values + z * plane + (size_t)row * cols;
+					double *relaxed = newValues + z * plane + (size_t)row * cols;
+
+					double delta = relaxRowVolume(current, current - cols, current + cols, current - plane,
+												  current + plane, relaxed, block->colStart, block->colEnd);
+					if (delta > maxDelta)
+						maxDelta = delta;
+				}
+			}
+		}
+
+		if (data->profile != NULL)
+			profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+		count++;
+		syncs++;
+		globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+
+		double *tempValues = values;
+		values = newValues;
+		newValues = tempValues;
+
+		if (convergenceDue(&convergence, count)) {
+			double norm = globalDelta;
+			if (data->norm != NORM_MAX)
+				norm = reduceResidual(data, values, &syncs);
+			converged = convergenceCheck(&convergence, count, norm);
+		}
+	}
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	return NULL;
+}
+
+/* Red-black Gauss-Seidel or SOR, in place on values. Every thread relaxes the red cells
+ * of its blocks, then waits for the others before doing the black ones, as black cells
+ * read red cells from neighbouring blocks. The wait after the black cells also finds the
+ * largest change over both colours.
+ */
+void* relaxArrayRedBlack(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+
+	double *values = data->values;
+	int cols = data->cols;
+	double omega = data->omega;
+	double globalDelta = 0;
+	struct Convergence convergence;
+	int converged = 0;
+	int count = data->done;
+	int syncs = data->syncs;
+	int nextCheckpoint = nextCheckpointAfter(data, count);
+	int b, row, colour;
+
+	startConvergence(data, &convergence, &syncs);
+
+	while (!converged) {
+		double maxDelta = 0;
+
+		for (colour = 0; colour < 2; colour++) {
+			uint64_t start = data->profile != NULL ? profileNow() : 0;
+
+			for (b = 0; b < data->blockCount; b++) {
+				struct Block *block = &data->blocks[b];
+
+				for (row = block->rowStart; row < block->rowEnd; row++) {
+					double *current = values + (size_t)row * cols;
+					// First column in the block where (row + col) % 2 == colour
+					int first = block->colStart + ((row + block->colStart) % 2 != colour);
+
+					double delta;
+					if (block->masked)
+						delta = relaxRowColourMasked(current, current - cols, current + cols,
+													 data->mask + (size_t)row * cols, first, block->colEnd, omega);
+					else
+						delta = relaxRowColour(current, current - cols, current + cols, first, block->colEnd, omega);
+					if (delta > maxDelta)
+						maxDelta = delta;
+				}
+			}
+
+			if (data->profile != NULL)
+				profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+			syncs++;
+			globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+		}
+
+		count++;
+
+		if (convergenceDue(&convergence, count)) {
+			double norm = globalDelta;
+			if (data->norm != NORM_MAX)
+				norm = reduceResidual(data, values, &syncs);
+			converged = convergenceCheck(&convergence, count, norm);
+		}
+
+		if (!converged && checkpointDue(data, count, &nextCheckpoint))
+			saveCheckpoint(data, values, NULL, count, &convergence, 0, 0, &syncs);
+	}
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	return NULL;
+}
+
+/* Copies a thread's blocks, and the edge cells next to them, between double and float */
+void blocksToFloat(struct RelaxData *data, float *floatValues) {
+	int rowLow, rowHigh, colLow, colHigh, row, col, b;
+
+	for (b = 0; b < data->blockCount; b++) {
+		blockWithEdges(&data->blocks[b], data->rows, data->cols, &rowLow, &rowHigh, &colLow, &colHigh);
+		for (row = rowLow; row < rowHigh; row++) {
+			size_t first = (size_t)row * data->cols;
+			for (col = colLow; col < colHigh; col++)
+				floatValues[first + col] = (float) data->values[first + col];
+		}
+	}
+}
+
+/* Only the interior cells come back, the edges in values were never changed. Nor were
+ * the cells fixed by the mask, which float would only have rounded */
+void blocksToDouble(struct RelaxData *data, float *floatValues) {
+	int row, col, b;
+
+	for (b = 0; b < data->blockCount; b++) {
+		struct Block *block = &data->blocks[b];
+		for (row = block->rowStart; row < block->rowEnd; row++) {
+			size_t first = (size_t)row * data->cols;
+			if (block->masked) {
+				for (col = block->colStart; col < block->colEnd; col++)
+					data->values[first + col] = data->mask[first + col] ? data->values[first + col]
+																		: floatValues[first + col];
+				continue;
+			}
+			for (col = block->colStart; col < block->colEnd; col++)
+				data->values[first + col] = floatValues[first + col];
+		}
+	}
+}
+
+/* Float and mixed arithmetic, for Jacobi (when there's a floatNewValues) or red-black.
+ * Each thread copies its blocks into float and relaxes them there exactly as relaxArray
+ * or relaxArrayRedBlack would, then copies them back. Float stops at precision, which
+ * the job has already kept above what float can reach. Mixed stops the float relaxation
+ * at that limit instead, and carries on from there with relaxArray or relaxArrayRedBlack
+ * in double to finish off.
+ *
+ * Rounding keeps exciting the slowest modes of Jacobi, so on big arrays float can level
+ * off above even that limit. If the norm goes FLOAT_STALL relaxations without a new low
+ * float stops there; mixed goes on in double, float alone ends with the norm it got to
+ * and says it stalled.
+ */
+void* relaxArrayFloat(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+
+	float *values = data->floatValues;
+	float *newValues = data->floatNewValues;
+	int cols = data->cols;
+	float omega = (float) data->omega;
+	double globalDelta = 0;
+	double precision = data->precision;
+	struct Convergence convergence;
+	int converged = 0;
+	int stalled = 0;
+	int count = 0;
+	int syncs = 0;
+	int nextCheckpoint = nextCheckpointAfter(data, 0);
+	int b, row, colour;
+
+	// Resumed after the float part was over, so straight on with the double
+	if (data->resume != NULL && !data->resume->inFloat) {
+		data->done = data->resume->count;
+		if (data->floatNewValues != NULL)
+			relaxArray(data);
+		else
+			relaxArrayRedBlack(data);
+		return NULL;
+	}
+
+	uint64_t start = data->profile != NULL ? profileNow() : 0;
+	blocksToFloat(data, values);
+	if (newValues != NULL)
+		blocksToFloat(data, newValues);
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COPY, start, profileNow());
+
+	// Neighbouring blocks have to be in float before anyone relaxes next to them
+	syncs++;
+	reduceMaxDelta(data->reduction, data->id, syncs, 0, NULL, data->profile);
+
+	double floor = convergenceFloatFloor(data->norm, data->rows, cols);
+	if (data->arithmetic == ARITHMETIC_MIXED && precision < floor)
+		precision = floor;
+	convergenceInit(&convergence, data->norm, precision, data->checkEvery);
+	if (data->norm == NORM_RELATIVE && data->resume == NULL)
+		convergence.initial = reduceResidualFloat(data, values, &syncs);
+
+	// Every thread sees the same norms, so they all give up together
+	double lowest = HUGE_VAL;
+	int lowestCount = 0;
+
+	if (data->resume != NULL) {
+		count = data->resume->count;
+		nextCheckpoint = nextCheckpointAfter(data, count);
+		convergence = data->resume->convergence;
+		lowest = data->resume->lowest;
+		lowestCount = data->resume->lowestCount;
+	}
+
+	while (!converged) {
+		double maxDelta = 0;
+
+		if (newValues != NULL) {
+			start = data->profile != NULL ? profileNow() : 0;
+
+			for (b = 0; b < data->blockCount; b++) {
+				struct Block *block = &data->blocks[b];
+				for (row = block->rowStart; row < block->rowEnd; row++) {
+					float *current = values + (size_t)row * cols;
+					float delta;
+					if (block->masked)
+						delta = relaxRowFloatMasked(current, current - cols, current + cols, newValues + (size_t)row * cols,
+													data->mask + (size_t)row * cols, block->colStart, block->colEnd);
+					else
+						delta = relaxRowFloat(current, current - cols, current + cols,
+											  newValues + (size_t)row * cols, block->colStart, block->colEnd);
+					if (delta > maxDelta)
+						maxDelta = delta;
+				}
+			}
+
+			if (data->profile != NULL)
+				profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+			syncs++;
+			globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+
+			float *tempValues = values;
+			values = newValues;
+			newValues = tempValues;
+		} else {
+			for (colour = 0; colour < 2; colour++) {
+				start = data->profile != NULL ? profileNow() : 0;
+
+				for (b = 0; b < data->blockCount; b++) {
+					struct Block *block = &data->blocks[b];
+					for (row = block->rowStart; row < block->rowEnd; row++) {
+						float *current = values + (size_t)row * cols;
+						int first = block->colStart + ((row + block->colStart) % 2 != colour);
+						float delta;
+						if (block->masked)
+							delta = relaxRowColourFloatMasked(current, current - cols, current + cols,
+															  data->mask + (size_t)row * cols, first, block->colEnd, omega);
+						else
+							delta = relaxRowColourFloat(current, current - cols, current + cols,
+														first, block->colEnd, omega);
+						if (delta > maxDelta)
+							maxDelta = delta;
+					}
+				}
+
+				if (data->profile != NULL)
+					profileRecord(data->profile, data->id, PHASE_COMPUTE, start, profileNow());
+
+				syncs++;
+				globalDelta = reduceMaxDelta(data->reduction, data->id, syncs, maxDelta, NULL, data->profile);
+			}
+		}
+
+		count++;
+
+		if (convergenceDue(&convergence, count)) {
+			double norm = globalDelta;
+			if (data->norm != NORM_MAX)
+				norm = reduceResidualFloat(data, values, &syncs);
+			converged = convergenceCheck(&convergence, count, norm);
+
+			if (convergenceValue(&convergence) < lowest) {
+				lowest = convergenceValue(&convergence);
+				lowestCount = count;
+			} else if (count - lowestCount >= FLOAT_STALL) {
+				stalled = 1;
+				break;
+			}
+		}
+
+		if (!converged && checkpointDue(data, count, &nextCheckpoint))
+			saveCheckpoint(data, data->values, values, count, &convergence, lowest, lowestCount, &syncs);
+	}
+
+	start = data->profile != NULL ? profileNow() : 0;
+	blocksToDouble(data, values);
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COPY, start, profileNow());
+
+	if (data->id == 0)
+		*data->floatCount = count;
+
+	if (data->arithmetic == ARITHMETIC_MIXED) {
+		// As before, the double relaxation reads cells copied back by the neighbours
+		syncs++;
+		reduceMaxDelta(data->reduction, data->id, syncs, 0, NULL, data->profile);
+
+		data->syncs = syncs;
+		data->done = count;
+		data->initial = convergence.initial;
+		data->resume = NULL;
+		if (data->floatNewValues != NULL)
+			relaxArray(data);
+		else
+			relaxArrayRedBlack(data);
+
+		if (data->id == 0)
+			data->convergence->checks += convergence.checks;
+		return NULL;
+	}
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = data->values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+		*data->stalled = stalled;
+	}
+
+	return NULL;
+}
+
+/* The share of rows 1 to dimension - 2 thread id gets, for spreading each multigrid
+ * step over the threads. Levels are too different in size to keep one partition */
+void levelRows(int dimension, int threads, int id, int *rowStart, int *rowEnd) {
+	int rows = dimension - 2;
+	*rowStart = 1 + (int) ((long) rows * id / threads);
+	*rowEnd = 1 + (int) ((long) rows * (id + 1) / threads);
+}
+
+/* Waits for all threads to finish the current multigrid step. When profiling, the time
+ * since the last step finished is recorded as the work of this one */
+void multigridSync(struct RelaxData *data, int *syncs, uint64_t *stepStart) {
+	if (data->profile != NULL)
+		profileRecord(data->profile, data->id, PHASE_COMPUTE, *stepStart, profileNow());
+
+	(*syncs)++;
+	reduceMaxDelta(data->reduction, data->id, *syncs, 0, NULL, data->profile);
+
+	if (data->profile != NULL)
+		*stepStart = profileNow();
+}
+
+void multigridSmoothSweeps(struct RelaxData *data, int level, int sweeps, int *syncs, uint64_t *stepStart) {
+	struct Level *current = &data->levels[level];
+	int rowStart, rowEnd, s, colour;
+
+	levelRows(current->dimension, data->reduction->threads, data->id, &rowStart, &rowEnd);
+
+	for (s = 0; s < sweeps; s++) {
+		for (colour = 0; colour < 2; colour++) {
+			multigridSmooth(current, rowStart, rowEnd, colour);
+			multigridSync(data, syncs, stepStart);
+		}
+	}
+}
+
+/* One cycle from level down to the coarsest and back up. Every thread runs this in
+ * step, doing its share of rows of each step and waiting for the rest at the end */
+void multigridCycle(struct RelaxData *data, int level, int *syncs, uint64_t *stepStart) {
+	struct Level *levels = data->levels;
+	int rowStart, rowEnd, c;
+
+	if (level == data->levelCount - 1) {
+		multigridSmoothSweeps(data, level, COARSEST_SWEEPS, syncs, stepStart);
+		return;
+	}
+
+	multigridSmoothSweeps(data, level, SMOOTH_SWEEPS, syncs, stepStart);
+
+	levelRows(levels[level+1].dimension, data->reduction->threads, data->id, &rowStart, &rowEnd);
+	multigridRestrict(&levels[level], &levels[level+1], rowStart, rowEnd);
+	multigridSync(data, syncs, stepStart);
+
+	for (c = 0; c < data->cycleShape; c++)
+		multigridCycle(data, level + 1, syncs, stepStart);
+
+	levelRows(levels[level].dimension, data->reduction->threads, data->id, &rowStart, &rowEnd);
+	multigridProlong(&levels[level+1], &levels[level], rowStart, rowEnd);
+	multigridSync(data, syncs, stepStart);
+
+	multigridSmoothSweeps(data, level, SMOOTH_SWEEPS, syncs, stepStart);
+}
+
+/* Multigrid cycles on values in place, until a Jacobi sweep would change no cell by
+ * more than precision. count ends up as the number of cycles */
+void* relaxArrayMultigrid(void *td) {
+	struct RelaxData *data = (struct RelaxData*) td;
+
+	double globalDelta = 0; // Only found when checking the max norm
+	struct Convergence convergence;
+	int converged = 0;
+	int count = data->done;
+	int syncs = 0;
+	int nextCheckpoint = nextCheckpointAfter(data, count);
+	int rowStart, rowEnd;
+
+	levelRows(data->rows, data->reduction->threads, data->id, &rowStart, &rowEnd);
+	startConvergence(data, &convergence, &syncs);
+	uint64_t stepStart = data->profile != NULL ? profileNow() : 0;
+
+	while (!converged) {
+		multigridCycle(data, 0, &syncs, &stepStart);
+		count++;
+
+		// Each cycle ends with every thread in step, so unchecked cycles can run straight on
+		if (convergenceDue(&convergence, count)) {
+			double norm;
+			if (data->norm == NORM_MAX) {
+				double change = multigridChange(&data->levels[0], rowStart, rowEnd);
+				if (data->profile != NULL)
+					profileRecord(data->profile, data->id, PHASE_COMPUTE, stepStart, profileNow());
+
+				syncs++;
+				norm = reduceMaxDelta(data->reduction, data->id, syncs, change, NULL, data->profile);
+				globalDelta = norm;
+			} else {
+				norm = reduceResidual(data, data->values, &syncs);
+			}
+			converged = convergenceCheck(&convergence, count, norm);
+
+			if (data->profile != NULL)
+				stepStart = profileNow();
+		}
+
+		// The coarser levels start from nothing each cycle, so the finest is all there is to save
+		if (!converged && checkpointDue(data, count, &nextCheckpoint)) {
+			saveCheckpoint(data, data->values, NULL, count, &convergence, 0, 0, &syncs);
+			if (data->profile != NULL)
+				stepStart = profileNow();
+		}
+	}
+
+	if (data->id == 0) {
+		*data->count = count;
+		*data->result = data->values;
+		*data->convergence = convergence;
+		*data->maxDelta = globalDelta;
+	}
+
+	return NULL;
+}
+
+/* Whole rows of the interior, split as evenly as possible into one strip per thread.
+ * Returns the number of blocks used. */
+int partitionRows(int rows, int cols, int cores, struct Block *blocks, int *firstBlock, int *blockCount) {
+	int interior = rows - 2;
+	int rowsPerCore = interior / cores;
+	int remain = interior % cores;
+	int curRow = 1;
+	int i;
+
+	for (i = 0; i < cores; i++) {
+		int rowsToGive = rowsPerCore;
+		if (remain > 0) {
+			rowsToGive++;
+			remain--;
+		}
+
+		blocks[i].rowStart = curRow;
+		blocks[i].rowEnd = curRow + rowsToGive;
+		blocks[i].colStart = 1;
+		blocks[i].colEnd = cols - 1;
+		blocks[i].masked = 0;
+		curRow += rowsToGive;
+
+		firstBlock[i] = i;
+		blockCount[i] = rowsToGive > 0 ? 1 : 0;
+	}
+
+	return cores;
+}
+
+/* Number of tiles partitionTiles() will make, so the blocks array can be sized */
+int countTiles(int rows, int cols, int tileRows, int tileCols) {
+	if (rows < 3 || cols < 3)
+		return 0;
+	return ((rows - 2 + tileRows - 1) / tileRows) * ((cols - 2 + tileCols - 1) / tileCols);
+}
+
+/* Pick a tile size where a tile of values (plus the cells around it) and its tile of
+ * newValues take up no more than half of the L2 cache.
+ *
+ * For temporal blocking halo is how deep the extra cells go, and tiles are made closer
+ * to square so less of the window is halo. */
+void chooseTileSize(int rows, int cols, int halo, int *tileRows, int *tileCols) {
+	long cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (cache <= 0)
+		cache = DEFAULT_L2_CACHE;
+
+	int interiorRows = rows - 2 > 1 ? rows - 2 : 1;
+	int interiorCols = cols - 2 > 1 ? cols - 2 : 1;
+
+	long cells = (cache / 2) / (2 * sizeof(double));
+	int side = (int) sqrt((double) cells);
+
+	if (halo > 0)
+		*tileCols = side - 2 * halo;
+	else
+		*tileCols = TILE_MAX_COLS;
+	if (*tileCols > interiorCols)
+		*tileCols = interiorCols;
+	if (*tileCols < 1)
+		*tileCols = 1;
+
+	*tileRows = (int) (cells / (*tileCols + 2 * (halo > 0 ? halo : 1))) - 2 * (halo > 0 ? halo : 1);
+	if (*tileRows < 1)
+		*tileRows = 1;
+	if (*tileRows > interiorRows)
+		*tileRows = interiorRows;
+}
+
+/* Tiles for 2.5D blocking of a 3D array, where the three planes of a tile the stencil
+ * reads and the one it writes take up no more than half of the L2 cache. A tile covers
+ * every plane, so there are far fewer of them than in 2D, and they are made shorter
+ * until every thread has one */
+void chooseTileSizeVolume(int rows, int cols, int threads, int *tileRows, int *tileCols) {
+	long cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (cache <= 0)
+		cache = DEFAULT_L2_CACHE;
+
+	int interiorRows = rows - 2 > 1 ? rows - 2 : 1;
+	int interiorCols = cols - 2 > 1 ? cols - 2 : 1;
+
+	long cells = (cache / 2) / (4 * sizeof(double));
+	*tileCols = (int) sqrt((double) cells);
+	if (*tileCols > interiorCols)
+		*tileCols = interiorCols;
+
+	*tileRows = (int) (cells / (*tileCols + 2)) - 2;
+	if (*tileRows < 1)
+		*tileRows = 1;
+	if (*tileRows > interiorRows)
+		*tileRows = interiorRows;
+
+	while (*tileRows > 1 && countTiles(rows, cols, *tileRows, *tileCols) < threads)
+		*tileRows = (*tileRows + 1) / 2;
+}
+
+/* Rectangular tiles covering the interior in row major order. Each thread gets a
+ * contiguous run of tiles, so it works on neighbouring tiles one after the other.
+ * Returns the number of blocks used. */
+int partitionTiles(int rows, int cols, int cores, int tileRows, int tileCols,
+				   struct Block *blocks, int *firstBlock, int *blockCount) {
+	int tiles = countTiles(rows, cols, tileRows, tileCols);
+	int row, col, i;
+	int t = 0;
+
+	for (row = 1; row < rows - 1; row += tileRows) {
+		for (col = 1; col < cols - 1; col += tileCols) {
+			blocks[t].rowStart = row;
+			blocks[t].rowEnd = row + tileRows < rows - 1 ? row + tileRows : rows - 1;
+			blocks[t].colStart = col;
+			blocks[t].colEnd = col + tileCols < cols - 1 ? col + tileCols : cols - 1;
+			blocks[t].masked = 0;
+			t++;
+		}
+	}
+
+	for (i = 0; i < cores; i++) {
+		firstBlock[i] = (int) ((long) tiles * i / cores);
+		blockCount[i] = (int) ((long) tiles * (i + 1) / cores) - firstBlock[i];
+	}
+
+	return tiles;
+}
+
+/* Marks the blocks with a cell fixed by the mask anywhere they relax, which with temporal
+ * blocking takes in a halo of sweeps - 1 cells around them. The rest keep the plain
+ * kernels, so a mask only costs where it fixes something */
+void markMaskedBlocks(struct Block *blocks, int blockCount, const unsigned char *mask,
+					  int rows, int cols, int sweeps) {
+	int halo = sweeps - 1;
+	int b, row, col;
+
+	for (b = 0; b < blockCount; b++) {
+		struct Block *block = &blocks[b];
+		int rowLow = block->rowStart - halo > 1 ? block->rowStart - halo : 1;
+		int rowHigh = block->rowEnd + halo < rows - 1 ? block->rowEnd + halo : rows - 1;
+		int colLow = block->colStart - halo > 1 ? block->colStart - halo : 1;
+		int colHigh = block->colEnd + halo < cols - 1 ? block->colEnd + halo : cols - 1;
+
+		block->masked = 0;
+		for (row = rowLow; row < rowHigh && !block->masked; row++) {
+			const unsigned char *fixed = mask + (size_t)row * cols;
+			for (col = colLow; col < colHigh; col++)
+				block->masked |= fixed[col] != 0;
+		}
+	}
+}
+
+/* A solve in the queue or in progress. The reduction lives in here so it gets its
+ * own cache lines, which is why jobs are allocated aligned. */
+struct RelaxJob {
+	struct Reduction reduction;
+	struct RelaxJob *next;
+	struct RelaxPool *pool;
+
+	double *values;
+	double *newValues; // Second array for Jacobi, NULL otherwise
+	float *floatValues; // For float and mixed arithmetic, NULL otherwise
+	float *floatNewValues; // Second float array for Jacobi
+	int planes, rows, cols;
+	struct RelaxOptions options;
+
+	int touchOnly; // Only placing the pages of values, see relaxAllocate
+	int threads; // Workers that solve it together
+	int joined; // Workers that have taken an id so far
+	int finished; // Workers that have returned from it
+	int done;
+
+	struct Block *blocks;
+	struct RelaxData *data;
+	struct Level *levels;
+	struct ActiveTiles *active; // NULL unless settled tiles are skipped
+	struct Progress *progress; // One for each thread with neighbour sync, otherwise NULL
+	int *neighbours; // Each thread's neighbours, one after another
+	int *neighbourFirst; // Where each thread's start in neighbours, and one past the last
+	int count;
+	double *result;
+	struct Convergence convergence; // Thread 0's, once finished
+	double maxDelta;
+	int floatCount;
+	int stalled;
+	struct CheckpointState settings; // Filled in for each checkpoint as it's taken
+	struct RelaxResult summary;
+};
+
+/* Workers sleep on work until a job reaches the front of the queue. A job stays at the
+ * front until as many workers as it needs have joined, so they all start it together,
+ * and the ones left over move on to the jobs behind it. */
+struct RelaxPool {
+	int threads;
+	pthread_t *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t work; // Signalled when a job is queued, a gang fills up or the pool stops
+	pthread_cond_t done; // Signalled when a job finishes
+	struct RelaxJob *head, *tail;
+	int stopping;
+	void *spare[SPARE_ARRAYS]; // Arrays from finished jobs, already mapped and faulted in
+	int spareCount;
+};
+
+struct RelaxWorker {
+	struct RelaxPool *pool;
+	int cpu; // CPU to pin to, -1 to leave it to the scheduler
+};
+
+/* Arrays are mapped rather than malloced so their pages are always fresh and untouched,
+ * whatever the allocator has lying around. The length is kept in a cache line in front. */
+void* relaxAllocateArray(size_t bytes, int hugePages) {
+	size_t page = hugePages ? HUGE_PAGE : (size_t) sysconf(_SC_PAGESIZE);
+	size_t length = (CACHE_LINE + bytes + page - 1) / page * page;
+	void *base = MAP_FAILED;
+
+	if (hugePages) {
+#ifdef MAP_HUGETLB
+		// Reserved huge pages if the system has any, otherwise ask for transparent ones
+		base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	}
+	if (base == MAP_FAILED) {
+		base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		if (hugePages)
+			madvise(base, length, MADV_HUGEPAGE);
+#endif
+	}
+
+	((size_t*) base)[0] = length;
+	((size_t*) base)[1] = hugePages;
+	return (char*) base + CACHE_LINE;
+}
+
+void relaxFreeArray(void *array) {
+	void *base = (char*) array - CACHE_LINE;
+	munmap(base, *(size_t*) base);
+}
+
+/* A second array for a job, one of the pool's spares if one fits without being more than
+ * twice the size, otherwise a fresh one. Taking a spare saves the mapping and page faults,
+ * which are most of the setup of a small solve when a pool is handed one after another.
+ * Its pages stay wherever the thread that first touched them put them */
+void* relaxTakeArray(struct RelaxPool *pool, size_t bytes, int hugePages) {
+	void *array = NULL;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->spareCount; i++) {
+		size_t *header = (size_t*) ((char*) pool->spare[i] - CACHE_LINE);
+		if (header[1] == (size_t) hugePages && header[0] >= CACHE_LINE + bytes && header[0] <= 2 * (CACHE_LINE + bytes)) {
+			array = pool->spare[i];
+			pool->spare[i] = pool->spare[--pool->spareCount];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return array != NULL ? array : relaxAllocateArray(bytes, hugePages);
+}
+
+/* Gives a job's second array back to the pool for the next job, unless it's too big to
+ * be worth keeping or the pool has enough already */
+void relaxGiveArray(struct RelaxPool *pool, void *array) {
+	size_t length = *(size_t*) ((char*) array - CACHE_LINE);
+
+	pthread_mutex_lock(&pool->lock);
+	if (length <= SPARE_LARGEST && pool->spareCount < SPARE_ARRAYS) {
+		pool->spare[pool->spareCount++] = array;
+		array = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (array != NULL)
+		relaxFreeArray(array);
+}
+
+void relaxFree(double *values) {
+	relaxFreeArray(values);
+}
+
+void* relaxWorker(void *td) {
+	struct RelaxWorker *worker = (struct RelaxWorker*) td;
+	struct RelaxPool *pool = worker->pool;
+
+	if (worker->cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(worker->cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+	free(worker);
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (pool->head == NULL && !pool->stopping)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if (pool->head == NULL)
+			break;
+
+		struct RelaxJob *job = pool->head;
+		int id = job->joined++;
+
+		if (job->joined == job->threads) {
+			pool->head = job->next;
+			if (pool->head == NULL)
+				pool->tail = NULL;
+			pthread_cond_broadcast(&pool->work);
+		} else {
+			// Rather than spin in the first reduction while the rest finish other jobs
+			while (job->joined < job->threads)
+				pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		if (job->options.profile != NULL)
+			profileThreadStart(job->options.profile, id);
+
+		if (job->touchOnly)
+			relaxTouch(&job->data[id]);
+		else if (job->planes > 1)
+			relaxArrayVolume(&job->data[id]);
+		else if (job->options.arithmetic != ARITHMETIC_DOUBLE)
+			relaxArrayFloat(&job->data[id]);
+		else if (job->active != NULL)
+			relaxArrayActive(&job->data[id]);
+		else if (job->progress != NULL)
+			relaxArrayNeighbours(&job->data[id]);
+		else if (job->options.method == METHOD_JACOBI)
+			relaxArray(&job->data[id]);
+		else if (job->options.method == METHOD_MULTIGRID)
+			relaxArrayMultigrid(&job->data[id]);
+		else
+			relaxArrayRedBlack(&job->data[id]);
+
+		if (job->options.profile != NULL)
+			profileThreadStop(job->options.profile, id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (++job->finished == job->threads) {
+			job->done = 1;
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/* Where a CPU sits: its socket, its core within the socket, and which of the core's
+ * hardware threads it is */
+struct CpuPlace {
+	int cpu;
+	int package, core, smt;
+};
+
+/* Reads a number from a sysfs topology file, -1 if there isn't one */
+int readTopology(int cpu, const char *name) {
+	char path[128];
+	int value = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	if (fscanf(file, "%d", &value) != 1)
+		value = -1;
+	fclose(file);
+	return value;
+}
+
+/* Compact fills a socket before moving to the next, one thread per core before doubling up */
+int compareCompact(const void *a, const void *b) {
+	const struct CpuPlace *x = a, *y = b;
+	if (x->package != y->package)
+		return x->package - y->package;
+	if (x->smt != y->smt)
+		return x->smt - y->smt;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+/* Scatter deals threads out to the sockets in turn, so each one's memory bandwidth is used.
+ * core has been replaced by the CPU's rank within its socket by then */
+int compareScatter(const void *a, const void *b) {
+	const struct CpuPlace *x = a, *y = b;
+	if (x->smt != y->smt)
+		return x->smt - y->smt;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->package - y->package;
+}
+
+int relaxParseCpuList(const char *list, int *cpus) {
+	int count = 0;
+	const char *c = list;
+
+	while (*c != '\0') {
+		char *end;
+		long first = strtol(c, &end, 10), last;
+		if (end == c || first < 0 || first >= RELAX_MAX_CPUS)
+			return 0;
+		last = first;
+		if (*end == '-') {
+			c = end + 1;
+			last = strtol(c, &end, 10);
+			if (end == c || last < first || last >= RELAX_MAX_CPUS)
+				return 0;
+		}
+		while (first <= last && count < RELAX_MAX_CPUS)
+			cpus[count++] = (int) first++;
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return 0;
+		c = end;
+	}
+
+	return count;
+}
+
+/* Fills cpus with the order to pin threads in, thread i going to cpus[i % count].
+ * Returns count, 0 to leave the threads unpinned */
+int chooseCpus(enum Affinity affinity, const char *cpuList, int *cpus) {
+	struct CpuPlace places[RELAX_MAX_CPUS];
+	cpu_set_t allowed;
+	int count = 0;
+	int i, j;
+
+	if (affinity == AFFINITY_NONE)
+		return 0;
+	if (affinity == AFFINITY_LIST)
+		return relaxParseCpuList(cpuList, cpus);
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return 0;
+
+	for (i = 0; i < RELAX_MAX_CPUS; i++) {
+		if (!CPU_ISSET(i, &allowed))
+			continue;
+		places[count].cpu = i;
+		places[count].package = readTopology(i, "physical_package_id");
+		places[count].core = readTopology(i, "core_id");
+		if (places[count].core < 0)
+			places[count].core = i;
+		count++;
+	}
+
+	// Hardware threads of the same core get numbered 0, 1... in CPU order
+	for (i = 0; i < count; i++) {
+		places[i].smt = 0;
+		for (j = 0; j < i; j++) {
+			if (places[j].package == places[i].package && places[j].core == places[i].core)
+				places[i].smt++;
+		}
+	}
+
+	qsort(places, count, sizeof(struct CpuPlace), compareCompact);
+
+	if (affinity == AFFINITY_SCATTER) {
+		// Rank each CPU within its socket, in compact order, then interleave the sockets
+		for (i = 0; i < count; i++) {
+			int rank = 0;
+			for (j = 0; j < i; j++) {
+				if (places[j].package == places[i].package && places[j].smt == places[i].smt)
+					rank++;
+			}
+			places[i].core = rank;
+		}
+		qsort(places, count, sizeof(struct CpuPlace), compareScatter);
+	}
+
+	for (i = 0; i < count; i++)
+		cpus[i] = places[i].cpu;
+	return count;
+}
+
+struct RelaxPool* relaxPoolCreate(int threads) {
+	return relaxPoolCreateAffinity(threads, AFFINITY_COMPACT, NULL);
+}
+
+struct RelaxPool* relaxPoolCreateAffinity(int threads, enum Affinity affinity, const char *cpuList) {
+	struct RelaxPool *pool = malloc(sizeof(struct RelaxPool));
+	int i;
+
+	if (pool == NULL)
+		return NULL;
+	if (threads < 1)
+		threads = 1;
+
+	// The stencil may already have been chosen, e.g. by -isa
+	if (stencilName() == NULL)
+		stencilInit();
+
+	pool->threads = 0;
+	pool->workers = malloc(threads * sizeof(pthread_t));
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->stopping = 0;
+	pool->spareCount = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	if (pool->workers == NULL) {
+		relaxPoolDestroy(pool);
+		return NULL;
+	}
+
+	// One thread per CPU while they last, then round again
+	int cpus[RELAX_MAX_CPUS];
+	int cpuCount = chooseCpus(affinity, cpuList, cpus);
+	if (affinity == AFFINITY_LIST && cpuCount == 0) {
+		relaxPoolDestroy(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < threads; i++) {
+		struct RelaxWorker *worker = malloc(sizeof(struct RelaxWorker));
+		if (worker == NULL)
+			break;
+		worker->pool = pool;
+		worker->cpu = cpuCount > 0 ? cpus[i % cpuCount] : -1;
+
+		if (pthread_create(&pool->workers[i], NULL, relaxWorker, worker) != 0) {
+			free(worker);
+			break;
+		}
+		pool->threads++;
+	}
+
+	if (pool->threads < threads) {
+		relaxPoolDestroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+int relaxPoolThreads(struct RelaxPool *pool) {
+	return pool->threads;
+}
+
+void relaxPoolDestroy(struct RelaxPool *pool) {
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->threads; i++)
+		pthread_join(pool->workers[i], NULL);
+	for (i = 0; i < pool->spareCount; i++)
+		relaxFreeArray(pool->spare[i]);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool);
+}
+
+/* Finds which threads have blocks that border each other's, as neighbour sync only
+ * waits for those. Blocks are in rows of across, as partitionTiles makes them, or
+ * across is 1 for strips of whole rows. Fills in job->neighbours and
+ * job->neighbourFirst, returning 0 if memory ran out */
+int findNeighbours(struct RelaxJob *job, int blockTotal, int across, int *firstBlock, int *blockCount) {
+	int threads = job->threads;
+	int *owner = malloc((blockTotal > 0 ? blockTotal : 1) * sizeof(int));
+	unsigned char *borders = calloc((size_t)threads * threads, 1);
+	int i, j, b, total = 0;
+
+	job->neighbourFirst = malloc((threads + 1) * sizeof(int));
+	if (owner == NULL || borders == NULL || job->neighbourFirst == NULL) {
+		free(owner);
+		free(borders);
+		return 0;
+	}
+
+	for (b = 0; b < blockTotal; b++)
+		owner[b] = -1;
+	for (i = 0; i < threads; i++) {
+		for (b = firstBlock[i]; b < firstBlock[i] + blockCount[i]; b++)
+			owner[b] = i;
+	}
+
+	// Each block only needs to look right and down, the other two see it
+	for (b = 0; b < blockTotal; b++) {
+		int next[2] = { (b + 1) % across > 0 ? b + 1 : -1, b + across };
+		for (j = 0; j < 2; j++) {
+			if (owner[b] < 0 || next[j] < 0 || next[j] >= blockTotal || owner[next[j]] < 0
+				|| owner[next[j]] == owner[b])
+				continue;
+			borders[owner[b] * threads + owner[next[j]]] = 1;
+			borders[owner[next[j]] * threads + owner[b]] = 1;
+		}
+	}
+
+	for (i = 0; i < threads * threads; i++)
+		total += borders[i];
+	job->neighbours = malloc((total > 0 ? total : 1) * sizeof(int));
+	if (job->neighbours == NULL) {
+		free(owner);
+		free(borders);
+		return 0;
+	}
+
+	total = 0;
+	for (i = 0; i < threads; i++) {
+		job->neighbourFirst[i] = total;
+		for (j = 0; j < threads; j++) {
+			if (borders[i * threads + j])
+				job->neighbours[total++] = j;
+		}
+	}
+	job->neighbourFirst[threads] = total;
+
+	free(owner);
+	free(borders);
+	return 1;
+}
+
+/* Tracking for tiles tiles, across to a row of them, every one still to settle. Each thread's
+ * queue holds the run of tiles partitionTiles gave it. Returns NULL if memory ran out */
+struct ActiveTiles* createActiveTiles(struct Block *tiles, int tileCount, int across, int threads,
+									  int *firstBlock, int *blockCount) {
+	struct ActiveTiles *active = calloc(1, sizeof(struct ActiveTiles));
+	int i;
+	if (active == NULL)
+		return NULL;
+
+	active->tiles = tiles;
+	active->tileCount = tileCount;
+	active->across = across;
+	active->delta[0] = malloc(tileCount * sizeof(double));
+	active->delta[1] = malloc(tileCount * sizeof(double));
+	active->idle = calloc(tileCount, sizeof(int));
+	active->settled = calloc(tileCount, 1);
+	active->queues = aligned_alloc(CACHE_LINE, threads * sizeof(struct TileQueue));
+	if (active->delta[0] == NULL || active->delta[1] == NULL || active->idle == NULL
+		|| active->settled == NULL || active->queues == NULL) {
+		free(active->delta[0]);
+		free(active->delta[1]);
+		free(active->idle);
+		free(active->settled);
+		free(active->queues);
+		free(active);
+		return NULL;
+	}
+
+	for (i = 0; i < tileCount; i++) {
+		active->delta[0][i] = HUGE_VAL;
+		active->delta[1][i] = HUGE_VAL;
+	}
+	for (i = 0; i < threads; i++) {
+		active->queues[i].start = firstBlock[i];
+		active->queues[i].end = firstBlock[i] + blockCount[i];
+		atomic_init(&active->queues[i].next, firstBlock[i]);
+	}
+	atomic_init(&active->relaxed, 0);
+	atomic_init(&active->skipped, 0);
+
+	return active;
+}
+
+void relaxJobFree(struct RelaxJob *job) {
+	if (job->levels != NULL) {
+		multigridFree(job->levels, job->summary.levelCount);
+		free(job->levels);
+	}
+	free(job->reduction.slots);
+	if (job->newValues != NULL)
+		relaxGiveArray(job->pool, job->newValues);
+	if (job->floatValues != NULL)
+		relaxGiveArray(job->pool, job->floatValues);
+	if (job->floatNewValues != NULL)
+		relaxGiveArray(job->pool, job->floatNewValues);
+	if (job->active != NULL) {
+		free(job->active->delta[0]);
+		free(job->active->delta[1]);
+		free(job->active->idle);
+		free(job->active->settled);
+		free(job->active->queues);
+		free(job->active);
+	}
+	free(job->progress);
+	free(job->neighbours);
+	free(job->neighbourFirst);
+	free(job->blocks);
+	free(job->data);
+	free(job);
+}
+
+/* Everything the workers need is set up here, so they only have to relax. A touchOnly
+ * job is partitioned exactly as a solve with the same options would be. planes is 1 for
+ * a 2D array */
+struct RelaxJob* relaxCreateJob(struct RelaxPool *pool, double *values, int planes, int rows, int cols,
+								const struct RelaxOptions *options, int touchOnly) {
+	struct RelaxJob *job = aligned_alloc(CACHE_LINE, sizeof(struct RelaxJob));
+	size_t cells = (size_t)planes * rows * cols;
+	struct Profile *profile = touchOnly ? NULL : options->profile;
+	uint64_t setupStart = 0;
+	int i, b;
+
+	if (profile != NULL) {
+		setupStart = profileNow();
+		profile->origin = setupStart;
+	}
+
+	if (job == NULL)
+		return NULL;
+	memset(job, 0, sizeof(struct RelaxJob));
+
+	job->pool = pool;
+	job->touchOnly = touchOnly;
+	job->values = values;
+	job->planes = planes;
+	job->rows = rows;
+	job->cols = cols;
+	job->options = *options;
+	job->result = values;
+
+	// Only the tiles handle temporal blocking, and only Jacobi double buffers for it
+	struct RelaxOptions *opts = &job->options;
+	if (planes > 1) {
+		// 3D arrays only have Jacobi in double, always streamed through tiles of the plane
+		opts->method = METHOD_JACOBI;
+		opts->arithmetic = ARITHMETIC_DOUBLE;
+		opts->sweeps = 1;
+		opts->partition = PARTITION_TILES;
+		opts->mask = NULL;
+		opts->checkpoint = NULL;
+		opts->resume = NULL;
+	}
+	if (opts->sweeps < 1 || opts->method != METHOD_JACOBI)
+		opts->sweeps = 1;
+	if (opts->sweeps > 1)
+		opts->partition = PARTITION_TILES;
+	if (opts->method == METHOD_GAUSS_SEIDEL)
+		opts->omega = 1;
+	if (opts->cycleShape < 1)
+		opts->cycleShape = 1;
+
+	// Multigrid's coarser levels halve a square array, and know nothing of fixed cells
+	if (opts->method == METHOD_MULTIGRID && (rows != cols || opts->mask != NULL))
+		opts->method = METHOD_SOR;
+	if (opts->method == METHOD_SOR && opts->omega == 0)
+		opts->omega = optimalOmega(rows, cols);
+
+	// Skipping settled tiles is for Jacobi in double a sweep at a time. It changes the count, which a
+	// resumed solve has to match
+	if (opts->method != METHOD_JACOBI || opts->arithmetic != ARITHMETIC_DOUBLE || opts->sweeps > 1
+		|| planes > 1 || opts->checkpoint != NULL || opts->resume != NULL)
+		opts->active = 0;
+	if (opts->active)
+		opts->partition = PARTITION_TILES;
+
+	// Only Jacobi's two arrays let a thread run ahead of the ones that aren't its neighbours,
+	// and only the max norm can be checked from each thread's own changes
+	if (opts->method != METHOD_JACOBI || opts->arithmetic != ARITHMETIC_DOUBLE || opts->sweeps > 1
+		|| planes > 1 || opts->active || opts->norm != NORM_MAX || opts->checkpoint != NULL || opts->resume != NULL)
+		opts->sync = SYNC_GLOBAL;
+
+	// Multigrid and temporal blocking only work in double. Float alone can't get below its floor
+	if (opts->method == METHOD_MULTIGRID || opts->sweeps > 1 || touchOnly)
+		opts->arithmetic = ARITHMETIC_DOUBLE;
+	if (opts->arithmetic == ARITHMETIC_FLOAT && opts->precision < convergenceFloatFloor(opts->norm, rows, cols))
+		opts->precision = convergenceFloatFloor(opts->norm, rows, cols);
+
+	job->threads = opts->threads;
+	if (job->threads < 1)
+		job->threads = cells < SOLO_CELLS ? 1 : pool->threads;
+	if (job->threads > pool->threads)
+		job->threads = pool->threads;
+
+	size_t slotsSize = job->threads * sizeof(struct ReductionSlot);
+	job->reduction.threads = job->threads;
+	job->reduction.slots = aligned_alloc(CACHE_LINE, slotsSize);
+	job->reduction.maxDelta = 0;
+	atomic_init(&job->reduction.released, 0);
+	job->data = malloc(job->threads * sizeof(struct RelaxData));
+	if (job->reduction.slots == NULL || job->data == NULL) {
+		relaxJobFree(job);
+		return NULL;
+	}
+	if (profile != NULL) {
+		profileFree(profile);
+		if (!profileAllocate(profile, job->threads)) {
+			relaxJobFree(job);
+			return NULL;
+		}
+	}
+	for (i = 0; i < job->threads; i++) {
+		atomic_init(&job->reduction.slots[i].arrived, 0);
+		job->reduction.slots[i].maxDelta = 0;
+	}
+
+	// Float on its own works straight back into values, so has no need of a second double array
+	if (opts->method == METHOD_JACOBI && !touchOnly && opts->arithmetic != ARITHMETIC_FLOAT) {
+		job->newValues = relaxTakeArray(pool, cells * sizeof(double), opts->hugePages);
+		if (job->newValues == NULL) {
+			relaxJobFree(job);
+			return NULL;
+		}
+		// Too small to have blocks, so no thread would copy its edges
+		if (rows < 3 || cols < 3 || planes == 2)
+			memcpy(job->newValues, values, cells * sizeof(double));
+	}
+	if (opts->arithmetic != ARITHMETIC_DOUBLE) {
+		job->floatValues = relaxTakeArray(pool, cells * sizeof(float), opts->hugePages);
+		if (opts->method == METHOD_JACOBI)
+			job->floatNewValues = relaxTakeArray(pool, cells * sizeof(float), opts->hugePages);
+		if (job->floatValues == NULL || (opts->method == METHOD_JACOBI && job->floatNewValues == NULL)) {
+			relaxJobFree(job);
+			return NULL;
+		}
+	}
+
+	int tileRows = 0, tileCols = 0;
+	int blocksNeeded = job->threads;
+	if (opts->partition == PARTITION_TILES) {
+		if (planes > 1)
+			chooseTileSizeVolume(rows, cols, job->threads, &tileRows, &tileCols);
+		else
+			chooseTileSize(rows, cols, opts->sweeps > 1 ? opts->sweeps : 0, &tileRows, &tileCols);
+		if (opts->active) {
+			if (tileRows > ACTIVE_TILE_ROWS)
+				tileRows = ACTIVE_TILE_ROWS;
+			if (tileCols > ACTIVE_TILE_COLS)
+				tileCols = ACTIVE_TILE_COLS;
+		}
+		blocksNeeded = countTiles(rows, cols, tileRows, tileCols);
+	}
+
+	int firstBlock[job->threads], blockCount[job->threads];
+	job->blocks = malloc((blocksNeeded > 0 ? blocksNeeded : 1) * sizeof(struct Block));
+	if (job->blocks == NULL) {
+		relaxJobFree(job);
+		return NULL;
+	}
+	if (opts->partition == PARTITION_TILES)
+		job->summary.blocks = partitionTiles(rows, cols, job->threads, tileRows, tileCols,
+											 job->blocks, firstBlock, blockCount);
+	else
+		job->summary.blocks = partitionRows(rows, cols, job->threads, job->blocks, firstBlock, blockCount);
+	if (touchOnly)
+		opts->mask = NULL;
+	if (opts->mask != NULL)
+		markMaskedBlocks(job->blocks, job->summary.blocks, opts->mask, rows, cols, opts->sweeps);
+
+	if (opts->active && !touchOnly && job->summary.blocks > 0) {
+		job->active = createActiveTiles(job->blocks, job->summary.blocks, (cols - 2 + tileCols - 1) / tileCols,
+										job->threads, firstBlock, blockCount);
+		if (job->active == NULL) {
+			relaxJobFree(job);
+			return NULL;
+		}
+	}
+	job->summary.active = job->active != NULL;
+
+	if (opts->sync == SYNC_NEIGHBOURS && !touchOnly) {
+		job->progress = aligned_alloc(CACHE_LINE, job->threads * sizeof(struct Progress));
+		if (job->progress == NULL || !findNeighbours(job, job->summary.blocks,
+													 opts->partition == PARTITION_TILES ? (cols - 2 + tileCols - 1) / tileCols : 1,
+													 firstBlock, blockCount)) {
+			relaxJobFree(job);
+			return NULL;
+		}
+		for (i = 0; i < job->threads; i++)
+			atomic_init(&job->progress[i].completed, 0);
+	}
+	job->summary.sync = job->progress != NULL ? SYNC_NEIGHBOURS : SYNC_GLOBAL;
+
+	if (opts->method == METHOD_MULTIGRID && !touchOnly) {
+		job->summary.levelCount = multigridLevelCount(rows);
+		job->levels = malloc(job->summary.levelCount * sizeof(struct Level));
+		if (job->levels == NULL || !multigridInit(job->levels, job->summary.levelCount, values, rows)) {
+			free(job->levels);
+			job->levels = NULL;
+			relaxJobFree(job);
+			return NULL;
+		}
+		job->summary.coarsestDimension = job->levels[job->summary.levelCount-1].dimension;
+	}
+
+	job->summary.threads = job->threads;
+	job->summary.tileRows = tileRows;
+	job->summary.tileCols = tileCols;
+	job->summary.sweeps = opts->sweeps;
+	job->summary.arithmetic = opts->arithmetic;
+	job->summary.method = opts->method;
+
+	job->settings.rows = rows;
+	job->settings.cols = cols;
+	job->settings.masked = opts->mask != NULL;
+	job->settings.method = opts->method;
+	job->settings.arithmetic = opts->arithmetic;
+	job->settings.norm = opts->norm;
+	job->settings.checkEvery = opts->checkEvery;
+	job->settings.sweeps = opts->sweeps;
+	job->settings.cycleShape = opts->cycleShape;
+	job->settings.precision = opts->precision;
+	job->settings.omega = opts->omega;
+	if (touchOnly) {
+		opts->checkpoint = NULL;
+		opts->resume = NULL;
+	}
+	if (opts->resume != NULL)
+		job->floatCount = opts->resume->floatCount;
+
+	for (i = 0; i < job->threads; i++) {
+		struct RelaxData *data = &job->data[i];
+		data->blocks = job->blocks + firstBlock[i];
+		data->blockCount = blockCount[i];
+		data->id = i;
+		data->values = values;
+		data->newValues = job->newValues;
+		data->reduction = &job->reduction;
+		data->count = &job->count;
+		data->result = &job->result;
+		data->sweeps = opts->sweeps;
+		data->omega = opts->omega;
+		data->levels = job->levels;
+		data->levelCount = job->summary.levelCount;
+		data->cycleShape = opts->cycleShape;
+		data->planes = planes;
+		data->rows = rows;
+		data->cols = cols;
+		data->mask = opts->mask;
+		data->precision = opts->precision;
+		data->profile = profile;
+		data->norm = opts->norm;
+		data->checkEvery = opts->checkEvery;
+		data->convergence = &job->convergence;
+		data->maxDelta = &job->maxDelta;
+		data->arithmetic = opts->arithmetic;
+		data->floatValues = job->floatValues;
+		data->floatNewValues = job->floatNewValues;
+		data->floatCount = &job->floatCount;
+		data->stalled = &job->stalled;
+		data->syncs = 0;
+		data->done = opts->resume != NULL ? opts->resume->count : 0;
+		data->initial = 0;
+		data->checkpoint = opts->checkpoint;
+		data->settings = &job->settings;
+		data->resume = opts->resume;
+		data->generate = 0;
+		data->text = NULL;
+		data->active = job->active;
+		data->progress = job->progress;
+		data->neighbours = job->progress != NULL ? job->neighbours + job->neighbourFirst[i] : NULL;
+		data->neighbourCount = job->progress != NULL ? job->neighbourFirst[i + 1] - job->neighbourFirst[i] : 0;
+
+		if (profile != NULL) {
+			for (b = 0; b < data->blockCount; b++)
+				profile->thread[i].cells += (long)(data->blocks[b].rowEnd - data->blocks[b].rowStart)
+											* (data->blocks[b].colEnd - data->blocks[b].colStart)
+											* (planes > 2 ? planes - 2 : 1);
+		}
+	}
+
+	if (profile != NULL) {
+		profile->setup.phase = PHASE_SETUP;
+		profile->setup.start = 0;
+		profile->setup.duration = profileNow() - setupStart;
+	}
+
+	return job;
+}
+
+void relaxQueue(struct RelaxPool *pool, struct RelaxJob *job) {
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail != NULL)
+		pool->tail->next = job;
+	else
+		pool->head = job;
+	pool->tail = job;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+struct RelaxJob* relaxSubmitVolume(struct RelaxPool *pool, double *values, int planes, int rows, int cols,
+								   const struct RelaxOptions *options) {
+	struct RelaxJob *job = relaxCreateJob(pool, values, planes, rows, cols, options, 0);
+	if (job != NULL)
+		relaxQueue(pool, job);
+	return job;
+}
+
+struct RelaxJob* relaxSubmit(struct RelaxPool *pool, double *values, int rows, int cols,
+							 const struct RelaxOptions *options) {
+	return relaxSubmitVolume(pool, values, 1, rows, cols, options);
+}
+
+void relaxWait(struct RelaxJob *job, struct RelaxResult *result) {
+	struct RelaxPool *pool = job->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!job->done)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	// Jacobi swaps arrays as it goes, so may have finished in its own one
+	struct Profile *profile = job->options.profile;
+	uint64_t copyStart = profile != NULL ? profileNow() : 0;
+	if (job->result != job->values)
+		memcpy(job->values, job->result, (size_t)job->planes * job->rows * job->cols * sizeof(double));
+
+	if (profile != NULL) {
+		int i;
+		profile->copyBack.phase = PHASE_COPY;
+		profile->copyBack.start = copyStart - profile->origin;
+		profile->copyBack.duration = job->result != job->values ? profileNow() - copyStart : 0;
+		for (i = 0; i < job->threads; i++)
+			profile->thread[i].iterations = job->count;
+	}
+
+	if (result != NULL) {
+		*result = job->summary;
+		result->count = job->count;
+		result->maxDelta = job->maxDelta;
+		result->residual = convergenceValue(&job->convergence);
+		result->checks = job->convergence.checks;
+		result->floatCount = job->floatCount;
+		result->stalled = job->stalled;
+		if (job->active != NULL) {
+			result->tilesRelaxed = atomic_load(&job->active->relaxed);
+			result->tilesSkipped = atomic_load(&job->active->skipped);
+		}
+	}
+
+	relaxJobFree(job);
+}
+
+int relaxSolveVolume(struct RelaxPool *pool, double *values, int planes, int rows, int cols,
+					 const struct RelaxOptions *options, struct RelaxResult *result) {
+	struct RelaxJob *job = relaxSubmitVolume(pool, values, planes, rows, cols, options);
+	if (job == NULL)
+		return 0;
+	relaxWait(job, result);
+	return 1;
+}
+
+int relaxSolve(struct RelaxPool *pool, double *values, int rows, int cols,
+			   const struct RelaxOptions *options, struct RelaxResult *result) {
+	return relaxSolveVolume(pool, values, 1, rows, cols, options, result);
+}
+
+/* relaxAllocate's array, zeroed, or with generate set filled with random values */
+double* relaxAllocateFilled(struct RelaxPool *pool, int planes, int rows, int cols, const struct RelaxOptions *options,
+							int generate, uint64_t seed, double low, double high) {
+	size_t cells = (size_t)planes * rows * cols;
+	double *values = relaxAllocateArray(cells * sizeof(double), options->hugePages);
+	int i;
+	if (values == NULL)
+		return NULL;
+
+	struct RelaxJob *job = relaxCreateJob(pool, values, planes, rows, cols, options, 1);
+	if (job == NULL) {
+		relaxFree(values);
+		return NULL;
+	}
+	for (i = 0; i < job->threads; i++) {
+		job->data[i].generate = generate;
+		job->data[i].seed = seed;
+		job->data[i].low = low;
+		job->data[i].high = high;
+	}
+	relaxQueue(pool, job);
+	relaxWait(job, NULL);
+
+	return values;
+}
+
+int relaxLoadText(struct RelaxPool *pool, const char *path, double *values, int planes, int rows, int cols,
+				  const struct RelaxOptions *options) {
+	int i;
+
+	struct RelaxJob *job = relaxCreateJob(pool, values, planes, rows, cols, options, 1);
+	if (job == NULL)
+		return 0;
+	struct GridText *text = gridTextOpen(path, values, (size_t)planes * rows * cols, job->threads);
+	if (text == NULL) {
+		relaxJobFree(job);
+		return 0;
+	}
+	for (i = 0; i < job->threads; i++)
+		job->data[i].text = text;
+	relaxQueue(pool, job);
+	relaxWait(job, NULL);
+
+	return gridTextClose(text);
+}
+
+double* relaxAllocate(struct RelaxPool *pool, int rows, int cols, const struct RelaxOptions *options) {
+	return relaxAllocateFilled(pool, 1, rows, cols, options, 0, 0, 0, 0);
+}
+
+double* relaxAllocateVolume(struct RelaxPool *pool, int planes, int rows, int cols,
+							const struct RelaxOptions *options) {
+	return relaxAllocateFilled(pool, planes, rows, cols, options, 0, 0, 0, 0);
+}
+
+double* relaxAllocateRandom(struct RelaxPool *pool, int rows, int cols, const struct RelaxOptions *options,
+							uint64_t seed, double low, double high) {
+	return relaxAllocateFilled(pool, 1, rows, cols, options, 1, seed, low, high);
+}
+
+double* relaxAllocateRandomVolume(struct RelaxPool *pool, int planes, int rows, int cols,
+								  const struct RelaxOptions *options, uint64_t seed, double low, double high) {
+	return relaxAllocateFilled(pool, planes, rows, cols, options, 1, seed, low, high);
+}
@@ -0,0 +1,163 @@
+#ifndef RELAX_H
+#define RELAX_H
+
+#include <stdint.h>
+
+#include "stencil.h"
+#include "convergence.h"
+
+/* The parallel relaxation as a library. A pool of threads is created once, each pinned
+ * to its own core, and stays alive solving grids handed to it until destroyed, so many
+ * grids can be solved without creating threads or starting a process for each.
+ *
+ *	struct RelaxPool *pool = relaxPoolCreate(8);
+ *	struct RelaxOptions options;
+ *	relaxOptionsInit(&options);
+ *	options.precision = 0.001;
+ *	for each grid: jobs[g] = relaxSubmit(pool, grids[g], rows, cols, &options);
+ *	for each grid: relaxWait(jobs[g], &results[g]);
+ *	relaxPoolDestroy(pool);
+ *
+ * Jobs run in the order they are submitted. Big grids are shared between several
+ * threads working in step; small ones are given a thread each so a batch of them runs
+ * side by side. The pool keeps a few of the second arrays Jacobi needs from one job to
+ * the next, so a stream of small grids doesn't map and fault in fresh ones every time.
+ */
+
+enum Partition { PARTITION_ROWS, PARTITION_TILES };
+
+/* How threads keep in step. Global has every thread wait for all the others after each
+ * relaxation. Neighbours has each wait only for the threads whose blocks border its own,
+ * checking convergence a few relaxations behind, so a slow thread only holds up the
+ * threads next to it. Neighbours is only for Jacobi in double on the max norm */
+enum Sync { SYNC_GLOBAL, SYNC_NEIGHBOURS };
+
+/* How pool threads are pinned to CPUs. Compact fills one socket before the next, one
+ * thread per core before using hyperthreads. Scatter deals them out to the sockets in
+ * turn. A list gives the CPUs to use in order, e.g. "0,2,4-7" */
+enum Affinity { AFFINITY_NONE, AFFINITY_COMPACT, AFFINITY_SCATTER, AFFINITY_LIST };
+
+#define RELAX_MAX_CPUS 1024
+
+struct RelaxOptions {
+	enum Method method;
+	double precision; // Stop once norm falls to this
+	enum Norm norm; // What has to fall below precision, see convergence.h
+	int checkEvery; // Relaxations, or multigrid cycles, between convergence checks, 0 to adapt
+	int threads; // Pool threads to share the grid between, 0 to decide from its size
+	enum Partition partition; // How the grid is split between threads: rows or L2 sized tiles
+	int sweeps; // Jacobi relaxations done on each tile while it's in cache, 1 to synchronise every time
+	double omega; // For SOR, 0 to estimate it from the dimension
+	int cycleShape; // For multigrid, 1 for V cycles, 2 for W cycles
+	struct Profile *profile; // NULL, or set up with profileInit to record where each thread's time goes
+	int hugePages; // 1 to back arrays from relaxAllocate, and Jacobi's second array, with 2MB pages
+	enum Arithmetic arithmetic; // Double, float, or float then double, see stencil.h. Not for multigrid or sweeps above 1
+	struct Checkpoint *checkpoint; // NULL, or from checkpointCreate to save progress to as it goes
+	const struct CheckpointState *resume; // NULL, or a checkpoint to carry on from. The values given must
+										  // be its array and the options the ones it was saved with
+	const unsigned char *mask; // NULL, or one per cell, nonzero to hold the cell fixed as the outer ring is.
+							   // Must stay untouched until relaxWait returns. Not for multigrid
+	int active; // 1 to stop relaxing tiles once they have settled, stealing tiles to balance the rest.
+				// Jacobi in double with sweeps 1 and no checkpoints only, and always split into tiles
+	enum Sync sync; // Global, or neighbours for Jacobi in double on the max norm without active or checkpoints
+};
+
+struct RelaxResult {
+	int count; // Relaxations, or cycles for multigrid
+	double maxDelta; // Largest change on the last of them
+	double residual; // The norm at the final check
+	int checks; // Convergence checks made
+	int threads; // Threads the grid was shared between
+	int blocks; // Rows or tiles the grid was split into
+	int tileRows, tileCols; // Size of tiles, 0 when split into rows
+	int sweeps; // Relaxations between precision checks actually used
+	enum Method method; // Method actually used, SOR in place of multigrid when it can't be
+	enum Arithmetic arithmetic; // Arithmetic actually used
+	int floatCount; // Of count, how many were done in float
+	int stalled; // 1 if float arithmetic levelled off above precision and stopped there
+	int levelCount; // Multigrid levels, 0 for other methods
+	int coarsestDimension;
+	enum Sync sync; // Synchronisation actually used
+	int active; // 1 if settled tiles were skipped
+	long tilesRelaxed; // With active, tile relaxations done and saved
+	long tilesSkipped;
+};
+
+struct RelaxPool;
+struct RelaxJob;
+struct Profile;
+struct Checkpoint;
+struct CheckpointState;
+
+/* Jacobi in double, stopping on the max change and checked every sweep, split into rows,
+ * threads chosen from the grid size. In options.c, so relaxc can fill in a request
+ * without linking the solver */
+void relaxOptionsInit(struct RelaxOptions *options);
+
+/* Starts threads threads, pinned compactly. Returns NULL if they couldn't be created */
+struct RelaxPool* relaxPoolCreate(int threads);
+
+/* As relaxPoolCreate, choosing how threads are pinned. cpuList is only used with
+ * AFFINITY_LIST, and NULL is returned if it can't be read */
+struct RelaxPool* relaxPoolCreateAffinity(int threads, enum Affinity affinity, const char *cpuList);
+
+int relaxPoolThreads(struct RelaxPool *pool);
+
+/* Waits for every submitted job to finish then stops the threads. Jobs still have to
+ * be collected with relaxWait first */
+void relaxPoolDestroy(struct RelaxPool *pool);
+
+/* Queues the rows x cols grid in values to be relaxed in place. values must stay
+ * untouched until relaxWait returns. Multigrid only takes square grids without a mask,
+ * others are solved with SOR instead. Returns NULL if memory for it ran out */
+struct RelaxJob* relaxSubmit(struct RelaxPool *pool, double *values, int rows, int cols,
+							 const struct RelaxOptions *options);
+
+/* Waits for a job to finish, fills in result if it isn't NULL, and frees the job.
+ * The relaxed grid is in the values given to relaxSubmit */
+void relaxWait(struct RelaxJob *job, struct RelaxResult *result);
+
+/* Parses a CPU list like "0,2,4-7" into cpus, which needs room for RELAX_MAX_CPUS.
+ * Returns how many CPUs, 0 if it isn't a valid list */
+int relaxParseCpuList(const char *list, int *cpus);
+
+/* A rows x cols array to solve in, with each part of it first touched by the
+ * pool thread that will relax it under these options. On NUMA machines that places the
+ * part in the memory next to that thread. Returns NULL if memory ran out. The array is
+ * zeroed; write values into it from any thread, it stays where it was placed.
+ * Release with relaxFree */
+double* relaxAllocate(struct RelaxPool *pool, int rows, int cols, const struct RelaxOptions *options);
+
+/* relaxAllocate with the array filled with random values in [low, high) rather than
+ * zeroes, each thread making the part it touches. The values come from seed and each
+ * cell's index (see rng.h), so a seed gives the same array whatever the threads */
+double* relaxAllocateRandom(struct RelaxPool *pool, int rows, int cols, const struct RelaxOptions *options,
+							uint64_t seed, double low, double high);
+
+/* Reads the first planes x rows x cols numbers of the text file at path into values, an
+ * array from relaxAllocate or relaxAllocateVolume under the same options, with each pool
+ * thread parsing a range of the file as gridLoadText's threads would. Returns 0, with a
+ * message on stderr, if the file can't be read as gridLoadText needs */
+int relaxLoadText(struct RelaxPool *pool, const char *path, double *values, int planes, int rows, int cols,
+				  const struct RelaxOptions *options);
+
+void relaxFree(double *values);
+
+/* relaxSubmit then relaxWait. Returns 0 if memory ran out */
+int relaxSolve(struct RelaxPool *pool, double *values, int rows, int cols,
+			   const struct RelaxOptions *options, struct RelaxResult *result);
+
+/* 3D arrays of planes planes of rows x cols, plane after plane, relaxed with the 7 point
+ * stencil. Every face is fixed. Always Jacobi in double without a mask, checkpoints or
+ * temporal blocking, with the plane split into tiles that each stream from the front
+ * plane to the back (2.5D blocking). Otherwise as their 2D versions */
+struct RelaxJob* relaxSubmitVolume(struct RelaxPool *pool, double *values, int planes, int rows, int cols,
+								   const struct RelaxOptions *options);
+int relaxSolveVolume(struct RelaxPool *pool, double *values, int planes, int rows, int cols,
+					 const struct RelaxOptions *options, struct RelaxResult *result);
+double* relaxAllocateVolume(struct RelaxPool *pool, int planes, int rows, int cols,
+							const struct RelaxOptions *options);
+double* relaxAllocateRandomVolume(struct RelaxPool *pool, int planes, int rows, int cols,
+								  const struct RelaxOptions *options, uint64_t seed, double low, double high);
+
+#endif
@@ -0,0 +1,527 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "relax.h"
+#include "service.h"
+#include "rng.h"
+
+#define BILLION 1000000000L
+
+void printArray(const char *, const double *, int, int, int);
+
+int main(int argc, char *argv[]) {
+
+	/* Values hard coded - ensure to update
+	 * As parallel, whose flags these are, with the grid solved by relaxd rather than in this process.
+	 * Flags that set up the threads (-affinity, -isa) are given to relaxd when it starts, and
+	 * -profile, -trace, -hugepages, checkpoints and streaming are only for parallel
+	 *
+	 * debug - The level of debug output: 0, 1, 2
+	 * cores - how many of relaxd's threads to share the grid between, 0 to leave it to relaxd, which
+	 * 			gives small grids a thread each so several clients' grids are solved side by side
+	 * dimension - how big the square array is
+	 * rows, cols - how many rows and columns the array has, to make it rectangular. 0 to use dimension
+	 * planes - 1 for a 2D array, or how many rows x cols planes deep a 3D one is. 3D is always jacobi in double
+	 * precision - how precise the relaxation needs to be before the program ends
+	 * method, omega, cycleShape, partition, sweeps, active, sync, arithmetic, norm, checkEvery - see parallel
+	 * maskFile - text or binary grid file with a nonzero value for each cell to hold fixed, NULL for just the ring
+	 * outputFile, outputText, imageFile - where to write the relaxed array, see parallel
+	 * socketPath - where relaxd is listening
+	 *
+	 * generateNumbers - 0 to use values in textFile, 1 to generate them randomly
+	 * seed - what the random values are made from, the same seed giving the same array as parallel. 0 for the clock
+	 * textFile - text or binary grid file (see gridio.h) to read numbers from. Needs to be set and filled in if generateNumbers == 0
+	 * 				needs to contain at least planes*rows*cols numbers, can contain more but not less
+	 */
+
+	int debug = 0; /* Debug output: 0 no detail - 1 some detail - 2 all detail */
+
+	int cores = 0;
+	int dimension = 10;
+	int rows = 0;
+	int cols = 0;
+	int planes = 1;
+	double precision = 0.0000000001;
+	enum Partition partition = PARTITION_ROWS;
+	int sweeps = 1;
+	int active = 0;
+	enum Sync sync = SYNC_GLOBAL;
+	enum Arithmetic arithmetic = ARITHMETIC_DOUBLE;
+
+	enum Method method = METHOD_JACOBI;
+	double omega = 0;
+	int cycleShape = 1;
+
+	enum Norm norm = NORM_MAX;
+	int checkEvery = 1;
+
+	const char *maskFile = NULL;
+
+	const char *outputFile = NULL;
+	int outputText = 0;
+	const char *imageFile = NULL;
+
+	const char *socketPath = SERVICE_SOCKET;
+
+	int generateNumbers = 1;
+	unsigned long long seed = 0;
+	// textFile needs to be set and filled in if generateNumbers == 0
+	const char *textFile = "scratch/valuesSmall.txt";
+
+	/* End editable values */
+
+	uint64_t diff;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* Parse command line input */
+	int a;
+	for (a = 1; a < argc; a++) { /* argv[0] is program name */
+		if (strcmp(argv[a], "-c") == 0 || strcmp(argv[a], "-cores") == 0) { // Value of 0 means strings are identical
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					cores = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -c. Positive integer required. Leaving it to relaxd as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-d") == 0 || strcmp(argv[a], "-dimension") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					dimension = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -d. Positive integer required. Using %d dimension as default.\n", dimension);
+				}
+			}
+		} else if (strcmp(argv[a], "-rows") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					rows = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -rows. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-cols") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					cols = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -cols. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-planes") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) == 1 || atoi(argv[a+1]) >= 3) {
+					a++;
+					planes = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -planes. 1, or an integer of at least 3, required. Using %d planes as default.\n", planes);
+				}
+			}
+		} else if (strcmp(argv[a], "-mask") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				maskFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-p") == 0 || strcmp(argv[a], "-precision") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) > 0.0) {
+					a++;
+					precision = atof(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -p. Positive double required. Using %f precision as default.\n", precision);
+				}
+			}
+		} else if (strcmp(argv[a], "-g") == 0 || strcmp(argv[a], "-generate") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					generateNumbers = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -g. Integer >= 0 required. Using %d dimension as default.\n", dimension);
+				}
+			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strtoull(argv[a+1], NULL, 10) > 0) {
+					a++;
+					seed = strtoull(argv[a], NULL, 10);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -seed. Positive integer required. Using a seed from the clock as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-debug") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					debug = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -debug. Integer >= 0 required. Using %d debug as default.\n", debug);
+				}
+			}
+		} else if (strcmp(argv[a], "-partition") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "rows") == 0) {
+					a++;
+					partition = PARTITION_ROWS;
+				} else if (strcmp(argv[a+1], "tiles") == 0) {
+					a++;
+					partition = PARTITION_TILES;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -partition. rows or tiles required. Using rows as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-temporal") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					sweeps = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -temporal. Positive integer required. Using %d sweeps as default.\n", sweeps);
+				}
+			}
+		} else if (strcmp(argv[a], "-active") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "0") == 0 || strcmp(argv[a+1], "1") == 0) {
+					a++;
+					active = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -active. 0 or 1 required. Using %d active as default.\n", active);
+				}
+			}
+		} else if (strcmp(argv[a], "-sync") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "global") == 0) {
+					a++;
+					sync = SYNC_GLOBAL;
+				} else if (strcmp(argv[a+1], "neighbours") == 0) {
+					a++;
+					sync = SYNC_NEIGHBOURS;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -sync. global or neighbours required. Using global as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-method") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "jacobi") == 0) {
+					a++;
+					method = METHOD_JACOBI;
+				} else if (strcmp(argv[a+1], "gs") == 0) {
+					a++;
+					method = METHOD_GAUSS_SEIDEL;
+				} else if (strcmp(argv[a+1], "sor") == 0) {
+					a++;
+					method = METHOD_SOR;
+				} else if (strcmp(argv[a+1], "multigrid") == 0) {
+					a++;
+					method = METHOD_MULTIGRID;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -method. jacobi, gs, sor or multigrid required. Using jacobi as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-cycle") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "v") == 0) {
+					a++;
+					cycleShape = 1;
+				} else if (strcmp(argv[a+1], "w") == 0) {
+					a++;
+					cycleShape = 2;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -cycle. v or w required. Using v as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-omega") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) >= 0.0 && atof(argv[a+1]) < 2.0) {
+					a++;
+					omega = atof(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -omega. Double from 0 up to 2 required. Estimating omega as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-norm") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "max") == 0) {
+					a++;
+					norm = NORM_MAX;
+				} else if (strcmp(argv[a+1], "l2") == 0) {
+					a++;
+					norm = NORM_L2;
+				} else if (strcmp(argv[a+1], "relative") == 0) {
+					a++;
+					norm = NORM_RELATIVE;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -norm. max, l2 or relative required. Using max as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-check") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "adaptive") == 0) {
+					a++;
+					checkEvery = 0;
+				} else if (atoi(argv[a+1]) > 0) {
+					a++;
+					checkEvery = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -check. Positive integer or adaptive required. Using %d check as default.\n", checkEvery);
+				}
+			}
+		} else if (strcmp(argv[a], "-arithmetic") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "double") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_DOUBLE;
+				} else if (strcmp(argv[a+1], "float") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_FLOAT;
+				} else if (strcmp(argv[a+1], "mixed") == 0) {
+					a++;
+					arithmetic = ARITHMETIC_MIXED;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -arithmetic. double, float or mixed required. Using double as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-o") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outputFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-oformat") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "binary") == 0) {
+					a++;
+					outputText = 0;
+				} else if (strcmp(argv[a+1], "text") == 0) {
+					a++;
+					outputText = 1;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -oformat. binary or text required. Using binary as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-image") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				imageFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-f") == 0 || strcmp(argv[a], "-filepath") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				textFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-socket") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				socketPath = argv[a];
+			}
+		} else if (strcmp(argv[a], "-profile") == 0 || strcmp(argv[a], "-trace") == 0 || strcmp(argv[a], "-affinity") == 0
+				   || strcmp(argv[a], "-hugepages") == 0 || strcmp(argv[a], "-isa") == 0 || strcmp(argv[a], "-checkpoint") == 0
+				   || strcmp(argv[a], "-checkpointevery") == 0 || strcmp(argv[a], "-resume") == 0
+				   || strcmp(argv[a], "-stream") == 0 || strcmp(argv[a], "-band") == 0) {
+			/* Up to relaxd when it's started, or only for a solve in its own process */
+			fprintf(stderr, "LOG WARNING - %s is only for parallel. Ignoring it.\n", argv[a]);
+			if (a + 1 <= argc - 1) /* Skip its argument */
+				a++;
+		} else {
+			/* Non optional arguments here, but we have none of those */
+		}
+	}
+
+	if (rows == 0) rows = dimension;
+	if (cols == 0) cols = dimension;
+	if (precision < 0.0000000001) precision = 0.0000000001;
+
+	if (planes > 1 && (method != METHOD_JACOBI || arithmetic != ARITHMETIC_DOUBLE || sweeps > 1 || maskFile != NULL)) {
+		fprintf(stderr, "LOG WARNING - -planes relaxes with jacobi in double. Ignoring -method, -arithmetic, -temporal and -mask.\n");
+		maskFile = NULL;
+	}
+
+	int binaryFile = 0;
+	if (!generateNumbers) {
+		binaryFile = gridIsBinary(textFile);
+		if (!binaryFile && access(textFile, R_OK) != 0) {
+			fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", textFile);
+			return 1;
+		}
+	}
+
+	int server = serviceConnect(socketPath);
+	if (server < 0) {
+		fprintf(stdout, "LOG ERROR - Failed to reach relaxd at %s. Exiting program", socketPath);
+		return 1;
+	}
+
+	struct RelaxOptions options;
+	relaxOptionsInit(&options);
+	options.method = method;
+	options.precision = precision;
+	options.threads = cores;
+	options.partition = partition;
+	options.sweeps = sweeps;
+	options.omega = omega;
+	options.cycleShape = cycleShape;
+	options.active = active;
+	options.sync = sync;
+	options.norm = norm;
+	options.checkEvery = checkEvery;
+	options.arithmetic = arithmetic;
+
+	struct ServiceRequest request;
+	serviceRequestInit(&request, planes, rows, cols, &options, maskFile != NULL);
+	size_t cells = (size_t)planes * rows * cols;
+	size_t length = serviceBytes(&request);
+	int loadThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* The array is put straight into memory shared with relaxd, which relaxes it there */
+	int memory = memfd_create("relaxc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	double *values = MAP_FAILED;
+	if (memory >= 0 && ftruncate(memory, length) == 0 && fcntl(memory, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+		values = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+	if (values == MAP_FAILED) {
+		fprintf(stdout, "LOG ERROR - Failed to allocate array of %d x %d. Exiting program", rows, cols);
+		return 1;
+	}
+
+	if (binaryFile) {
+		struct GridMapping mapping = { NULL, 0 };
+		double *file = gridMap(textFile, cells, &mapping);
+		if (file == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to read grid file: %s. Exiting program", textFile);
+			return 1;
+		}
+		memcpy(values, file, cells * sizeof(double));
+		gridUnmap(&mapping);
+	} else if (generateNumbers) {
+		if (seed == 0)
+			seed = rngClockSeed();
+		rngFill(values, 0, cells, seed, 1, 2);
+	} else if (!gridLoadText(textFile, values, cells, loadThreads)) {
+		fprintf(stdout, "LOG ERROR - Failed to read file: %s. Exiting program", textFile);
+		return 1;
+	}
+
+	unsigned char *mask = NULL;
+	if (maskFile != NULL) {
+		mask = (unsigned char*) (values + cells);
+		if (!gridLoadMask(maskFile, mask, (size_t)rows * cols, loadThreads)) {
+			fprintf(stdout, "LOG ERROR - Failed to read mask file: %s. Exiting program", maskFile);
+			return 1;
+		}
+	}
+
+	if (debug >= 1) {
+		if (planes > 1)
+			fprintf(stdout, "LOG FINE - Sending a %d x %d x %d array to relaxd at %s.\n", planes, rows, cols, socketPath);
+		else
+			fprintf(stdout, "LOG FINE - Sending a %d x %d array to relaxd at %s.\n", rows, cols, socketPath);
+		if (generateNumbers)
+			fprintf(stdout, "LOG FINE - Generated values from seed %llu.\n", seed);
+		if (maskFile != NULL)
+			fprintf(stdout, "LOG FINE - Holding the cells set in %s fixed.\n", maskFile);
+	}
+	if (debug >= 2)
+		printArray("Working with array", values, planes, rows, cols);
+
+	struct ServiceReply reply;
+	if (!serviceSend(server, &request, memory) || !serviceReceiveReply(server, &reply)) {
+		fprintf(stdout, "LOG ERROR - Lost relaxd at %s. Exiting program", socketPath);
+		return 1;
+	}
+	close(server);
+	if (!reply.solved) {
+		fprintf(stdout, "LOG ERROR - relaxd couldn't solve the array. Exiting program");
+		return 1;
+	}
+	struct RelaxResult result = reply.result;
+	if (result.stalled)
+		fprintf(stderr, "LOG WARNING - float stopped improving after %d relaxations without reaching precision. -arithmetic mixed goes on in double.\n",
+				result.count);
+
+	if (outputFile != NULL) {
+		int written = outputText ? gridWriteText(outputFile, values, planes * rows, cols, loadThreads)
+								 : gridWrite(outputFile, values, planes * rows, cols);
+		if (!written) {
+			fprintf(stdout, "LOG ERROR - Failed to write output to %s. Exiting program", outputFile);
+			return 1;
+		}
+	}
+
+	double low = 0, high = 0;
+	if (imageFile != NULL
+		&& !gridWriteImage(imageFile, values + (size_t) (planes / 2) * rows * cols, rows, cols, GRID_IMAGE_SIDE, &low, &high)) {
+		fprintf(stdout, "LOG ERROR - Failed to write image to %s. Exiting program", imageFile);
+		return 1;
+	}
+
+	if (debug >= 1) {
+		fprintf(stdout, "LOG FINE - Solved on %d of relaxd's threads.\n", result.threads);
+		if (result.tileRows > 0)
+			fprintf(stdout, "LOG FINE - Partitioned into %d tiles of %dx%d.\n", result.blocks, result.tileRows, result.tileCols);
+		else
+			fprintf(stdout, "LOG FINE - Partitioned into rows.\n");
+		if (result.sweeps > 1)
+			fprintf(stdout, "LOG FINE - Relaxed each tile %d times between precision checks.\n", result.sweeps);
+		if (result.sync == SYNC_NEIGHBOURS)
+			fprintf(stdout, "LOG FINE - Threads only waited for their neighbours, checking convergence behind them.\n");
+		if (result.active)
+			fprintf(stdout, "LOG FINE - Skipped %ld of %ld tile relaxations as settled.\n",
+					result.tilesSkipped, result.tilesRelaxed + result.tilesSkipped);
+		if (result.levelCount > 0)
+			fprintf(stdout, "LOG FINE - Used %d multigrid levels down to dimension %d.\n",
+					result.levelCount, result.coarsestDimension);
+		if (result.method == METHOD_MULTIGRID)
+			fprintf(stdout, "\nLOG FINE - Program complete. Multigrid cycles: %d.\n", result.count);
+		else
+			fprintf(stdout, "\nLOG FINE - Program complete. Relaxation count: %d.\n", result.count);
+		fprintf(stdout, "LOG FINE - Largest change on final relaxation: %.10lf.\n", result.maxDelta);
+		if (result.arithmetic == ARITHMETIC_MIXED)
+			fprintf(stdout, "LOG FINE - %d relaxations in float, then %d in double.\n",
+					result.floatCount, result.count - result.floatCount);
+		if (norm != NORM_MAX || checkEvery != 1)
+			fprintf(stdout, "LOG FINE - Final %s norm %.10lg after %d convergence checks.\n",
+					normName(norm), result.residual, result.checks);
+		if (outputFile != NULL)
+			fprintf(stdout, "LOG FINE - Wrote relaxed array as %s to %s.\n", outputText ? "text" : "a binary grid", outputFile);
+		if (imageFile != NULL)
+			fprintf(stdout, "LOG FINE - Drew %s of values from %.10lf to %.10lf.\n", imageFile, low, high);
+	}
+	if (debug >= 2)
+		printArray("Final array", values, planes, rows, cols);
+
+	munmap(values, length);
+	close(memory);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);	/* mark the end time */
+
+	diff = BILLION * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec;
+	if (debug >= 1) printf("LOG FINE - Completed in %llu Nanoseconds\n",  (long long unsigned int) diff);
+
+	return 0;
+}
+
+/* Prints every value, a row to a line and a blank line between planes, for debugging */
+void printArray(const char *title, const double *values, int planes, int rows, int cols) {
+	int i, j;
+
+	fprintf(stdout, "LOG FINEST - %s:\n", title);
+	for (i = 0; i < planes * rows; i++) {
+		if (i > 0 && i % rows == 0)
+			fprintf(stdout, "\n");
+		for (j = 0; j < cols; j++)
+			fprintf(stdout, "%f ", values[(size_t)i * cols + j]);
+		fprintf(stdout, "\n");
+	}
+}
@@ -0,0 +1,304 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "stencil.h"
+#include "relax.h"
+#include "service.h"
+
+/* A request taken off a connection and handed to the pool, waiting for its reply */
+struct Pending {
+	struct RelaxJob *job; // NULL if the request couldn't be solved
+	void *memory;
+	size_t length;
+};
+
+struct Connection {
+	int socket;
+	struct RelaxPool *pool;
+	int debug;
+};
+
+static atomic_long served;
+static volatile sig_atomic_t stopping = 0;
+
+void* serveConnection(void *);
+struct RelaxJob* submitRequest(struct RelaxPool *, const struct ServiceRequest *, int, struct Pending *);
+void stop(int);
+
+int main(int argc, char *argv[]) {
+
+	/* Values hard coded - ensure to update
+	 * debug - The level of debug output: 0, 1 (a line for each connection), 2 (a line for each grid)
+	 * cores - number of threads in the pool every grid is solved on. Grids relaxc sends without -c
+	 * 			get a share decided from their size, small ones a thread each
+	 * affinity - how threads are pinned to CPUs: compact (fill a socket first), scatter (across sockets), none, or cpuList
+	 * cpuList - CPUs to pin threads to in order, like 0,2,4-7, used when affinity is AFFINITY_LIST
+	 * isa - which version of the stencil to use: scalar, avx2 or avx512. Best supported by default
+	 * socketPath - where to listen for relaxc
+	 */
+
+	int debug = 0; /* Debug output: 0 no detail - 1 some detail - 2 all detail */
+
+	int cores = 4;
+	enum Affinity affinity = AFFINITY_COMPACT;
+	const char *cpuList = NULL;
+	const char *socketPath = SERVICE_SOCKET;
+
+	/* End editable values */
+
+	stencilInit();
+
+	/* Parse command line input */
+	int a;
+	for (a = 1; a < argc; a++) { /* argv[0] is program name */
+		if (strcmp(argv[a], "-c") == 0 || strcmp(argv[a], "-cores") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					cores = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -c. Positive integer required. Using %d cores as default.\n", cores);
+				}
+			}
+		} else if (strcmp(argv[a], "-debug") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) >= 0) {
+					a++;
+					debug = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -debug. Integer >= 0 required. Using %d debug as default.\n", debug);
+				}
+			}
+		} else if (strcmp(argv[a], "-affinity") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				int cpus[RELAX_MAX_CPUS];
+				if (strcmp(argv[a+1], "compact") == 0) {
+					a++;
+					affinity = AFFINITY_COMPACT;
+				} else if (strcmp(argv[a+1], "scatter") == 0) {
+					a++;
+					affinity = AFFINITY_SCATTER;
+				} else if (strcmp(argv[a+1], "none") == 0) {
+					a++;
+					affinity = AFFINITY_NONE;
+				} else if (relaxParseCpuList(argv[a+1], cpus) > 0) {
+					a++;
+					affinity = AFFINITY_LIST;
+					cpuList = argv[a];
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -affinity. compact, scatter, none or a CPU list like 0,2,4-7 required. Using compact as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-isa") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (stencilUse(argv[a+1])) {
+					a++;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -isa. scalar, avx2 or avx512 supported by this CPU required. Using %s as default.\n", stencilName());
+				}
+			}
+		} else if (strcmp(argv[a], "-socket") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				socketPath = argv[a];
+			}
+		}
+	}
+
+	struct sockaddr_un address;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stdout, "LOG ERROR - Socket path is too long: %s. Exiting program", socketPath);
+		return 1;
+	}
+
+	// A socket left behind by a service that died is removed, one still answering is left alone
+	int running = serviceConnect(socketPath);
+	if (running >= 0) {
+		close(running);
+		fprintf(stdout, "LOG ERROR - relaxd is already listening at %s. Exiting program", socketPath);
+		return 1;
+	}
+	unlink(socketPath);
+
+	int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+	if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0
+		|| listen(listener, SOMAXCONN) != 0) {
+		fprintf(stdout, "LOG ERROR - Failed to listen at %s. Exiting program", socketPath);
+		return 1;
+	}
+
+	struct RelaxPool *pool = relaxPoolCreateAffinity(cores, affinity, cpuList);
+	if (pool == NULL) {
+		fprintf(stdout, "LOG ERROR - Failed to start %d threads. Exiting program", cores);
+		unlink(socketPath);
+		return 1;
+	}
+
+	// Without SA_RESTART, so a signal wakes accept up to notice it
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (debug >= 1)
+		fprintf(stdout, "LOG FINE - Listening at %s with %d threads using %s stencil.\n", socketPath, cores, stencilName());
+	fflush(stdout);
+
+	/* Each connection gets a thread of its own to read requests and send replies, all of
+	 * them sharing the one pool */
+	while (!stopping) {
+		int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				fprintf(stderr, "LOG WARNING - Failed to accept a connection: %s.\n", strerror(errno));
+			continue;
+		}
+
+		struct Connection *connection = malloc(sizeof(struct Connection));
+		pthread_t thread;
+		pthread_attr_t attributes;
+		pthread_attr_init(&attributes);
+		pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+		if (connection != NULL) {
+			connection->socket = client;
+			connection->pool = pool;
+			connection->debug = debug;
+		}
+		if (connection == NULL || pthread_create(&thread, &attributes, serveConnection, connection) != 0) {
+			fprintf(stderr, "LOG WARNING - Failed to start a thread for a connection. Closing it.\n");
+			close(client);
+			free(connection);
+		}
+		pthread_attr_destroy(&attributes);
+	}
+
+	/* Connections may still have jobs in the pool, so it's left for the exit to clean up */
+	close(listener);
+	unlink(socketPath);
+	if (debug >= 1)
+		fprintf(stdout, "LOG FINE - Stopped after solving %ld grids.\n", atomic_load(&served));
+
+	return 0;
+}
+
+void stop(int number) {
+	stopping = 1;
+}
+
+/* Reads requests and puts them on the pool for as long as more are waiting on the socket,
+ * up to SERVICE_PIPELINE, so a client that sends a batch has them all solving at once.
+ * Once none are waiting the oldest is waited for and answered */
+void* serveConnection(void *td) {
+	struct Connection *connection = (struct Connection*) td;
+	struct Pending pending[SERVICE_PIPELINE];
+	int first = 0, count = 0, open = 1, grids = 0;
+
+	while (open || count > 0) {
+		struct pollfd waiting = { connection->socket, POLLIN, 0 };
+		if (open && (count == 0 || (count < SERVICE_PIPELINE && poll(&waiting, 1, 0) > 0))) {
+			struct ServiceRequest request;
+			int fd;
+			int received = serviceReceive(connection->socket, &request, &fd);
+			if (received == 0) {
+				open = 0;
+				continue;
+			}
+
+			struct Pending *next = &pending[(first + count) % SERVICE_PIPELINE];
+			next->job = NULL;
+			next->memory = NULL;
+			if (received > 0) {
+				next->job = submitRequest(connection->pool, &request, fd, next);
+				close(fd);
+				if (next->job == NULL)
+					fprintf(stderr, "LOG WARNING - Failed to solve a %dx%dx%d grid, replying with nothing solved.\n",
+							request.planes, request.rows, request.cols);
+				else if (connection->debug >= 2)
+					fprintf(stdout, "LOG FINEST - Solving a %dx%dx%d grid.\n", request.planes, request.rows, request.cols);
+			} else {
+				fprintf(stderr, "LOG WARNING - Received something that isn't a request, replying with nothing solved.\n");
+			}
+			count++;
+			continue;
+		}
+
+		struct Pending *oldest = &pending[first];
+		struct ServiceReply reply;
+		memset(&reply, 0, sizeof(reply));
+		reply.magic = SERVICE_MAGIC;
+		if (oldest->job != NULL) {
+			relaxWait(oldest->job, &reply.result);
+			reply.solved = 1;
+			atomic_fetch_add(&served, 1);
+			grids++;
+		}
+		if (oldest->memory != NULL)
+			munmap(oldest->memory, oldest->length);
+		first = (first + 1) % SERVICE_PIPELINE;
+		count--;
+
+		// A client that has gone away still has its jobs waited for, just not answered
+		if (open && !serviceSendReply(connection->socket, &reply))
+			open = 0;
+	}
+
+	if (connection->debug >= 1)
+		fprintf(stdout, "LOG FINE - Connection closed after %d grids.\n", grids);
+	fflush(stdout);
+	close(connection->socket);
+	free(connection);
+	return NULL;
+}
+
+/* Maps the request's shared memory and queues its grid on the pool, filling in where the
+ * memory is mapped. Returns NULL if the request is bad or memory ran out */
+struct RelaxJob* submitRequest(struct RelaxPool *pool, const struct ServiceRequest *request, int fd,
+							   struct Pending *pending) {
+	struct RelaxOptions options;
+	struct stat info;
+
+	if (!serviceRequestOptions(request, &options))
+		return NULL;
+
+	// Sealed against shrinking, the client can't pull the pages out from under the solve
+	size_t length = serviceBytes(request);
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < length || seals < 0 || !(seals & F_SEAL_SHRINK))
+		return NULL;
+
+	void *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED)
+		return NULL;
+
+	size_t cells = (size_t)request->planes * request->rows * request->cols;
+	if (request->masked)
+		options.mask = (unsigned char*) memory + cells * sizeof(double);
+
+	struct RelaxJob *job = relaxSubmitVolume(pool, memory, request->planes, request->rows, request->cols, &options);
+	if (job == NULL) {
+		munmap(memory, length);
+		return NULL;
+	}
+
+	pending->memory = memory;
+	pending->length = length;
+	return job;
+}
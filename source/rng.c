@@ -0,0 +1,34 @@
+#include <time.h>
+
+#include "rng.h"
+
+#define RNG_GOLDEN 0x9E3779B97F4A7C15ULL /* 2^64 over the golden ratio, odd */
+
+static uint64_t rngMix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t rngBits(uint64_t seed, uint64_t index) {
+	// Scrambling the seed first keeps grids from nearby seeds from being shifted copies
+	return rngMix(rngMix(seed) + (index + 1) * RNG_GOLDEN);
+}
+
+double rngUniform(uint64_t seed, uint64_t index, double low, double high) {
+	// The top 53 bits, as many as a double holds
+	double f = (double)(rngBits(seed, index) >> 11) * (1.0 / 9007199254740992.0);
+	return low + f * (high - low);
+}
+
+void rngFill(double *values, size_t first, size_t count, uint64_t seed, double low, double high) {
+	size_t i;
+	for (i = 0; i < count; i++)
+		values[i] = rngUniform(seed, first + i, low, high);
+}
+
+uint64_t rngClockSeed(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return rngMix((uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+}
@@ -0,0 +1,27 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Counter based random numbers. Rather than stepping a shared state, the number for a
+ * cell is worked out from the seed and the cell's index alone (SplitMix64: the index
+ * times a large odd constant, added to a key made from the seed, then scrambled). Any
+ * thread can make any part of a grid, in any order, and a seed always gives the same grid
+ * however many threads made it.
+ */
+
+/* 64 random bits for cell index of the grid made from seed */
+uint64_t rngBits(uint64_t seed, uint64_t index);
+
+/* A value in [low, high) for cell index of the grid made from seed */
+double rngUniform(uint64_t seed, uint64_t index, double low, double high);
+
+/* Fills values[0] up to values[count - 1] with the values for cells first up to
+ * first + count - 1 */
+void rngFill(double *values, size_t first, size_t count, uint64_t seed, double low, double high);
+
+/* A seed from the clock, for when none is given */
+uint64_t rngClockSeed(void);
+
+#endif
@@ -4,13 +4,19 @@
 #include <math.h>
 #include <time.h>
 #include <stdint.h>
+#include <unistd.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "convergence.h"
+#include "rng.h"
 
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
 #define BILLION 1000000000L
 
-double fRand(double, double);
+double residualNorm(double *, int, int, const unsigned char *, const unsigned char *);
 void setValue(int, int);
 
 int main(int argc, char *argv[]) {
@@ -19,21 +25,48 @@ int main(int argc, char *argv[]) {
 	 * debug - The level of debug output: 0, 1, 2
 	 * cores - number of cores to use for the program
 	 * dimension - how big the square array is
+	 * rows, cols - how many rows and columns the array has, to make it rectangular. 0 to use dimension
 	 * precision - how precise the relaxation needs to be before the program ends
+	 * isa - which version of the stencil to use: scalar, avx2 or avx512. Best supported by default
+	 * method - jacobi (two arrays), gs (red-black Gauss-Seidel in place) or sor (red-black over-relaxation in place)
+	 * omega - how far sor moves each cell past the average of its neighbours, 0 to estimate it from the dimension
+	 * norm - what has to fall below precision: max (largest change), l2 (residual) or relative (residual over starting residual)
+	 * checkEvery - relaxations between convergence checks, 0 to adapt as the solve goes. Can overshoot by up to checkEvery - 1
+	 * maskFile - text or binary grid file with a nonzero value for each cell to hold fixed along with the
+	 * 				outer ring, NULL for just the ring
+	 * outputFile - where to write the relaxed array, NULL for nowhere. A binary grid file, like -f reads,
+	 * 				or text with a line per row if outputText is 1
+	 * outputText - 0 for a binary grid file, 1 for text to GRID_TEXT_DECIMALS places
 	 *
 	 * generateNumbers - 0 to use values in setValues[][], 1 to generate them randomly
-	 * textFile[] - text file to read numbers from. Needs to be set and filled in if generateNumbers == 0
+	 * seed - what the random values are made from, the same seed giving the same array as parallel
+	 * 				and distributed. 0 to pick one from the clock
+	 * textFile - text or binary grid file (see gridio.h) to read numbers from. Needs to be set and filled in if generateNumbers == 0
 	 */
 
 	int debug = 0; /* Debug output: 0 no detail - 1 some detail - 2 all detail */
 
 	int cores = 1; 
 	int dimension = 10;
+	int rows = 0;
+	int cols = 0;
 	double precision = 0.0001;
 
+	enum Method method = METHOD_JACOBI;
+	double omega = 0;
+
+	enum Norm norm = NORM_MAX;
+	int checkEvery = 1;
+
+	const char *maskFile = NULL;
+
+	const char *outputFile = NULL;
+	int outputText = 0;
+
 	int generateNumbers = 0;
+	unsigned long long seed = 0;
 	// textFile needs to be set and filled in if generateNumbers == 0
-	char textFile[] = "values.txt";
+	const char *textFile = "values.txt";
 	
 	/* End editable values */
 
@@ -41,6 +74,8 @@ int main(int argc, char *argv[]) {
 	struct timespec start, end;
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
+	stencilInit();
+
 	/* Parse command line input */
 	int a;
 	for (a = 1; a < argc; a++) { /* argv[0] is program name */
@@ -62,6 +97,46 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "LOG WARNING - Invalid argument for -d. Positive integer required. Using %d dimension as default.\n", dimension);
 				}
 			}
+		} else if (strcmp(argv[a], "-rows") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					rows = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -rows. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-cols") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atoi(argv[a+1]) > 0) {
+					a++;
+					cols = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -cols. Positive integer required. Using dimension as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-mask") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				maskFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-o") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				a++;
+				outputFile = argv[a];
+			}
+		} else if (strcmp(argv[a], "-oformat") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "binary") == 0) {
+					a++;
+					outputText = 0;
+				} else if (strcmp(argv[a+1], "text") == 0) {
+					a++;
+					outputText = 1;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -oformat. binary or text required. Using binary as default.\n");
+				}
+			}
 		} else if (strcmp(argv[a], "-p") == 0 || strcmp(argv[a], "-precision") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
 				if (atof(argv[a+1]) > 0.0) {
@@ -80,10 +155,78 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "LOG WARNING - Invalid argument for -g. Integer >= 0 required. Using %d dimension as default.\n", dimension);
 				}
 			}
+		} else if (strcmp(argv[a], "-seed") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strtoull(argv[a+1], NULL, 10) > 0) {
+					a++;
+					seed = strtoull(argv[a], NULL, 10);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -seed. Positive integer required. Using a seed from the clock as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-method") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "jacobi") == 0) {
+					a++;
+					method = METHOD_JACOBI;
+				} else if (strcmp(argv[a+1], "gs") == 0) {
+					a++;
+					method = METHOD_GAUSS_SEIDEL;
+				} else if (strcmp(argv[a+1], "sor") == 0) {
+					a++;
+					method = METHOD_SOR;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -method. jacobi, gs or sor required. Using jacobi as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-omega") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (atof(argv[a+1]) >= 0.0 && atof(argv[a+1]) < 2.0) {
+					a++;
+					omega = atof(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -omega. Double from 0 up to 2 required. Estimating omega as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-norm") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "max") == 0) {
+					a++;
+					norm = NORM_MAX;
+				} else if (strcmp(argv[a+1], "l2") == 0) {
+					a++;
+					norm = NORM_L2;
+				} else if (strcmp(argv[a+1], "relative") == 0) {
+					a++;
+					norm = NORM_RELATIVE;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -norm. max, l2 or relative required. Using max as default.\n");
+				}
+			}
+		} else if (strcmp(argv[a], "-check") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (strcmp(argv[a+1], "adaptive") == 0) {
+					a++;
+					checkEvery = 0;
+				} else if (atoi(argv[a+1]) > 0) {
+					a++;
+					checkEvery = atoi(argv[a]);
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -check. Positive integer or adaptive required. Using %d check as default.\n", checkEvery);
+				}
+			}
+		} else if (strcmp(argv[a], "-isa") == 0) {
+			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
+				if (stencilUse(argv[a+1])) {
+					a++;
+				} else {
+					fprintf(stderr, "LOG WARNING - Invalid argument for -isa. scalar, avx2 or avx512 supported by this CPU required. Using %s as default.\n", stencilName());
+				}
+			}
 		} else if (strcmp(argv[a], "-f") == 0 || strcmp(argv[a], "-filepath") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
 				a++;
-				strncpy(textFile, argv[a], sizeof(textFile));
+				textFile = argv[a];
 			}
 		} else if (strcmp(argv[a], "-debug") == 0) {
 			if (a + 1 <= argc - 1) { /* Make sure we have more arguments */
@@ -99,55 +242,124 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	FILE *valueFile;
+	if (rows == 0) rows = dimension;
+	if (cols == 0) cols = dimension;
+	if (rows < 3) rows = 3;
+	if (cols < 3) cols = 3;
+
+	int binaryFile = 0;
 
 	if (!generateNumbers) {
-		valueFile = fopen(textFile, "r");
-		if (valueFile == NULL) {
+		binaryFile = gridIsBinary(textFile);
+		if (!binaryFile && access(textFile, R_OK) != 0) {
 			fprintf(stdout, "LOG ERROR - Failed to open file: %s. Exiting program", textFile);
 			return 1;
 		}
 	}
 
-	/* Set up two arrays, one to store current results & one to store changes */
-	double *values = malloc(dimension * dimension * sizeof(double));
-	double *newValues = malloc(dimension * dimension * sizeof(double));
-	
-	srand((unsigned)time(NULL));
+	/* Set up two arrays, one to store current results & one to store changes.
+	 * Gauss-Seidel and SOR change values in place so only need the one.
+	 * Binary files are mapped straight in as the first array */
+	struct GridMapping mapping = { NULL, 0 };
+	double *values;
+	if (binaryFile) {
+		values = gridMap(textFile, (size_t)rows * cols, &mapping);
+		if (values == NULL) {
+			fprintf(stdout, "LOG ERROR - Failed to read grid file: %s. Exiting program", textFile);
+			return 1;
+		}
+	} else {
+		values = malloc((size_t)rows * cols * sizeof(double));
+	}
+	double *newValues = NULL;
+	if (method == METHOD_JACOBI)
+		newValues = malloc((size_t)rows * cols * sizeof(double));
+
+	/* Rows with no fixed cells keep the plain stencil, so a mask only costs where it fixes something */
+	unsigned char *mask = NULL;
+	unsigned char *maskedRows = NULL;
+	if (maskFile != NULL) {
+		mask = malloc((size_t)rows * cols);
+		maskedRows = calloc(rows, 1);
+		if (mask == NULL || maskedRows == NULL || !gridLoadMask(maskFile, mask, (size_t)rows * cols, 1)) {
+			fprintf(stdout, "LOG ERROR - Failed to read mask file: %s. Exiting program", maskFile);
+			return 1;
+		}
+	}
+
+	// Remember which is which, as they get swapped around while relaxing
+	double *firstArray = values;
+	double *secondArray = newValues;
 
 	/* Put numbers into the value arrays */
 	int i, j;
-	for (i = 0; i < dimension; i++) {
-		for (j = 0; j < dimension; j++) {
-			// If we're going to generate the numbers, or use predetermined ones
-			if (generateNumbers)
-				values[i*dimension+j] = fRand(1, 2);
-			else
-				fscanf(valueFile, "%lf", &values[i*dimension+j] );
-			// And copy them to the new array as well
-			newValues[i*dimension+j] = values[i*dimension+j];
+	if (!generateNumbers && !binaryFile) {
+		// Text is parsed on this one thread straight into the array
+		if (!gridLoadText(textFile, values, (size_t)rows * cols, 1)) {
+			fprintf(stdout, "LOG ERROR - Failed to read file: %s. Exiting program", textFile);
+			return 1;
+		}
+	}
+
+	if (generateNumbers) {
+		if (seed == 0)
+			seed = rngClockSeed();
+		rngFill(values, 0, (size_t)rows * cols, seed, 1, 2);
+	}
+
+	if (mask != NULL) {
+		for (i = 1; i < rows - 1; i++) {
+			for (j = 1; j < cols - 1; j++)
+				maskedRows[i] |= mask[i*cols+j] != 0;
 		}
 	}
+
+	// And copy them to the new array as well
+	if (newValues != NULL)
+		memcpy(newValues, values, (size_t)rows * cols * sizeof(double));
 	if (precision < 0.0000000001) precision = 0.0000000001;
-	if (dimension < 3) dimension = 3;
+	if (method == METHOD_GAUSS_SEIDEL) omega = 1;
+	if (method == METHOD_SOR && omega == 0) omega = optimalOmega(rows, cols);
 	
 	if (debug >= 1) {
 		fprintf(stdout, "LOG FINE - Using %d cores.\n", cores);
-		fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", dimension);
+		if (rows == cols)
+			fprintf(stdout, "LOG FINE - Using array of dimension %d.\n", rows);
+		else
+			fprintf(stdout, "LOG FINE - Using array of %d rows and %d columns.\n", rows, cols);
+		if (mask != NULL)
+			fprintf(stdout, "LOG FINE - Holding the cells set in %s fixed.\n", maskFile);
+		if (generateNumbers)
+			fprintf(stdout, "LOG FINE - Generated values from seed %llu.\n", seed);
 		fprintf(stdout, "LOG FINE - Working to precision of %.10lf.\n", precision);
+		fprintf(stdout, "LOG FINE - Using %s stencil.\n", stencilName());
+		if (method == METHOD_JACOBI)
+			fprintf(stdout, "LOG FINE - Using Jacobi relaxation.\n");
+		else if (method == METHOD_GAUSS_SEIDEL)
+			fprintf(stdout, "LOG FINE - Using red-black Gauss-Seidel relaxation.\n");
+		else
+			fprintf(stdout, "LOG FINE - Using red-black SOR relaxation with omega %.6lf.\n", omega);
+		if (checkEvery == 0)
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked adaptively.\n", normName(norm));
+		else
+			fprintf(stdout, "LOG FINE - Stopping on %s norm, checked every %d relaxations.\n", normName(norm), checkEvery);
 	}
 
 	int count = 0; // Count how many times we try to relax the square array
-	int withinPrecision = 0; // 1 when pass entirely completed within precision, i.e. finished
+	int withinPrecision = 0; // 1 when a checked pass came in within precision, i.e. finished
+	struct Convergence convergence;
+	convergenceInit(&convergence, norm, precision, checkEvery);
+	if (norm == NORM_RELATIVE)
+		convergence.initial = residualNorm(values, rows, cols, mask, maskedRows);
 
 	if (debug >= 2) {
 	/* Display initial array for debugging */
 		fprintf(stdout, "LOG FINEST - Working with array:\n");
-		for (i = 0; i < dimension; i++) {
-			for (j = 0; j < dimension; j++) {
-				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
+		for (i = 0; i < rows; i++) {
+			for (j = 0; j < cols; j++) {
+				if (i == 0 || i == rows-1 || j == 0 || j == cols -1 || (mask != NULL && mask[i*cols+j]))
 					fprintf(stdout, ANSI_COLOR_RED);
-				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*cols+j]);
 			}
 			fprintf(stdout, "\n");
 		}
@@ -155,42 +367,88 @@ int main(int argc, char *argv[]) {
 
 	while (!withinPrecision) {
 		count++;
-		withinPrecision = 1;
-		// Outside line of square array will remain static so skip it
-		for (i = 1; i < dimension - 1; i++) { // Skip top and bottom
-			for (j = 1; j < dimension - 1; j++) { // Skip left and right
-				// Store relaxed number into new array
-				newValues[i*dimension+j] = (values[(i-1)*dimension+j] + values[(i+1)*dimension+j] 
-							  + values[i*dimension+(j-1)] + values[i*dimension+(j+1)]) / 4.0;
-				/* If the numbers changed more than precision, we need to do it again */
-				if (fabs(values[i*dimension+j] - newValues[i*dimension+j]) > precision) {
-					withinPrecision = 0;
+		double maxDelta = 0; // Largest change this relaxation
+
+		if (method != METHOD_JACOBI) {
+			/* Relax all the red cells ((i + j) even) in place, then all the black ones.
+			 * Each colour only reads the other, so the order within a colour doesn't matter */
+			int colour;
+			for (colour = 0; colour < 2; colour++) {
+				for (i = 1; i < rows - 1; i++) {
+					int first = (i + 1) % 2 == colour ? 1 : 2;
+					double delta;
+					if (maskedRows != NULL && maskedRows[i])
+						delta = relaxRowColourMasked(values + i*cols, values + (i-1)*cols, values + (i+1)*cols,
+													 mask + i*cols, first, cols - 1, omega);
+					else
+						delta = relaxRowColour(values + i*cols, values + (i-1)*cols,
+											   values + (i+1)*cols, first, cols - 1, omega);
+					if (delta > maxDelta)
+						maxDelta = delta;
 				}
 			}
+		} else {
+			// Outside line of square array will remain static so skip it
+			for (i = 1; i < rows - 1; i++) { // Skip top and bottom
+				// Store relaxed row into new array, skipping left and right
+				double delta;
+				if (maskedRows != NULL && maskedRows[i])
+					delta = relaxRowMasked(values + i*cols, values + (i-1)*cols, values + (i+1)*cols,
+										   newValues + i*cols, mask + i*cols, 1, cols - 1);
+				else
+					delta = relaxRow(values + i*cols, values + (i-1)*cols, values + (i+1)*cols,
+									 newValues + i*cols, 1, cols - 1);
+				if (delta > maxDelta)
+					maxDelta = delta;
+			}
+			// Swap pointers, so we can continue working on the new array
+			double *tempValues = values;
+			values = newValues;
+			newValues = tempValues;
 		}
-		// Swap pointers, so we can continue working on the new array
-		double *tempValues = values;
-		values = newValues;
-		newValues = tempValues;
+
+		/* If the numbers changed more than precision, we need to do it again */
+		if (convergenceDue(&convergence, count))
+			withinPrecision = convergenceCheck(&convergence, count,
+											   norm == NORM_MAX ? maxDelta : residualNorm(values, rows, cols, mask, maskedRows));
 	}
 	/* Switch the pointers around to move the new list to the currently active list */
 
 	if (debug >= 1) 
 		fprintf(stdout, "\nLOG FINE - Program complete. Relaxation count: %d.\n", count);
+	if (debug >= 1 && (norm != NORM_MAX || checkEvery != 1))
+		fprintf(stdout, "LOG FINE - Final %s norm %.10lg after %d convergence checks.\n",
+				normName(norm), convergenceValue(&convergence), convergence.checks);
+	if (outputFile != NULL) {
+		int written = outputText ? gridWriteText(outputFile, values, rows, cols, cores)
+								 : gridWrite(outputFile, values, rows, cols);
+		if (!written) {
+			fprintf(stdout, "LOG ERROR - Failed to write output to %s. Exiting program", outputFile);
+			return 1;
+		}
+		if (debug >= 1)
+			fprintf(stdout, "LOG FINE - Wrote relaxed array as %s to %s.\n", outputText ? "text" : "a binary grid", outputFile);
+	}
+
 	if (debug >= 2) {
 		fprintf(stdout, "LOG FINEST - Final array:\n");
-		for (i = 0; i < dimension; i++) {
-			for (j = 0; j < dimension; j++) {
-				if (i == 0 || i == dimension-1 || j == 0 || j == dimension -1)
+		for (i = 0; i < rows; i++) {
+			for (j = 0; j < cols; j++) {
+				if (i == 0 || i == rows-1 || j == 0 || j == cols -1 || (mask != NULL && mask[i*cols+j]))
 					fprintf(stdout, ANSI_COLOR_RED);
-				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*dimension+j]);
+				fprintf(stdout, "%f " ANSI_COLOR_RESET, values[i*cols+j]);
 			}
 			fprintf(stdout, "\n");
 		}
 	}
 
-	free(values);
-	free(newValues);
+	if (mapping.base != NULL)
+		gridUnmap(&mapping);
+	else
+		free(firstArray);
+	free(secondArray);
+	free(mask);
+	free(maskedRows);
 
 	fprintf(stdout, "Program complete.\n");
 
@@ -200,9 +458,19 @@ int main(int argc, char *argv[]) {
 	printf("elapsed time = %llu nanoseconds\n", (long long unsigned int) diff);
 }
 
-double fRand(double fMin, double fMax) {
-    double f = (double)rand() / RAND_MAX;
-    return fMin + f * (fMax - fMin);
+/* Square root of the sum of squared residuals over the inside of the array, leaving out
+ * any cells fixed by mask */
+double residualNorm(double *values, int rows, int cols, const unsigned char *mask, const unsigned char *maskedRows) {
+	double sum = 0;
+	int i;
+	for (i = 1; i < rows - 1; i++) {
+		if (maskedRows != NULL && maskedRows[i])
+			sum += residualSquaresMasked(values + i*cols, values + (i-1)*cols, values + (i+1)*cols,
+										 mask + i*cols, 1, cols - 1);
+		else
+			sum += residualSquares(values + i*cols, values + (i-1)*cols, values + (i+1)*cols, 1, cols - 1);
+	}
+	return sqrt(sum);
 }
 
 /* Image 2 threads
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "service.h"
+
+size_t serviceBytes(const struct ServiceRequest *request) {
+	size_t cells = (size_t)request->rows * request->cols;
+	return (size_t)request->planes * cells * sizeof(double) + (request->masked ? cells : 0);
+}
+
+void serviceRequestInit(struct ServiceRequest *request, int planes, int rows, int cols,
+						const struct RelaxOptions *options, int masked) {
+	memset(request, 0, sizeof(struct ServiceRequest));
+	request->magic = SERVICE_MAGIC;
+	request->planes = planes;
+	request->rows = rows;
+	request->cols = cols;
+	request->masked = masked;
+	request->method = options->method;
+	request->norm = options->norm;
+	request->checkEvery = options->checkEvery;
+	request->threads = options->threads;
+	request->partition = options->partition;
+	request->sweeps = options->sweeps;
+	request->cycleShape = options->cycleShape;
+	request->arithmetic = options->arithmetic;
+	request->active = options->active;
+	request->sync = options->sync;
+	request->precision = options->precision;
+	request->omega = options->omega;
+}
+
+int serviceRequestOptions(const struct ServiceRequest *request, struct RelaxOptions *options) {
+	// Anything could arrive on the socket, so check it all before the pool sees it
+	if (request->magic != SERVICE_MAGIC || request->rows < 1 || request->cols < 1
+		|| (request->planes != 1 && request->planes < 3) || (request->masked && request->planes != 1)
+		|| request->method < METHOD_JACOBI || request->method > METHOD_MULTIGRID
+		|| request->norm < NORM_MAX || request->norm > NORM_RELATIVE
+		|| request->arithmetic < ARITHMETIC_DOUBLE || request->arithmetic > ARITHMETIC_MIXED
+		|| request->partition < PARTITION_ROWS || request->partition > PARTITION_TILES
+		|| request->sync < SYNC_GLOBAL || request->sync > SYNC_NEIGHBOURS
+		|| request->checkEvery < 0 || request->threads < 0 || request->sweeps < 1
+		|| request->cycleShape < 1 || request->cycleShape > 2 || (request->active != 0 && request->active != 1)
+		|| !(request->precision > 0) || !isfinite(request->precision)
+		|| !(request->omega >= 0 && request->omega < 2)
+		|| (size_t)request->rows * request->cols > SIZE_MAX / sizeof(double) / 2 / request->planes)
+		return 0;
+
+	relaxOptionsInit(options);
+	options->method = request->method;
+	options->norm = request->norm;
+	options->checkEvery = request->checkEvery;
+	options->threads = request->threads;
+	options->partition = request->partition;
+	options->sweeps = request->sweeps;
+	options->cycleShape = request->cycleShape;
+	options->arithmetic = request->arithmetic;
+	options->active = request->active;
+	options->sync = request->sync;
+	options->precision = request->precision;
+	options->omega = request->omega;
+	return 1;
+}
+
+int serviceConnect(const char *path) {
+	struct sockaddr_un address;
+
+	if (strlen(path) >= sizeof(address.sun_path))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	if (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Sequenced packets keep each request and reply whole, so one send or receive is always
+ * all of it, and the descriptor rides along with the request it belongs to */
+int serviceSend(int socket, const struct ServiceRequest *request, int fd) {
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec part = { (void*) request, sizeof(struct ServiceRequest) };
+	struct msghdr message;
+
+	memset(&message, 0, sizeof(message));
+	memset(control, 0, sizeof(control));
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+	return sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(struct ServiceRequest);
+}
+
+int serviceReceive(int socket, struct ServiceRequest *request, int *fd) {
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec part = { request, sizeof(struct ServiceRequest) };
+	struct msghdr message;
+
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	*fd = -1;
+	ssize_t got = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+	if (got <= 0)
+		return 0;
+
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+		&& header->cmsg_len == CMSG_LEN(sizeof(int)))
+		memcpy(fd, CMSG_DATA(header), sizeof(int));
+
+	if (got != sizeof(struct ServiceRequest) || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || *fd < 0) {
+		if (*fd >= 0)
+			close(*fd);
+		*fd = -1;
+		return -1;
+	}
+
+	return 1;
+}
+
+int serviceSendReply(int socket, const struct ServiceReply *reply) {
+	return send(socket, reply, sizeof(struct ServiceReply), MSG_NOSIGNAL) == sizeof(struct ServiceReply);
+}
+
+int serviceReceiveReply(int socket, struct ServiceReply *reply) {
+	return recv(socket, reply, sizeof(struct ServiceReply), 0) == sizeof(struct ServiceReply)
+		   && reply->magic == SERVICE_MAGIC;
+}
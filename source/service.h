@@ -0,0 +1,68 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "relax.h"
+
+/* The solve service. relaxd keeps a pool of threads (see relax.h) running and solves
+ * grids sent to it over a Unix domain socket, so a solve pays for neither starting a
+ * process nor creating threads. relaxc is a client taking the same flags as parallel.
+ *
+ * Grids travel in shared memory, never through the socket. The client makes a memfd,
+ * puts the values in it, seals it so it can't shrink, and sends its descriptor along
+ * with the request. The service maps it and relaxes the values where they are, then
+ * replies with the RelaxResult, by which time the relaxed values are already in the
+ * client's own mapping. The memory holds planes*rows*cols doubles, then with a mask
+ * rows*cols bytes of it.
+ *
+ * A connection carries any number of requests, and a client can send several before
+ * reading any replies. The service queues up to SERVICE_PIPELINE of them on the pool
+ * at once, where small grids get a thread each and run side by side, and replies in
+ * the order the requests came.
+ */
+
+#define SERVICE_SOCKET "/tmp/relaxd.sock"
+#define SERVICE_MAGIC 0x44584c52 /* "RLXD" */
+#define SERVICE_PIPELINE 64
+
+struct ServiceRequest {
+	uint32_t magic;
+	int32_t planes, rows, cols;
+	int32_t masked; // 1 if a mask follows the values
+	int32_t method, norm, checkEvery, threads, partition, sweeps, cycleShape, arithmetic, active, sync;
+	double precision, omega;
+};
+
+struct ServiceReply {
+	uint32_t magic;
+	int32_t solved; // 0 if the request was bad or the service ran out of memory
+	struct RelaxResult result;
+};
+
+/* Bytes of shared memory a request needs */
+size_t serviceBytes(const struct ServiceRequest *request);
+
+/* Fills in request from options for a planes x rows x cols grid */
+void serviceRequestInit(struct ServiceRequest *request, int planes, int rows, int cols,
+						const struct RelaxOptions *options, int masked);
+
+/* The options a request asks for. Returns 0 if it isn't a request relaxd can solve */
+int serviceRequestOptions(const struct ServiceRequest *request, struct RelaxOptions *options);
+
+/* Connects to the service listening at path. Returns the socket, or -1 */
+int serviceConnect(const char *path);
+
+/* Sends request with the shared memory descriptor fd. Returns 0 on failure */
+int serviceSend(int socket, const struct ServiceRequest *request, int fd);
+
+/* Receives a request and its descriptor. Returns 1, 0 once the connection has closed or
+ * failed, or -1 if what came wasn't a request */
+int serviceReceive(int socket, struct ServiceRequest *request, int *fd);
+
+/* Both return 0 on failure */
+int serviceSendReply(int socket, const struct ServiceReply *reply);
+int serviceReceiveReply(int socket, struct ServiceReply *reply);
+
+#endif
@@ -0,0 +1,676 @@
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STENCIL_X86
+#endif
+
+#include "stencil.h"
+
+/* Keep a * b + c as a multiply then an add even where the CPU has fused multiply-add,
+ * so every version rounds the same way */
+#pragma GCC optimize ("fp-contract=off")
+
+RelaxRowFunction relaxRow;
+RelaxRowColourFunction relaxRowColour;
+RelaxRowFloatFunction relaxRowFloat;
+RelaxRowColourFloatFunction relaxRowColourFloat;
+RelaxRowVolumeFunction relaxRowVolume;
+static const char *relaxRowName;
+
+static double relaxRowScalar(const double *current, const double *above, const double *below,
+							 double *relaxed, int colStart, int colEnd) {
+	double maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		// Set the new value to the average of the neighbouring values
+		relaxed[col] = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0;
+
+		double delta = fabs(current[col] - relaxed[col]);
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+static double relaxRowColourScalar(double *current, const double *above, const double *below,
+								   int colStart, int colEnd, double omega) {
+	double maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col += 2) {
+		double average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0;
+		double relaxed = (1 - omega) * current[col] + omega * average;
+
+		double delta = fabs(current[col] - relaxed);
+		if (delta > maxDelta)
+			maxDelta = delta;
+		current[col] = relaxed;
+	}
+
+	return maxDelta;
+}
+
+/* The float versions are the double ones with every constant a float too, so nothing is
+ * widened to double part way through */
+static float relaxRowFloatScalar(const float *current, const float *above, const float *below,
+								 float *relaxed, int colStart, int colEnd) {
+	float maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		relaxed[col] = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f;
+
+		float delta = fabsf(current[col] - relaxed[col]);
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+static float relaxRowColourFloatScalar(float *current, const float *above, const float *below,
+									   int colStart, int colEnd, float omega) {
+	float maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col += 2) {
+		float average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f;
+		float relaxed = (1 - omega) * current[col] + omega * average;
+
+		float delta = fabsf(current[col] - relaxed);
+		if (delta > maxDelta)
+			maxDelta = delta;
+		current[col] = relaxed;
+	}
+
+	return maxDelta;
+}
+
+/* The 7 point stencil of a 3D array. Dividing by 6 isn't exact as a multiply, so the
+ * vector versions divide too */
+static double relaxRowVolumeScalar(const double *current, const double *above, const double *below,
+								   const double *front, const double *back, double *relaxed, int colStart, int colEnd) {
+	double maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		relaxed[col] = (above[col] + below[col] + current[col-1] + current[col+1] + front[col] + back[col]) / 6.0;
+
+		double delta = fabs(current[col] - relaxed[col]);
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+#ifdef STENCIL_X86
+
+/* The vector versions add the neighbours in the same order as the scalar one and
+ * multiply by 0.25 rather than divide by 4, which rounds identically, so results
+ * are bit for bit the same. max takes the old maximum when delta is NaN, matching
+ * the > comparison in the scalar version. */
+
+__attribute__((target("avx2")))
+static double relaxRowAvx2(const double *current, const double *above, const double *below,
+						   double *relaxed, int colStart, int colEnd) {
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	const __m256d signBit = _mm256_set1_pd(-0.0);
+	__m256d maxDeltas = _mm256_setzero_pd();
+	int col = colStart;
+
+	for (; col + 4 <= colEnd; col += 4) {
+		__m256d centre = _mm256_loadu_pd(current + col);
+		__m256d sum = _mm256_add_pd(_mm256_loadu_pd(above + col), _mm256_loadu_pd(below + col));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(current + col - 1));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(current + col + 1));
+		__m256d average = _mm256_mul_pd(sum, quarter);
+		_mm256_storeu_pd(relaxed + col, average);
+
+		__m256d delta = _mm256_andnot_pd(signBit, _mm256_sub_pd(centre, average));
+		maxDeltas = _mm256_max_pd(delta, maxDeltas);
+	}
+
+	__m128d pair = _mm_max_pd(_mm256_castpd256_pd128(maxDeltas), _mm256_extractf128_pd(maxDeltas, 1));
+	pair = _mm_max_sd(pair, _mm_unpackhi_pd(pair, pair));
+	double maxDelta = _mm_cvtsd_f64(pair);
+
+	// GCC leaves the upper halves dirty going into the plain SSE tail, which costs every row
+	_mm256_zeroupper();
+	double tailDelta = relaxRowScalar(current, above, below, relaxed, col, colEnd);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+/* Red-black works on every other cell, so each vector covers twice as many columns as it
+ * relaxes cells, and only the even lanes are stored. Masked stores never write the other
+ * lanes, which neighbouring threads may be reading.
+ *
+ * The row is loaded once and the left and right neighbours are shifted out of the vector
+ * and the one before it. Loading them from current + col - 1 would overlap the masked
+ * store just made, which can't be forwarded, and stalls every step. Nothing past colEnd
+ * is read either. The upper halves are cleared before the scalar tail, which is plain
+ * SSE and would otherwise pay for the switch on every row. */
+__attribute__((target("avx2")))
+static double relaxRowColourAvx2(double *current, const double *above, const double *below,
+								 int colStart, int colEnd, double omega) {
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	const __m256d signBit = _mm256_set1_pd(-0.0);
+	const __m256d keep = _mm256_set1_pd(1 - omega);
+	const __m256d move = _mm256_set1_pd(omega);
+	const __m256i lanes = _mm256_set_epi64x(0, -1, 0, -1);
+	__m256d maxDeltas = _mm256_setzero_pd();
+	int col = colStart;
+
+	// Only the top lane of the vector before is used, the left neighbour of the first cell
+	__m256d before = _mm256_set1_pd(current[colStart - 1]);
+
+	for (; col + 3 <= colEnd; col += 4) {
+		__m256d centre = _mm256_loadu_pd(current + col);
+		__m256d left = _mm256_shuffle_pd(_mm256_permute2f128_pd(before, centre, 0x21), centre, 0x5);
+		__m256d right = _mm256_permute4x64_pd(centre, 0x39);
+		__m256d sum = _mm256_add_pd(_mm256_loadu_pd(above + col), _mm256_loadu_pd(below + col));
+		sum = _mm256_add_pd(sum, left);
+		sum = _mm256_add_pd(sum, right);
+		__m256d average = _mm256_mul_pd(sum, quarter);
+		__m256d relaxed = _mm256_add_pd(_mm256_mul_pd(keep, centre), _mm256_mul_pd(move, average));
+		_mm256_maskstore_pd(current + col, lanes, relaxed);
+		before = centre;
+
+		__m256d delta = _mm256_andnot_pd(signBit, _mm256_sub_pd(centre, relaxed));
+		delta = _mm256_and_pd(delta, _mm256_castsi256_pd(lanes));
+		maxDeltas = _mm256_max_pd(delta, maxDeltas);
+	}
+
+	__m128d pair = _mm_max_pd(_mm256_castpd256_pd128(maxDeltas), _mm256_extractf128_pd(maxDeltas, 1));
+	pair = _mm_max_sd(pair, _mm_unpackhi_pd(pair, pair));
+	double maxDelta = _mm_cvtsd_f64(pair);
+
+	_mm256_zeroupper();
+	double tailDelta = relaxRowColourScalar(current, above, below, col, colEnd, omega);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx512f")))
+static double relaxRowAvx512(const double *current, const double *above, const double *below,
+							 double *relaxed, int colStart, int colEnd) {
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	__m512d maxDeltas = _mm512_setzero_pd();
+	int col = colStart;
+
+	for (; col + 8 <= colEnd; col += 8) {
+		__m512d centre = _mm512_loadu_pd(current + col);
+		__m512d sum = _mm512_add_pd(_mm512_loadu_pd(above + col), _mm512_loadu_pd(below + col));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(current + col - 1));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(current + col + 1));
+		__m512d average = _mm512_mul_pd(sum, quarter);
+		_mm512_storeu_pd(relaxed + col, average);
+
+		__m512d delta = _mm512_abs_pd(_mm512_sub_pd(centre, average));
+		maxDeltas = _mm512_max_pd(delta, maxDeltas);
+	}
+
+	// Finish the row with masked loads and stores rather than a scalar loop
+	if (col < colEnd) {
+		__mmask8 mask = (__mmask8) ((1u << (colEnd - col)) - 1);
+		__m512d centre = _mm512_maskz_loadu_pd(mask, current + col);
+		__m512d sum = _mm512_add_pd(_mm512_maskz_loadu_pd(mask, above + col),
+									_mm512_maskz_loadu_pd(mask, below + col));
+		sum = _mm512_add_pd(sum, _mm512_maskz_loadu_pd(mask, current + col - 1));
+		sum = _mm512_add_pd(sum, _mm512_maskz_loadu_pd(mask, current + col + 1));
+		__m512d average = _mm512_mul_pd(sum, quarter);
+		_mm512_mask_storeu_pd(relaxed + col, mask, average);
+
+		__m512d delta = _mm512_abs_pd(_mm512_sub_pd(centre, average));
+		maxDeltas = _mm512_mask_max_pd(maxDeltas, mask, delta, maxDeltas);
+	}
+
+	return _mm512_reduce_max_pd(maxDeltas);
+}
+
+__attribute__((target("avx512f")))
+static double relaxRowColourAvx512(double *current, const double *above, const double *below,
+								   int colStart, int colEnd, double omega) {
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	const __m512d keep = _mm512_set1_pd(1 - omega);
+	const __m512d move = _mm512_set1_pd(omega);
+	const __mmask8 lanes = 0x55;
+	__m512d maxDeltas = _mm512_setzero_pd();
+	int col = colStart;
+
+	__m512i before = _mm512_castpd_si512(_mm512_set1_pd(current[colStart - 1]));
+
+	for (; col + 7 <= colEnd; col += 8) {
+		__m512d centre = _mm512_loadu_pd(current + col);
+		__m512i bits = _mm512_castpd_si512(centre);
+		__m512d left = _mm512_castsi512_pd(_mm512_alignr_epi64(bits, before, 7));
+		__m512d right = _mm512_castsi512_pd(_mm512_alignr_epi64(bits, bits, 1));
+		__m512d sum = _mm512_add_pd(_mm512_loadu_pd(above + col), _mm512_loadu_pd(below + col));
+		sum = _mm512_add_pd(sum, left);
+		sum = _mm512_add_pd(sum, right);
+		__m512d average = _mm512_mul_pd(sum, quarter);
+		__m512d relaxed = _mm512_add_pd(_mm512_mul_pd(keep, centre), _mm512_mul_pd(move, average));
+		_mm512_mask_storeu_pd(current + col, lanes, relaxed);
+		before = bits;
+
+		__m512d delta = _mm512_abs_pd(_mm512_sub_pd(centre, relaxed));
+		maxDeltas = _mm512_mask_max_pd(maxDeltas, lanes, delta, maxDeltas);
+	}
+
+	double maxDelta = _mm512_reduce_max_pd(maxDeltas);
+	_mm256_zeroupper();
+	double tailDelta = relaxRowColourScalar(current, above, below, col, colEnd, omega);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+/* Float vectors hold twice as many cells, otherwise they're the double versions */
+
+__attribute__((target("avx2")))
+static float relaxRowFloatAvx2(const float *current, const float *above, const float *below,
+							   float *relaxed, int colStart, int colEnd) {
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	__m256 maxDeltas = _mm256_setzero_ps();
+	int col = colStart;
+
+	for (; col + 8 <= colEnd; col += 8) {
+		__m256 centre = _mm256_loadu_ps(current + col);
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(above + col), _mm256_loadu_ps(below + col));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(current + col - 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(current + col + 1));
+		__m256 average = _mm256_mul_ps(sum, quarter);
+		_mm256_storeu_ps(relaxed + col, average);
+
+		__m256 delta = _mm256_andnot_ps(signBit, _mm256_sub_ps(centre, average));
+		maxDeltas = _mm256_max_ps(delta, maxDeltas);
+	}
+
+	__m128 quad = _mm_max_ps(_mm256_castps256_ps128(maxDeltas), _mm256_extractf128_ps(maxDeltas, 1));
+	quad = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+	quad = _mm_max_ss(quad, _mm_shuffle_ps(quad, quad, 1));
+	float maxDelta = _mm_cvtss_f32(quad);
+
+	_mm256_zeroupper();
+	float tailDelta = relaxRowFloatScalar(current, above, below, relaxed, col, colEnd);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx2")))
+static float relaxRowColourFloatAvx2(float *current, const float *above, const float *below,
+									 int colStart, int colEnd, float omega) {
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 keep = _mm256_set1_ps(1 - omega);
+	const __m256 move = _mm256_set1_ps(omega);
+	const __m256i lanes = _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1);
+	__m256 maxDeltas = _mm256_setzero_ps();
+	int col = colStart;
+
+	const __m256i nextLane = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+	__m256i before = _mm256_castps_si256(_mm256_set1_ps(current[colStart - 1]));
+
+	for (; col + 7 <= colEnd; col += 8) {
+		__m256 centre = _mm256_loadu_ps(current + col);
+		__m256i bits = _mm256_castps_si256(centre);
+		__m256 left = _mm256_castsi256_ps(_mm256_alignr_epi8(bits, _mm256_permute2x128_si256(before, bits, 0x21), 12));
+		__m256 right = _mm256_permutevar8x32_ps(centre, nextLane);
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(above + col), _mm256_loadu_ps(below + col));
+		sum = _mm256_add_ps(sum, left);
+		sum = _mm256_add_ps(sum, right);
+		__m256 average = _mm256_mul_ps(sum, quarter);
+		__m256 relaxed = _mm256_add_ps(_mm256_mul_ps(keep, centre), _mm256_mul_ps(move, average));
+		_mm256_maskstore_ps(current + col, lanes, relaxed);
+		before = bits;
+
+		__m256 delta = _mm256_andnot_ps(signBit, _mm256_sub_ps(centre, relaxed));
+		delta = _mm256_and_ps(delta, _mm256_castsi256_ps(lanes));
+		maxDeltas = _mm256_max_ps(delta, maxDeltas);
+	}
+
+	__m128 quad = _mm_max_ps(_mm256_castps256_ps128(maxDeltas), _mm256_extractf128_ps(maxDeltas, 1));
+	quad = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+	quad = _mm_max_ss(quad, _mm_shuffle_ps(quad, quad, 1));
+	float maxDelta = _mm_cvtss_f32(quad);
+
+	_mm256_zeroupper();
+	float tailDelta = relaxRowColourFloatScalar(current, above, below, col, colEnd, omega);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx512f")))
+static float relaxRowFloatAvx512(const float *current, const float *above, const float *below,
+								 float *relaxed, int colStart, int colEnd) {
+	const __m512 quarter = _mm512_set1_ps(0.25f);
+	__m512 maxDeltas = _mm512_setzero_ps();
+	int col = colStart;
+
+	for (; col + 16 <= colEnd; col += 16) {
+		__m512 centre = _mm512_loadu_ps(current + col);
+		__m512 sum = _mm512_add_ps(_mm512_loadu_ps(above + col), _mm512_loadu_ps(below + col));
+		sum = _mm512_add_ps(sum, _mm512_loadu_ps(current + col - 1));
+		sum = _mm512_add_ps(sum, _mm512_loadu_ps(current + col + 1));
+		__m512 average = _mm512_mul_ps(sum, quarter);
+		_mm512_storeu_ps(relaxed + col, average);
+
+		__m512 delta = _mm512_abs_ps(_mm512_sub_ps(centre, average));
+		maxDeltas = _mm512_max_ps(delta, maxDeltas);
+	}
+
+	if (col < colEnd) {
+		__mmask16 mask = (__mmask16) ((1u << (colEnd - col)) - 1);
+		__m512 centre = _mm512_maskz_loadu_ps(mask, current + col);
+		__m512 sum = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, above + col),
+								   _mm512_maskz_loadu_ps(mask, below + col));
+		sum = _mm512_add_ps(sum, _mm512_maskz_loadu_ps(mask, current + col - 1));
+		sum = _mm512_add_ps(sum, _mm512_maskz_loadu_ps(mask, current + col + 1));
+		__m512 average = _mm512_mul_ps(sum, quarter);
+		_mm512_mask_storeu_ps(relaxed + col, mask, average);
+
+		__m512 delta = _mm512_abs_ps(_mm512_sub_ps(centre, average));
+		maxDeltas = _mm512_mask_max_ps(maxDeltas, mask, delta, maxDeltas);
+	}
+
+	return _mm512_reduce_max_ps(maxDeltas);
+}
+
+__attribute__((target("avx512f")))
+static float relaxRowColourFloatAvx512(float *current, const float *above, const float *below,
+									   int colStart, int colEnd, float omega) {
+	const __m512 quarter = _mm512_set1_ps(0.25f);
+	const __m512 keep = _mm512_set1_ps(1 - omega);
+	const __m512 move = _mm512_set1_ps(omega);
+	const __mmask16 lanes = 0x5555;
+	__m512 maxDeltas = _mm512_setzero_ps();
+	int col = colStart;
+
+	__m512i before = _mm512_castps_si512(_mm512_set1_ps(current[colStart - 1]));
+
+	for (; col + 15 <= colEnd; col += 16) {
+		__m512 centre = _mm512_loadu_ps(current + col);
+		__m512i bits = _mm512_castps_si512(centre);
+		__m512 left = _mm512_castsi512_ps(_mm512_alignr_epi32(bits, before, 15));
+		__m512 right = _mm512_castsi512_ps(_mm512_alignr_epi32(bits, bits, 1));
+		__m512 sum = _mm512_add_ps(_mm512_loadu_ps(above + col), _mm512_loadu_ps(below + col));
+		sum = _mm512_add_ps(sum, left);
+		sum = _mm512_add_ps(sum, right);
+		__m512 average = _mm512_mul_ps(sum, quarter);
+		__m512 relaxed = _mm512_add_ps(_mm512_mul_ps(keep, centre), _mm512_mul_ps(move, average));
+		_mm512_mask_storeu_ps(current + col, lanes, relaxed);
+		before = bits;
+
+		__m512 delta = _mm512_abs_ps(_mm512_sub_ps(centre, relaxed));
+		maxDeltas = _mm512_mask_max_ps(maxDeltas, lanes, delta, maxDeltas);
+	}
+
+	float maxDelta = _mm512_reduce_max_ps(maxDeltas);
+	_mm256_zeroupper();
+	float tailDelta = relaxRowColourFloatScalar(current, above, below, col, colEnd, omega);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx2")))
+static double relaxRowVolumeAvx2(const double *current, const double *above, const double *below,
+								 const double *front, const double *back, double *relaxed, int colStart, int colEnd) {
+	const __m256d six = _mm256_set1_pd(6.0);
+	const __m256d signBit = _mm256_set1_pd(-0.0);
+	__m256d maxDeltas = _mm256_setzero_pd();
+	int col = colStart;
+
+	for (; col + 4 <= colEnd; col += 4) {
+		__m256d centre = _mm256_loadu_pd(current + col);
+		__m256d sum = _mm256_add_pd(_mm256_loadu_pd(above + col), _mm256_loadu_pd(below + col));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(current + col - 1));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(current + col + 1));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(front + col));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(back + col));
+		__m256d average = _mm256_div_pd(sum, six);
+		_mm256_storeu_pd(relaxed + col, average);
+
+		__m256d delta = _mm256_andnot_pd(signBit, _mm256_sub_pd(centre, average));
+		maxDeltas = _mm256_max_pd(delta, maxDeltas);
+	}
+
+	__m128d pair = _mm_max_pd(_mm256_castpd256_pd128(maxDeltas), _mm256_extractf128_pd(maxDeltas, 1));
+	pair = _mm_max_sd(pair, _mm_unpackhi_pd(pair, pair));
+	double maxDelta = _mm_cvtsd_f64(pair);
+
+	_mm256_zeroupper();
+	double tailDelta = relaxRowVolumeScalar(current, above, below, front, back, relaxed, col, colEnd);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+__attribute__((target("avx512f")))
+static double relaxRowVolumeAvx512(const double *current, const double *above, const double *below,
+								   const double *front, const double *back, double *relaxed, int colStart, int colEnd) {
+	const __m512d six = _mm512_set1_pd(6.0);
+	__m512d maxDeltas = _mm512_setzero_pd();
+	int col = colStart;
+
+	for (; col + 8 <= colEnd; col += 8) {
+		__m512d centre = _mm512_loadu_pd(current + col);
+		__m512d sum = _mm512_add_pd(_mm512_loadu_pd(above + col), _mm512_loadu_pd(below + col));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(current + col - 1));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(current + col + 1));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(front + col));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(back + col));
+		__m512d average = _mm512_div_pd(sum, six);
+		_mm512_storeu_pd(relaxed + col, average);
+
+		__m512d delta = _mm512_abs_pd(_mm512_sub_pd(centre, average));
+		maxDeltas = _mm512_max_pd(delta, maxDeltas);
+	}
+
+	double maxDelta = _mm512_reduce_max_pd(maxDeltas);
+	_mm256_zeroupper();
+	double tailDelta = relaxRowVolumeScalar(current, above, below, front, back, relaxed, col, colEnd);
+	return tailDelta > maxDelta ? tailDelta : maxDelta;
+}
+
+#endif
+
+void stencilInit(void) {
+	stencilUse("scalar");
+
+#ifdef STENCIL_X86
+	__builtin_cpu_init();
+	if (!stencilUse("avx512"))
+		stencilUse("avx2");
+#endif
+}
+
+int stencilUse(const char *isa) {
+	if (strcmp(isa, "scalar") == 0) {
+		relaxRow = relaxRowScalar;
+		relaxRowColour = relaxRowColourScalar;
+		relaxRowFloat = relaxRowFloatScalar;
+		relaxRowColourFloat = relaxRowColourFloatScalar;
+		relaxRowVolume = relaxRowVolumeScalar;
+		relaxRowName = "scalar";
+		return 1;
+	}
+
+#ifdef STENCIL_X86
+	__builtin_cpu_init();
+	if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		relaxRow = relaxRowAvx2;
+		relaxRowColour = relaxRowColourAvx2;
+		relaxRowFloat = relaxRowFloatAvx2;
+		relaxRowColourFloat = relaxRowColourFloatAvx2;
+		relaxRowVolume = relaxRowVolumeAvx2;
+		relaxRowName = "avx2";
+		return 1;
+	}
+	if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+		relaxRow = relaxRowAvx512;
+		relaxRowColour = relaxRowColourAvx512;
+		relaxRowFloat = relaxRowFloatAvx512;
+		relaxRowColourFloat = relaxRowColourFloatAvx512;
+		relaxRowVolume = relaxRowVolumeAvx512;
+		relaxRowName = "avx512";
+		return 1;
+	}
+#endif
+
+	return 0;
+}
+
+double residualSquares(const double *current, const double *above, const double *below,
+					   int colStart, int colEnd) {
+	double sum = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		double residual = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0 - current[col];
+		sum += residual * residual;
+	}
+
+	return sum;
+}
+
+double residualSquaresFloat(const float *current, const float *above, const float *below,
+							int colStart, int colEnd) {
+	double sum = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		float residual = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f - current[col];
+		sum += (double) residual * residual;
+	}
+
+	return sum;
+}
+
+double residualSquaresVolume(const double *current, const double *above, const double *below,
+							 const double *front, const double *back, int colStart, int colEnd) {
+	double sum = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		double residual = (above[col] + below[col] + current[col-1] + current[col+1] + front[col] + back[col]) / 6.0
+						  - current[col];
+		sum += residual * residual;
+	}
+
+	return sum;
+}
+
+/* The masked versions choose between the relaxed value and the one already there rather
+ * than branch, which the compiler turns into a vector blend. A fixed cell changes by 0 */
+double relaxRowMasked(const double *current, const double *above, const double *below,
+					  double *relaxed, const unsigned char *fixed, int colStart, int colEnd) {
+	double maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		double average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0;
+		relaxed[col] = fixed[col] ? current[col] : average;
+
+		double delta = fabs(current[col] - relaxed[col]);
+		maxDelta = delta > maxDelta ? delta : maxDelta;
+	}
+
+	return maxDelta;
+}
+
+double relaxRowColourMasked(double *current, const double *above, const double *below,
+							const unsigned char *fixed, int colStart, int colEnd, double omega) {
+	double maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col += 2) {
+		double average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0;
+		double relaxed = fixed[col] ? current[col] : (1 - omega) * current[col] + omega * average;
+
+		double delta = fabs(current[col] - relaxed);
+		maxDelta = delta > maxDelta ? delta : maxDelta;
+		current[col] = relaxed;
+	}
+
+	return maxDelta;
+}
+
+float relaxRowFloatMasked(const float *current, const float *above, const float *below,
+						  float *relaxed, const unsigned char *fixed, int colStart, int colEnd) {
+	float maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		float average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f;
+		relaxed[col] = fixed[col] ? current[col] : average;
+
+		float delta = fabsf(current[col] - relaxed[col]);
+		maxDelta = delta > maxDelta ? delta : maxDelta;
+	}
+
+	return maxDelta;
+}
+
+float relaxRowColourFloatMasked(float *current, const float *above, const float *below,
+								const unsigned char *fixed, int colStart, int colEnd, float omega) {
+	float maxDelta = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col += 2) {
+		float average = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f;
+		float relaxed = fixed[col] ? current[col] : (1 - omega) * current[col] + omega * average;
+
+		float delta = fabsf(current[col] - relaxed);
+		maxDelta = delta > maxDelta ? delta : maxDelta;
+		current[col] = relaxed;
+	}
+
+	return maxDelta;
+}
+
+double residualSquaresMasked(const double *current, const double *above, const double *below,
+							 const unsigned char *fixed, int colStart, int colEnd) {
+	double sum = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		double residual = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0 - current[col];
+		sum += fixed[col] ? 0 : residual * residual;
+	}
+
+	return sum;
+}
+
+double residualSquaresFloatMasked(const float *current, const float *above, const float *below,
+								  const unsigned char *fixed, int colStart, int colEnd) {
+	double sum = 0;
+	int col;
+
+	for (col = colStart; col < colEnd; col++) {
+		float residual = (above[col] + below[col] + current[col-1] + current[col+1]) / 4.0f - current[col];
+		sum += fixed[col] ? 0 : (double) residual * residual;
+	}
+
+	return sum;
+}
+
+/* Jacobi's spectral radius on a rows x cols array is the mean of the cosines of each
+ * side's slowest mode. Square arrays use the closed form, which rounds a little less */
+double optimalOmega(int rows, int cols) {
+	if (rows < 3 || cols < 3)
+		return 1;
+	if (rows == cols)
+		return 2 / (1 + sin(M_PI / (rows - 1)));
+
+	double radius = (cos(M_PI / (rows - 1)) + cos(M_PI / (cols - 1))) / 2;
+	return 2 / (1 + sqrt(1 - radius * radius));
+}
+
+const char* stencilName(void) {
+	return relaxRowName;
+}
+
+const char* arithmeticName(enum Arithmetic arithmetic) {
+	if (arithmetic == ARITHMETIC_FLOAT)
+		return "float";
+	if (arithmetic == ARITHMETIC_MIXED)
+		return "mixed";
+	return "double";
+}
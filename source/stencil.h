@@ -0,0 +1,101 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+/* The 5 point stencil at the heart of the relaxation, shared by the sequential and
+ * parallel programs. Vector versions are picked at runtime from what the CPU supports,
+ * and give exactly the same results as the plain C version.
+ */
+
+/* How the array is relaxed. Jacobi works from one array into another, Gauss-Seidel and
+ * successive over-relaxation (SOR) work in place on alternate colours of a checkerboard.
+ * Multigrid uses Gauss-Seidel on a stack of coarser arrays as well (see multigrid.h) */
+enum Method { METHOD_JACOBI, METHOD_GAUSS_SEIDEL, METHOD_SOR, METHOD_MULTIGRID };
+
+/* What the cells are stored and relaxed in. Float halves the memory every sweep reads
+ * and writes and fits twice as many cells in a vector, but its changes stop meaning
+ * anything below about FLOAT_FLOOR for cells around 1. Mixed relaxes in float until the
+ * changes get down there, then finishes off in double */
+enum Arithmetic { ARITHMETIC_DOUBLE, ARITHMETIC_FLOAT, ARITHMETIC_MIXED };
+
+#define FLOAT_FLOOR 0.00001
+
+/* Relaxes cells colStart up to but not including colEnd of one row. current, above and
+ * below point to the start of the row and its neighbours in the array being read from,
+ * relaxed to the start of the row in the array being written to.
+ * Returns the largest change made to any cell.
+ *
+ * No version of any of these reads outside columns colStart - 1 to colEnd, vector ones
+ * included, so columns beyond can be changing underneath, like a halo still arriving. */
+typedef double (*RelaxRowFunction)(const double *current, const double *above, const double *below,
+								   double *relaxed, int colStart, int colEnd);
+
+/* Relaxes in place the cells colStart, colStart + 2, colStart + 4... up to but not including
+ * colEnd of one row, as one colour of a red-black sweep. Each cell moves omega of the way
+ * from its value towards the average of its neighbours, so 1 is Gauss-Seidel and above 1
+ * is over-relaxation. Neighbours are the other colour, so aren't changed by this.
+ * Returns the largest change made to any cell. */
+typedef double (*RelaxRowColourFunction)(double *current, const double *above, const double *below,
+										 int colStart, int colEnd, double omega);
+
+/* The same again in float */
+typedef float (*RelaxRowFloatFunction)(const float *current, const float *above, const float *below,
+									   float *relaxed, int colStart, int colEnd);
+typedef float (*RelaxRowColourFloatFunction)(float *current, const float *above, const float *below,
+											 int colStart, int colEnd, float omega);
+
+/* Relaxes one row of a plane of a 3D array with the 7 point stencil, each cell becoming
+ * the average of its neighbours in the row, the rows above and below it, and the rows in
+ * the same place in the planes in front and behind. Otherwise as RelaxRowFunction */
+typedef double (*RelaxRowVolumeFunction)(const double *current, const double *above, const double *below,
+										 const double *front, const double *back, double *relaxed,
+										 int colStart, int colEnd);
+
+/* Sum of the squared residuals of cells colStart up to but not including colEnd of one
+ * row, the residual of a cell being the change a Jacobi relaxation would make to it */
+double residualSquares(const double *current, const double *above, const double *below,
+					   int colStart, int colEnd);
+double residualSquaresFloat(const float *current, const float *above, const float *below,
+							int colStart, int colEnd);
+double residualSquaresVolume(const double *current, const double *above, const double *below,
+							 const double *front, const double *back, int colStart, int colEnd);
+
+/* Versions of the above for rows with cells fixed by a mask, where fixed[col] is nonzero.
+ * Fixed cells keep their value and count as no change and no residual. These aren't
+ * vectorised by hand, so are only for the parts of an array that have fixed cells in */
+double relaxRowMasked(const double *current, const double *above, const double *below,
+					  double *relaxed, const unsigned char *fixed, int colStart, int colEnd);
+double relaxRowColourMasked(double *current, const double *above, const double *below,
+							const unsigned char *fixed, int colStart, int colEnd, double omega);
+float relaxRowFloatMasked(const float *current, const float *above, const float *below,
+						  float *relaxed, const unsigned char *fixed, int colStart, int colEnd);
+float relaxRowColourFloatMasked(float *current, const float *above, const float *below,
+								const unsigned char *fixed, int colStart, int colEnd, float omega);
+double residualSquaresMasked(const double *current, const double *above, const double *below,
+							 const unsigned char *fixed, int colStart, int colEnd);
+double residualSquaresFloatMasked(const float *current, const float *above, const float *below,
+								  const unsigned char *fixed, int colStart, int colEnd);
+
+extern RelaxRowFunction relaxRow;
+extern RelaxRowColourFunction relaxRowColour;
+extern RelaxRowFloatFunction relaxRowFloat;
+extern RelaxRowColourFloatFunction relaxRowColourFloat;
+extern RelaxRowVolumeFunction relaxRowVolume;
+
+/* Points relaxRow, relaxRowColour, their float versions and relaxRowVolume at the best version for this CPU. Must be called before relaxRow is used */
+void stencilInit(void);
+
+/* Forces a particular version: "scalar", "avx2" or "avx512".
+ * Returns 0 if the CPU doesn't support it, leaving the current choice in place */
+int stencilUse(const char *isa);
+
+/* Best SOR omega for a rows x cols array, 2 / (1 + sin(pi / (dimension - 1))) when
+ * square, the optimum for averaging neighbours with fixed edges. Cells fixed by a mask
+ * only speed convergence up, so this is still a safe choice with one */
+double optimalOmega(int rows, int cols);
+
+/* Name of the version relaxRow and relaxRowColour currently point at */
+const char* stencilName(void);
+
+const char* arithmeticName(enum Arithmetic arithmetic);
+
+#endif
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stencil.h"
+#include "gridio.h"
+#include "convergence.h"
+#include "stream.h"
+
+/* Level s holds rows after s sweeps of this pass in a ring, row r at r % ringRows[s].
+ * Level 0 is where the reader puts bands, three of them: the one being read, the one
+ * being relaxed and the one before, whose last row that still needs. Level sweeps is
+ * where the writer takes rows from, two bands' worth: the one being written and the one
+ * being relaxed. Those between only need the rows of this band and the two below them.
+ *
+ * Bands are counted off by three counters, each thread waiting for the one before it:
+ * the reader can refill a band once it's no longer needed, the solver relax one once
+ * it's read and its place in the last level written, the writer write one once relaxed.
+ */
+struct Stream {
+	int inFd; // Read on the first pass
+	int fd; // Written every pass, and read on the passes after the first
+	int rows, cols;
+	int sweeps;
+	int bandRows;
+	int bandCount;
+	int threads;
+	double **levels;
+	int *ringRows;
+
+	pthread_t reader, writer;
+	pthread_mutex_t lock;
+	pthread_cond_t changed; // Signalled when any of the counters moves on
+	int read; // Bands of this pass read, relaxed and written
+	int relaxed;
+	int written;
+	int failed;
+	int started; // 1 once every worker has been created, or one couldn't be
+	int workersFailed; // A worker couldn't be created, so none of them relax
+	int threadFailed; // A reader, writer or worker couldn't be created
+	int readerStarted, writerStarted; // For this pass
+
+	pthread_barrier_t barrier;
+	double *deltas; // Each thread's largest change on the last sweep of the pass
+	struct Convergence convergence;
+	int passes;
+	int finished;
+};
+
+struct StreamThread {
+	struct Stream *stream;
+	int id;
+};
+
+void streamOptionsInit(struct StreamOptions *options) {
+	options->precision = 0.0000000001;
+	options->sweeps = 1;
+	options->bandRows = 0;
+	options->threads = 1;
+}
+
+static double* levelRow(struct Stream *stream, int level, int row) {
+	return stream->levels[level] + (size_t)(row % stream->ringRows[level]) * stream->cols;
+}
+
+/* Rows up to, but not including, this one have had level sweeps once band is relaxed.
+ * Each sweep needs the row below it from the sweep before, so lags one row further
+ * behind, until the last band finishes them all */
+static int levelEnd(struct Stream *stream, int level, int band) {
+	if (band < 0)
+		return 0;
+
+	int end = (band + 1) * stream->bandRows;
+	if (end >= stream->rows)
+		return stream->rows;
+	return end - level > 0 ? end - level : 0;
+}
+
+/* Waits for counter to reach value. Returns 1 if reading or writing has failed */
+static int waitFor(struct Stream *stream, int *counter, int value) {
+	pthread_mutex_lock(&stream->lock);
+	while (*counter < value)
+		pthread_cond_wait(&stream->changed, &stream->lock);
+	int failed = stream->failed;
+	pthread_mutex_unlock(&stream->lock);
+	return failed;
+}
+
+static void advance(struct Stream *stream, int *counter, int ok) {
+	pthread_mutex_lock(&stream->lock);
+	(*counter)++;
+	if (!ok)
+		stream->failed = 1;
+	pthread_cond_broadcast(&stream->changed);
+	pthread_mutex_unlock(&stream->lock);
+}
+
+/* Reads each band once the one three before, which it goes over, has been relaxed past.
+ * After a failure it carries on counting without reading, so the solver isn't left waiting */
+static void* streamReader(void *td) {
+	struct Stream *stream = (struct Stream*) td;
+	int fd = stream->passes == 0 ? stream->inFd : stream->fd;
+	int band;
+
+	for (band = 0; band < stream->bandCount; band++) {
+		int failed = waitFor(stream, &stream->relaxed, band - 1);
+
+		int first = band * stream->bandRows;
+		int rows = levelEnd(stream, 0, band) - first;
+		int ok = failed || gridReadValues(fd, levelRow(stream, 0, first), (size_t)first * stream->cols,
+										  (size_t)rows * stream->cols);
+		advance(stream, &stream->read, ok);
+	}
+
+	return NULL;
+}
+
+/* Writes the rows each band finished, in two pieces when they wrap round the ring */
+static void* streamWriter(void *td) {
+	struct Stream *stream = (struct Stream*) td;
+	int last = stream->sweeps;
+	int band;
+
+	for (band = 0; band < stream->bandCount; band++) {
+		int failed = waitFor(stream, &stream->relaxed, band + 1);
+
+		int row = levelEnd(stream, last, band - 1);
+		int end = levelEnd(stream, last, band);
+		int ok = 1;
+		while (ok && !failed && row < end) {
+			int rows = stream->ringRows[last] - row % stream->ringRows[last];
+			if (rows > end - row)
+				rows = end - row;
+			ok = gridWriteValues(stream->fd, levelRow(stream, last, row),
+								 (size_t)row * stream->cols, (size_t)rows * stream->cols);
+			row += rows;
+		}
+		advance(stream, &stream->written, ok);
+	}
+
+	return NULL;
+}
+
+/* Starts the reader or writer for a pass. If it can't be, its counter is run to the end
+ * with the stream failed, as after a failed read or write, so nothing waits on it */
+static int startPass(struct Stream *stream, pthread_t *thread, void* (*run)(void*), int *counter) {
+	if (pthread_create(thread, NULL, run, stream) == 0)
+		return 1;
+
+	pthread_mutex_lock(&stream->lock);
+	*counter = stream->bandCount;
+	stream->failed = 1;
+	stream->threadFailed = 1;
+	pthread_cond_broadcast(&stream->changed);
+	pthread_mutex_unlock(&stream->lock);
+	return 0;
+}
+
+/* Sweep level of this thread's share of the rows band brings in reach. The fixed edge
+ * rows and columns are carried up unchanged. Returns the largest change */
+static double relaxLevel(struct Stream *stream, int id, int level, int band) {
+	int cols = stream->cols;
+	int start = levelEnd(stream, level, band - 1);
+	int rows = levelEnd(stream, level, band) - start;
+	int first = start + (int) ((long) rows * id / stream->threads);
+	int end = start + (int) ((long) rows * (id + 1) / stream->threads);
+	double maxDelta = 0;
+	int row;
+
+	for (row = first; row < end; row++) {
+		const double *current = levelRow(stream, level - 1, row);
+		double *relaxed = levelRow(stream, level, row);
+
+		if (row == 0 || row == stream->rows - 1) {
+			memcpy(relaxed, current, cols * sizeof(double));
+			continue;
+		}
+
+		double delta = relaxRow(current, levelRow(stream, level - 1, row - 1), levelRow(stream, level - 1, row + 1),
+								relaxed, 1, cols - 1);
+		relaxed[0] = current[0];
+		relaxed[cols - 1] = current[cols - 1];
+		if (delta > maxDelta)
+			maxDelta = delta;
+	}
+
+	return maxDelta;
+}
+
+/* Thread 0 starts the reader and writer for each pass and decides after it whether
+ * another is needed. Every thread relaxes its share of each sweep of each band, waiting
+ * for the rest before the next sweep reads what they wrote */
+static void* streamRelax(void *td) {
+	struct StreamThread *thread = (struct StreamThread*) td;
+	struct Stream *stream = thread->stream;
+	int band, level;
+
+	// The barriers need every worker, so none starts until all have been created
+	waitFor(stream, &stream->started, 1);
+	if (stream->workersFailed)
+		return NULL;
+
+	while (1) {
+		double maxDelta = 0;
+
+		if (thread->id == 0) {
+			stream->read = stream->relaxed = stream->written = 0;
+			stream->readerStarted = startPass(stream, &stream->reader, streamReader, &stream->read);
+			stream->writerStarted = startPass(stream, &stream->writer, streamWriter, &stream->written);
+		}
+
+		for (band = 0; band < stream->bandCount; band++) {
+			if (thread->id == 0) {
+				waitFor(stream, &stream->read, band + 1);
+				waitFor(stream, &stream->written, band - 1);
+			}
+			pthread_barrier_wait(&stream->barrier);
+
+			for (level = 1; level <= stream->sweeps; level++) {
+				double delta = relaxLevel(stream, thread->id, level, band);
+				if (level == stream->sweeps && delta > maxDelta)
+					maxDelta = delta;
+				pthread_barrier_wait(&stream->barrier);
+			}
+
+			if (thread->id == 0)
+				advance(stream, &stream->relaxed, 1);
+		}
+
+		stream->deltas[thread->id] = maxDelta;
+		pthread_barrier_wait(&stream->barrier);
+
+		if (thread->id == 0) {
+			int t;
+			if (stream->readerStarted)
+				pthread_join(stream->reader, NULL);
+			if (stream->writerStarted)
+				pthread_join(stream->writer, NULL);
+
+			maxDelta = 0;
+			for (t = 0; t < stream->threads; t++)
+				if (stream->deltas[t] > maxDelta)
+					maxDelta = stream->deltas[t];
+			stream->passes++;
+			stream->finished = stream->failed
+							   || convergenceCheck(&stream->convergence, stream->passes * stream->sweeps, maxDelta);
+		}
+		pthread_barrier_wait(&stream->barrier);
+
+		if (stream->finished)
+			break;
+	}
+
+	return NULL;
+}
+
+/* 1 if both paths name the same file, so it's to be relaxed in place */
+static int sameFile(const char *inPath, const char *outPath) {
+	struct stat in, out;
+
+	return stat(inPath, &in) == 0 && stat(outPath, &out) == 0
+		   && in.st_dev == out.st_dev && in.st_ino == out.st_ino;
+}
+
+int streamSolve(const char *inPath, const char *outPath, int rows, int cols,
+				const struct StreamOptions *options, struct StreamResult *result) {
+	struct Stream stream;
+	size_t cells = (size_t)rows * cols;
+	size_t rowBytes = (size_t)cols * sizeof(double);
+	int l, t;
+
+	if (rows < 3 || cols < 3) {
+		fprintf(stderr, "LOG ERROR - Streaming needs at least 3 rows and 3 columns.\n");
+		return 0;
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	stream.rows = rows;
+	stream.cols = cols;
+	stream.sweeps = options->sweeps > 0 ? options->sweeps : 1;
+	stream.threads = options->threads > 0 ? options->threads : 1;
+	stream.bandRows = options->bandRows > 0 ? options->bandRows : (int) (STREAM_BAND_BYTES / rowBytes);
+	if (stream.bandRows < 2) // The band before has to still hold the row above this one
+		stream.bandRows = 2;
+	if (stream.bandRows > rows)
+		stream.bandRows = rows;
+	stream.bandCount = (rows + stream.bandRows - 1) / stream.bandRows;
+
+	if (sameFile(inPath, outPath)) {
+		stream.fd = gridOpen(outPath, cells, 1);
+		stream.inFd = stream.fd;
+	} else {
+		stream.inFd = gridOpen(inPath, cells, 0);
+		stream.fd = stream.inFd >= 0 ? gridCreate(outPath, rows, cols) : -1;
+	}
+	if (stream.inFd < 0 || stream.fd < 0) {
+		if (stream.inFd >= 0)
+			close(stream.inFd);
+		return 0;
+	}
+	posix_fadvise(stream.inFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(stream.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	// The last band can run sweeps rows longer, as it finishes every sweep
+	int sweeps = stream.sweeps;
+	stream.levels = calloc(sweeps + 1, sizeof(double*));
+	stream.ringRows = malloc((sweeps + 1) * sizeof(int));
+	stream.deltas = malloc(stream.threads * sizeof(double));
+	int ok = stream.levels != NULL && stream.ringRows != NULL && stream.deltas != NULL;
+	double memory = 0;
+	for (l = 0; ok && l <= sweeps; l++) {
+		if (l == 0)
+			stream.ringRows[l] = 3 * stream.bandRows;
+		else if (l == sweeps)
+			stream.ringRows[l] = 2 * (stream.bandRows + sweeps);
+		else
+			stream.ringRows[l] = stream.bandRows + sweeps + 2;
+		stream.levels[l] = malloc(stream.ringRows[l] * rowBytes);
+		ok = stream.levels[l] != NULL;
+		memory += (double) stream.ringRows[l] * rowBytes;
+	}
+
+	if (ok) {
+		struct StreamThread threads[stream.threads];
+		pthread_t workers[stream.threads];
+
+		pthread_mutex_init(&stream.lock, NULL);
+		pthread_cond_init(&stream.changed, NULL);
+		pthread_barrier_init(&stream.barrier, NULL, stream.threads);
+		convergenceInit(&stream.convergence, NORM_MAX, options->precision, sweeps);
+
+		for (t = 0; t < stream.threads; t++) {
+			threads[t].stream = &stream;
+			threads[t].id = t;
+		}
+		int created = 1;
+		while (created < stream.threads && pthread_create(&workers[created], NULL, streamRelax, &threads[created]) == 0)
+			created++;
+		stream.workersFailed = created < stream.threads;
+		stream.threadFailed = stream.workersFailed;
+		advance(&stream, &stream.started, !stream.workersFailed);
+
+		if (!stream.workersFailed)
+			streamRelax(&threads[0]);
+		for (t = 1; t < created; t++)
+			pthread_join(workers[t], NULL);
+
+		pthread_barrier_destroy(&stream.barrier);
+		pthread_cond_destroy(&stream.changed);
+		pthread_mutex_destroy(&stream.lock);
+
+		if (stream.threadFailed)
+			fprintf(stderr, "LOG ERROR - Failed to start the threads to stream %s with.\n", inPath);
+		else if (stream.failed)
+			fprintf(stderr, "LOG ERROR - Failed reading or writing %s.\n", stream.passes > 1 ? outPath : inPath);
+		ok = !stream.failed;
+	} else {
+		fprintf(stderr, "LOG ERROR - Failed to allocate bands of %d rows to stream through.\n", stream.bandRows);
+	}
+
+	if (result != NULL) {
+		result->count = stream.passes * sweeps;
+		result->passes = stream.passes;
+		result->maxDelta = stream.convergence.last;
+		result->bandRows = stream.bandRows;
+		result->bytesRead = (double) stream.passes * cells * sizeof(double);
+		result->bytesWritten = result->bytesRead;
+		result->memory = memory;
+	}
+
+	for (l = 0; stream.levels != NULL && l <= sweeps; l++)
+		free(stream.levels[l]);
+	free(stream.levels);
+	free(stream.ringRows);
+	free(stream.deltas);
+	if (stream.inFd != stream.fd)
+		close(stream.inFd);
+	if (fsync(stream.fd) != 0) {
+		fprintf(stderr, "LOG ERROR - Failed to write %s.\n", outPath);
+		ok = 0;
+	}
+	close(stream.fd);
+
+	return ok;
+}
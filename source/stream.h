@@ -0,0 +1,48 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/* Jacobi relaxation of grids too big to hold in memory. The grid stays in a binary grid
+ * file (see gridio.h) and each pass streams it through memory a band of rows at a time,
+ * from the top down, writing each row back once it has been relaxed sweeps times.
+ *
+ * Sweep s of a row only needs sweep s - 1 of the rows either side, so the sweeps run
+ * one behind another down the grid: each band read in is relaxed once, the band before
+ * it a second time, and so on, each sweep holding only a few bands of rows. Every row
+ * is read once and written once a pass however many sweeps it gets.
+ *
+ * A reader thread reads the next band while the solver relaxes this one and a writer
+ * thread writes out the last, so disk and cores are busy together. Rows are written back
+ * well behind where the reader has got to, so a pass works in place in one file.
+ */
+
+#define STREAM_BAND_BYTES (8 << 20) /* Default size of a band, big enough to read at full speed */
+
+struct StreamOptions {
+	double precision; // Stop once no cell changes by more than this on the last sweep of a pass
+	int sweeps; // Relaxations each pass, convergence is checked after the last of them
+	int bandRows; // Rows read and written at a time, 0 for STREAM_BAND_BYTES worth. At least 2
+	int threads; // Threads sharing the relaxing
+};
+
+struct StreamResult {
+	int count; // Relaxations
+	int passes; // Times the grid was read and written
+	double maxDelta; // Largest change on the last of them
+	int bandRows; // Rows read and written at a time actually used
+	double bytesRead;
+	double bytesWritten;
+	double memory; // Bytes of rows held in memory
+};
+
+/* One sweep a pass on one thread, in bands of STREAM_BAND_BYTES */
+void streamOptionsInit(struct StreamOptions *options);
+
+/* Relaxes the first rows x cols values of the binary grid file inPath, writing the
+ * result to a rows x cols binary grid file at outPath. The first pass reads inPath and
+ * each one after that works in place on outPath. outPath can be inPath, to relax it in
+ * place from the start. Returns 0, with a message on stderr, if a file can't be used or
+ * memory ran out */
+int streamSolve(const char *inPath, const char *outPath, int rows, int cols,
+				const struct StreamOptions *options, struct StreamResult *result);
+
+#endif